@@ -0,0 +1,115 @@
+// Microbenchmark for the allocation range index (src/alloc_index.h).
+//
+// Populates the index with N live allocations scattered over a device-like address
+// space, then reports ns/op for:
+//   lookup   - interior pointers of live allocations
+//   miss     - pointers in the gaps between allocations
+//   churn    - erase of a random live allocation plus insert of a new one
+// Afterwards random addresses are checked against a std::map of the same allocations.
+//
+// Build and run: make bench && ./build/bench/alloc_index_bench [allocations] [lookups]
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "alloc_index.h"
+
+using namespace rocm_accelprof;
+
+namespace {
+
+struct Range { uint64_t base, size; };
+
+template <typename F>
+double time_ns_per_op(size_t ops, F&& fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ops; i++) fn(i);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / ops;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t num_allocs = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100000;
+    size_t num_lookups = argc > 2 ? strtoull(argv[2], nullptr, 10) : 2000000;
+    if (num_allocs == 0) num_allocs = 1;
+    if (num_lookups == 0) num_lookups = 1;
+
+    // 2 MB aligned slots, 256 B to 1 MB used: every slot has a gap behind its allocation
+    std::mt19937_64 rng(42);
+    constexpr uint64_t kSlot = 2ull << 20;
+    uint64_t heap = 0x7f0000000000ull;
+    std::vector<uint64_t> slots(num_allocs * 2);
+    for (size_t i = 0; i < slots.size(); i++) slots[i] = heap + i * kSlot;
+    for (size_t i = slots.size() - 1; i > 0; i--) std::swap(slots[i], slots[rng() % (i + 1)]);
+
+    AllocIndex index;
+    std::map<uint64_t, uint64_t> reference;
+    std::vector<Range> live(num_allocs);
+    auto insert_time = time_ns_per_op(num_allocs, [&](size_t i) {
+        uint64_t size = 256 + rng() % (1ull << 20);
+        live[i] = {slots[i], size};
+        index.insert(slots[i], size, (int)(i % 8), MemoryKind::device);
+    });
+    for (const auto& r : live) reference[r.base] = r.size;
+
+    std::vector<uint64_t> hits(num_lookups), misses(num_lookups);
+    for (size_t i = 0; i < num_lookups; i++) {
+        const Range& r = live[rng() % num_allocs];
+        hits[i] = r.base + rng() % r.size;
+        misses[i] = r.base + r.size + rng() % (kSlot - r.size);
+    }
+
+    uint64_t found = 0;
+    double hit_ns = time_ns_per_op(num_lookups, [&](size_t i) {
+        index.with_allocation(hits[i], [&](Allocation& a) { found += a.base; });
+    });
+    double miss_ns = time_ns_per_op(num_lookups, [&](size_t i) {
+        found += index.with_allocation(misses[i], [](Allocation&) {});
+    });
+
+    // recycle the spare slots: free one live allocation, allocate in an unused slot
+    size_t churn_ops = num_allocs;
+    double churn_ns = time_ns_per_op(churn_ops, [&](size_t i) {
+        size_t victim = rng() % num_allocs;
+        index.erase(live[victim].base);
+        std::swap(live[victim].base, slots[num_allocs + i % num_allocs]);
+        live[victim].size = 256 + rng() % (1ull << 20);
+        index.insert(live[victim].base, live[victim].size, 0, MemoryKind::device);
+    });
+    reference.clear();
+    for (const auto& r : live) reference[r.base] = r.size;
+
+    // verify against the reference after churn
+    size_t errors = 0;
+    for (size_t i = 0; i < 100000; i++) {
+        uint64_t addr = heap + rng() % (slots.size() * kSlot);
+        auto it = reference.upper_bound(addr);
+        uint64_t expected = 0;
+        if (it != reference.begin() && addr < std::prev(it)->first + std::prev(it)->second) expected = std::prev(it)->first;
+        uint64_t got = 0;
+        index.with_allocation(addr, [&](Allocation& a) { got = a.base; });
+        if (got != expected) errors++;
+    }
+
+    printf("live allocations: %zu, lookups: %zu\n", index.size(), num_lookups);
+    printf("%-8s %10s\n", "op", "ns/op");
+    printf("%-8s %10.1f\n", "insert", insert_time);
+    printf("%-8s %10.1f\n", "lookup", hit_ns);
+    printf("%-8s %10.1f\n", "miss", miss_ns);
+    printf("%-8s %10.1f\n", "churn", churn_ns);
+    printf("checksum: %lx\n", (unsigned long)found);
+    if (errors != 0) {
+        fprintf(stderr, "%zu lookups disagree with the reference\n", errors);
+        return 1;
+    }
+    return 0;
+}
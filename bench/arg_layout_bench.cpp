@@ -0,0 +1,257 @@
+// Microbenchmark for the argument layout cache (src/arg_layout.h).
+//
+// Replays synthetic hipMalloc/hipFree/hipMemcpy/hipMemset/hipLaunchKernel records
+// through a local stand-in for rocprofiler_iterate_callback_tracing_kind_operation_args
+// and reports ns/event for:
+//   strcmp   - the previous per-call std::string(arg_name) comparisons
+//   indexed  - layout cache, arguments captured by position while iterating
+//   direct   - layout cache, arguments loaded from the payload at cached offsets
+//
+// Build and run: make bench && ./build/bench/arg_layout_bench [events]
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "arg_layout.h"
+
+using namespace rocm_accelprof;
+
+namespace {
+
+struct dim3_t { uint32_t x, y, z; };
+
+enum Op : int32_t { kOpMalloc, kOpFree, kOpMemcpy, kOpMemset, kOpLaunch, kNumOps };
+
+// stand-in for rocprofiler_callback_tracing_hip_api_data_t
+struct Payload {
+    uint64_t size;
+    union {
+        struct { void** ptr; size_t size; } hipMalloc;
+        struct { void* ptr; } hipFree;
+        struct { void* dst; const void* src; size_t sizeBytes; int kind; } hipMemcpy;
+        struct { void* dst; int value; size_t sizeBytes; } hipMemset;
+        struct { const void* function_address; dim3_t numBlocks; dim3_t dimBlocks;
+                 void** args; size_t sharedMemBytes; void* stream; } hipLaunchKernel;
+    } args;
+};
+
+struct Record {
+    Op operation;
+    Payload* payload;
+};
+
+typedef int (*arg_cb_t)(int32_t, int32_t, uint32_t, const void* const, int32_t,
+                        const char*, const char*, const char*, int32_t, void*);
+
+struct ArgDesc {
+    const char* name;
+    const char* type;
+    size_t offset;
+    size_t size;
+};
+
+#define ARG(OP, FIELD, TYPE) \
+    ArgDesc{#FIELD, TYPE, offsetof(Payload, args.OP.FIELD), sizeof(Payload::args.OP.FIELD)}
+
+const std::vector<ArgDesc> op_args[kNumOps] = {
+    {ARG(hipMalloc, ptr, "PPv"), ARG(hipMalloc, size, "m")},
+    {ARG(hipFree, ptr, "Pv")},
+    {ARG(hipMemcpy, dst, "Pv"), ARG(hipMemcpy, src, "PKv"), ARG(hipMemcpy, sizeBytes, "m"),
+     ARG(hipMemcpy, kind, "13hipMemcpyKind")},
+    {ARG(hipMemset, dst, "Pv"), ARG(hipMemset, value, "i"), ARG(hipMemset, sizeBytes, "m")},
+    {ARG(hipLaunchKernel, function_address, "PKv"), ARG(hipLaunchKernel, numBlocks, "4dim3"),
+     ARG(hipLaunchKernel, dimBlocks, "4dim3"), ARG(hipLaunchKernel, args, "PPv"),
+     ARG(hipLaunchKernel, sharedMemBytes, "m"), ARG(hipLaunchKernel, stream, "P12ihipStream_t")},
+};
+
+#undef ARG
+
+// Mimics the rocprofiler iterator: every argument is stringified before the callback.
+void standin_iterate(const Record& record, arg_cb_t cb, void* data)
+{
+    const char* base = reinterpret_cast<const char*>(record.payload);
+    uint32_t arg_num = 0;
+    for (const auto& arg : op_args[record.operation]) {
+        const char* addr = base + arg.offset;
+        uint64_t raw = 0;
+        memcpy(&raw, addr, arg.size < sizeof(raw) ? arg.size : sizeof(raw));
+        char buf[32];
+        snprintf(buf, sizeof(buf), "0x%lx", (unsigned long)raw);
+        std::string value_str(buf);
+        cb(0, record.operation, arg_num++, addr, 0, arg.type, arg.name, value_str.c_str(), 0, data);
+    }
+}
+
+const ArgSpec malloc_specs[] = {{"ptr", sizeof(void**)}, {"size", sizeof(size_t)}};
+const ArgSpec free_specs[] = {{"ptr", sizeof(void*)}};
+const ArgSpec memcpy_specs[] = {{"dst", sizeof(void*)}, {"src", sizeof(const void*)},
+                                {"sizeBytes", sizeof(size_t)}, {"kind", sizeof(int)}};
+const ArgSpec memset_specs[] = {{"dst", sizeof(void*)}, {"value", sizeof(int)},
+                                {"sizeBytes", sizeof(size_t)}};
+const ArgSpec launch_specs[] = {{"function_address", sizeof(const void*)},
+                                {"numBlocks", sizeof(dim3_t)}, {"dimBlocks", sizeof(dim3_t)},
+                                {"sharedMemBytes", sizeof(size_t)}, {"stream", sizeof(void*)}};
+
+struct SpecList { const ArgSpec* specs; uint32_t num; };
+const SpecList op_specs[kNumOps] = {
+    {malloc_specs, 2}, {free_specs, 1}, {memcpy_specs, 4}, {memset_specs, 3}, {launch_specs, 5},
+};
+
+OpArgLayout layouts[kNumOps];
+OpArgLayout indexed_layouts[kNumOps];
+
+void build_layouts()
+{
+    for (int op = 0; op < kNumOps; op++) {
+        Payload payload = {};
+        Record record{(Op)op, &payload};
+        struct bind_data { OpArgLayout* layout; const char* base; bool direct; };
+        for (bool direct : {true, false}) {
+            OpArgLayout& layout = direct ? layouts[op] : indexed_layouts[op];
+            layout.declare(op_specs[op].specs, op_specs[op].num);
+            bind_data d{&layout, reinterpret_cast<const char*>(&payload), direct};
+            standin_iterate(record, [](int32_t, int32_t, uint32_t arg_num, const void* const addr,
+                                       int32_t, const char* type, const char* name, const char*,
+                                       int32_t, void* cb_data) -> int {
+                auto* d = static_cast<bind_data*>(cb_data);
+                int64_t offset = d->direct ? static_cast<const char*>(addr) - d->base : -1;
+                d->layout->bind(arg_num, name, type, offset);
+                return 0;
+            }, &d);
+            if (const char* missing = layout.finalize()) {
+                fprintf(stderr, "unresolved argument %s\n", missing);
+                exit(1);
+            }
+        }
+    }
+}
+
+// The sink keeps the compiler from discarding the extracted values.
+struct Sink { uint64_t acc = 0; void add(uint64_t v) { acc = acc * 31 + v; } };
+
+void consume_strcmp(const Record& record, Sink& sink)
+{
+    struct out_t { uint64_t v[6]; } out = {};
+    auto cb = [](int32_t, int32_t, uint32_t, const void* const addr, int32_t, const char*,
+                 const char* arg_name, const char*, int32_t, void* cb_data) -> int {
+        auto* o = static_cast<out_t*>(cb_data);
+        if (std::string(arg_name) == "ptr") o->v[0] = *static_cast<const uint64_t*>(addr);
+        else if (std::string(arg_name) == "size") o->v[1] = *static_cast<const uint64_t*>(addr);
+        else if (std::string(arg_name) == "dst") o->v[0] = *static_cast<const uint64_t*>(addr);
+        else if (std::string(arg_name) == "src") o->v[1] = *static_cast<const uint64_t*>(addr);
+        else if (std::string(arg_name) == "sizeBytes") o->v[2] = *static_cast<const uint64_t*>(addr);
+        else if (std::string(arg_name) == "kind") o->v[3] = *static_cast<const int*>(addr);
+        else if (std::string(arg_name) == "value") o->v[3] = *static_cast<const int*>(addr);
+        else if (std::string(arg_name) == "function_address") o->v[0] = *static_cast<const uint64_t*>(addr);
+        else if (std::string(arg_name) == "numBlocks") o->v[1] = static_cast<const dim3_t*>(addr)->x;
+        else if (std::string(arg_name) == "dimBlocks") o->v[2] = static_cast<const dim3_t*>(addr)->x;
+        else if (std::string(arg_name) == "sharedMemBytes") o->v[3] = *static_cast<const uint64_t*>(addr);
+        else if (std::string(arg_name) == "stream") o->v[4] = *static_cast<const uint64_t*>(addr);
+        return 0;
+    };
+    standin_iterate(record, cb, &out);
+    for (uint64_t v : out.v) sink.add(v);
+}
+
+void consume_layout(const Record& record, const OpArgLayout* table, Sink& sink)
+{
+    ArgReader args(table[record.operation], record.payload);
+    if (args.needs_capture()) {
+        standin_iterate(record, [](int32_t, int32_t, uint32_t arg_num, const void* const addr,
+                                   int32_t, const char*, const char*, const char*, int32_t,
+                                   void* cb_data) -> int {
+            static_cast<ArgReader*>(cb_data)->capture(arg_num, addr);
+            return 0;
+        }, &args);
+    }
+    switch (record.operation) {
+        case kOpMalloc:
+            sink.add(args.get<uint64_t>(0));
+            sink.add(args.get<uint64_t>(1));
+            break;
+        case kOpFree:
+            sink.add(args.get<uint64_t>(0));
+            break;
+        case kOpMemcpy:
+            sink.add(args.get<uint64_t>(0));
+            sink.add(args.get<uint64_t>(1));
+            sink.add(args.get<uint64_t>(2));
+            sink.add(args.get<int>(3));
+            break;
+        case kOpMemset:
+            sink.add(args.get<uint64_t>(0));
+            sink.add(args.get<int>(1));
+            sink.add(args.get<uint64_t>(2));
+            break;
+        case kOpLaunch:
+            sink.add(args.get<uint64_t>(0));
+            sink.add(args.get<dim3_t>(1).x);
+            sink.add(args.get<dim3_t>(2).x);
+            sink.add(args.get<uint64_t>(3));
+            sink.add(args.get<uint64_t>(4));
+            break;
+        default:
+            break;
+    }
+}
+
+template <typename F>
+double time_ns_per_event(const std::vector<Record>& records, F&& fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& r : records) fn(r);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / records.size();
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t num_events = argc > 1 ? strtoull(argv[1], nullptr, 10) : 2000000;
+    if (num_events == 0) num_events = 1;
+
+    build_layouts();
+
+    // a launch-heavy mix, roughly what a training step looks like
+    std::mt19937_64 rng(42);
+    std::vector<Payload> payloads(num_events);
+    std::vector<Record> records(num_events);
+    for (size_t i = 0; i < num_events; i++) {
+        uint64_t r = rng();
+        Op op = (r % 10 < 6) ? kOpLaunch : (Op)(r % 4);
+        Payload& p = payloads[i];
+        p.size = sizeof(Payload);
+        p.args.hipLaunchKernel.function_address = reinterpret_cast<const void*>(rng());
+        p.args.hipLaunchKernel.numBlocks = {(uint32_t)(r & 0xff) + 1, 1, 1};
+        p.args.hipLaunchKernel.dimBlocks = {256, 1, 1};
+        p.args.hipLaunchKernel.args = reinterpret_cast<void**>(rng());
+        p.args.hipLaunchKernel.sharedMemBytes = r & 0xffff;
+        p.args.hipLaunchKernel.stream = reinterpret_cast<void*>(rng());
+        records[i] = Record{op, &p};
+    }
+
+    Sink s0, s1, s2;
+    double strcmp_ns = time_ns_per_event(records, [&](const Record& r) { consume_strcmp(r, s0); });
+    double indexed_ns = time_ns_per_event(records, [&](const Record& r) { consume_layout(r, indexed_layouts, s1); });
+    double direct_ns = time_ns_per_event(records, [&](const Record& r) { consume_layout(r, layouts, s2); });
+
+    printf("events: %zu\n", num_events);
+    printf("%-10s %10s %10s\n", "mode", "ns/event", "speedup");
+    printf("%-10s %10.1f %10.2fx\n", "strcmp", strcmp_ns, 1.0);
+    printf("%-10s %10.1f %10.2fx\n", "indexed", indexed_ns, strcmp_ns / indexed_ns);
+    printf("%-10s %10.1f %10.2fx\n", "direct", direct_ns, strcmp_ns / direct_ns);
+    printf("checksum: %lx\n", (unsigned long)(s0.acc ^ s1.acc));
+    if (s1.acc != s2.acc) {
+        fprintf(stderr, "indexed and direct reads disagree\n");
+        return 1;
+    }
+    return 0;
+}
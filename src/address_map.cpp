@@ -0,0 +1,92 @@
+#include "address_map.h"
+
+namespace rocm_accelprof {
+
+AddressMap::AddressMap()
+    : table_(make_table(1024)) {}
+
+AddressMap::~AddressMap()
+{
+    Table* t = table_.load();
+    delete[] t->entries;
+    delete t;
+    for (auto* r : retired_) {
+        delete[] r->entries;
+        delete r;
+    }
+}
+
+AddressMap::Table* AddressMap::make_table(uint64_t capacity)
+{
+    auto* t = new Table;
+    t->mask = capacity - 1;
+    t->entries = new Entry[capacity];
+    return t;
+}
+
+// A slot's key is stored before its value, which readers acquire, so a reader that sees
+// the new value also sees the new key when it checks the slot again.
+bool AddressMap::put(Table* t, uint64_t key, uint32_t value)
+{
+    Entry* reuse = nullptr;
+    for (uint64_t i = hash(key) & t->mask;; i = (i + 1) & t->mask) {
+        Entry& e = t->entries[i];
+        uint64_t k = e.key.load(std::memory_order_relaxed);
+        if (k == key) {
+            e.value.store(value, std::memory_order_release);
+            return false;
+        }
+        if (k == 0) {
+            Entry& slot = reuse ? *reuse : e;
+            slot.key.store(key, std::memory_order_relaxed);
+            slot.value.store(value, std::memory_order_release);
+            return reuse == nullptr;
+        }
+        if (reuse == nullptr && e.value.load(std::memory_order_relaxed) == 0) reuse = &e;
+    }
+}
+
+void AddressMap::retire(Table* t, uint64_t key)
+{
+    uint64_t i = hash(key) & t->mask;
+    for (;; i = (i + 1) & t->mask) {
+        uint64_t k = t->entries[i].key.load(std::memory_order_relaxed);
+        if (k == 0) return;
+        if (k == key) break;
+    }
+    t->entries[i].value.store(0, std::memory_order_release);
+    // no probe passes a slot followed by an empty one; emptying it may expose the one before
+    while (t->entries[(i + 1) & t->mask].key.load(std::memory_order_relaxed) == 0 &&
+           t->entries[i].key.load(std::memory_order_relaxed) != 0 &&
+           t->entries[i].value.load(std::memory_order_relaxed) == 0) {
+        t->entries[i].key.store(0, std::memory_order_relaxed);
+        size_--;
+        i = (i - 1) & t->mask;
+    }
+}
+
+void AddressMap::insert(uint64_t key, uint32_t value)
+{
+    if (key == 0) return;
+    Table* t = table_.load(std::memory_order_relaxed);
+    if (value == 0) {
+        retire(t, key);
+        return;
+    }
+    // keep the load factor at or below one half
+    if ((size_ + 1) * 2 > t->mask + 1) {
+        Table* bigger = make_table((t->mask + 1) * 2);
+        size_ = 0;
+        for (uint64_t i = 0; i <= t->mask; i++) {
+            uint64_t k = t->entries[i].key.load(std::memory_order_relaxed);
+            uint32_t v = t->entries[i].value.load(std::memory_order_relaxed);
+            if (k != 0 && v != 0 && put(bigger, k, v)) size_++;
+        }
+        table_.store(bigger, std::memory_order_release);
+        retired_.push_back(t);
+        t = bigger;
+    }
+    if (put(t, key, value)) size_++;
+}
+
+} // namespace rocm_accelprof
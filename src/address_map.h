@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace rocm_accelprof {
+
+// Open-addressing map from a non-zero 64-bit key to a 32-bit value. A value of 0 reads as
+// absent, so storing 0 is how an entry is retired.
+// Readers never lock; writers are serialized by the owner. A retired slot is emptied once
+// it ends its probe cluster, and otherwise taken by the next key whose probe passes it,
+// so churn does not grow the table. A key that is being inserted may read as absent until
+// the insert returns. Tables grow by publishing a larger copy without the retired
+// entries, and old tables are kept alive because readers may still be probing them.
+class AddressMap {
+public:
+    AddressMap();
+    ~AddressMap();
+    AddressMap(const AddressMap&) = delete;
+    AddressMap& operator=(const AddressMap&) = delete;
+
+    uint32_t find(uint64_t key) const {
+        const Table* t = table_.load(std::memory_order_acquire);
+        for (uint64_t i = hash(key) & t->mask;; i = (i + 1) & t->mask) {
+            const Entry& e = t->entries[i];
+            uint64_t k = e.key.load(std::memory_order_relaxed);
+            if (k == key) {
+                uint32_t value = e.value.load(std::memory_order_acquire);
+                // the slot may have been retired and given to another key since
+                return e.key.load(std::memory_order_relaxed) == key ? value : 0;
+            }
+            if (k == 0) return 0;
+        }
+    }
+
+    void insert(uint64_t key, uint32_t value);
+
+private:
+    struct Entry {
+        std::atomic<uint64_t> key{0};
+        std::atomic<uint32_t> value{0};
+    };
+    struct Table {
+        uint64_t mask;
+        Entry* entries;
+    };
+
+    static uint64_t hash(uint64_t key) { return (key >> 4) * 0x9E3779B97F4A7C15ull >> 17; }
+    static Table* make_table(uint64_t capacity);
+    // returns true when the key took an empty slot
+    static bool put(Table* t, uint64_t key, uint32_t value);
+    void retire(Table* t, uint64_t key);
+
+    std::atomic<Table*> table_;
+    std::vector<Table*> retired_;
+    uint64_t size_ = 0;   // slots holding a key, retired or not
+};
+
+} // namespace rocm_accelprof
@@ -0,0 +1,220 @@
+#include "alloc_index.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include "process.h"
+
+namespace rocm_accelprof {
+
+namespace {
+
+constexpr size_t kAllocationBlock = 1024;
+
+const char* kind_name(MemoryKind kind)
+{
+    switch (kind) {
+        case MemoryKind::device: return "device";
+        case MemoryKind::managed: return "managed";
+        case MemoryKind::host: return "host";
+    }
+    return "?";
+}
+
+uint64_t traffic(const Allocation& a)
+{
+    return a.bytes_read.load(std::memory_order_relaxed) + a.bytes_written.load(std::memory_order_relaxed) +
+           a.bytes_set.load(std::memory_order_relaxed);
+}
+
+} // namespace
+
+AllocIndex::AllocIndex() = default;
+
+AllocIndex::~AllocIndex()
+{
+    for (Chunk* c : chunks_) delete c;
+    for (Allocation* b : blocks_) delete[] b;
+}
+
+Allocation* AllocIndex::new_allocation()
+{
+    if (free_list_.empty()) {
+        Allocation* block = new Allocation[kAllocationBlock];
+        blocks_.push_back(block);
+        for (size_t i = kAllocationBlock; i > 0; i--) free_list_.push_back(&block[i - 1]);
+    }
+    Allocation* a = free_list_.back();
+    free_list_.pop_back();
+    return a;
+}
+
+void AllocIndex::release_allocation(Allocation* a)
+{
+    freed_count_++;
+    freed_read_ += a->bytes_read.load(std::memory_order_relaxed);
+    freed_written_ += a->bytes_written.load(std::memory_order_relaxed);
+    freed_set_ += a->bytes_set.load(std::memory_order_relaxed);
+    a->bytes_read.store(0, std::memory_order_relaxed);
+    a->bytes_written.store(0, std::memory_order_relaxed);
+    a->bytes_set.store(0, std::memory_order_relaxed);
+    free_list_.push_back(a);
+}
+
+size_t AllocIndex::chunk_for(uint64_t addr) const
+{
+    auto it = std::upper_bound(first_bases_.begin(), first_bases_.end(), addr);
+    return it == first_bases_.begin() ? 0 : (size_t)(it - first_bases_.begin()) - 1;
+}
+
+Allocation* AllocIndex::find_locked(uint64_t addr) const
+{
+    if (chunks_.empty() || addr < first_bases_[0]) return nullptr;
+    const Chunk* c = chunks_[chunk_for(addr)];
+    const uint64_t* it = std::upper_bound(c->bases, c->bases + c->count, addr);
+    if (it == c->bases) return nullptr;
+    size_t j = (size_t)(it - c->bases) - 1;
+    return addr < c->ends[j] ? c->allocs[j] : nullptr;
+}
+
+void AllocIndex::split(size_t c)
+{
+    Chunk* left = chunks_[c];
+    Chunk* right = new Chunk();
+    uint32_t half = left->count / 2;
+    right->count = left->count - half;
+    std::copy(left->bases + half, left->bases + left->count, right->bases);
+    std::copy(left->ends + half, left->ends + left->count, right->ends);
+    std::copy(left->allocs + half, left->allocs + left->count, right->allocs);
+    left->count = half;
+    chunks_.insert(chunks_.begin() + c + 1, right);
+    first_bases_.insert(first_bases_.begin() + c + 1, right->bases[0]);
+}
+
+void AllocIndex::insert(uint64_t base, uint64_t size, int32_t device, MemoryKind kind)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (chunks_.empty()) {
+        chunks_.push_back(new Chunk());
+        first_bases_.push_back(base);
+    }
+
+    size_t c = chunk_for(base);
+    if (chunks_[c]->count == kChunkCapacity) {
+        split(c);
+        if (base >= first_bases_[c + 1]) c++;
+    }
+
+    Chunk* chunk = chunks_[c];
+    uint32_t pos = (uint32_t)(std::lower_bound(chunk->bases, chunk->bases + chunk->count, base) - chunk->bases);
+    Allocation* a;
+    if (pos < chunk->count && chunk->bases[pos] == base) {
+        // the free of the previous occupant was missed (e.g. released before we attached)
+        release_allocation(chunk->allocs[pos]);
+        live_--;
+        a = new_allocation();
+    } else {
+        a = new_allocation();
+        std::copy_backward(chunk->bases + pos, chunk->bases + chunk->count, chunk->bases + chunk->count + 1);
+        std::copy_backward(chunk->ends + pos, chunk->ends + chunk->count, chunk->ends + chunk->count + 1);
+        std::copy_backward(chunk->allocs + pos, chunk->allocs + chunk->count, chunk->allocs + chunk->count + 1);
+        chunk->count++;
+    }
+
+    a->base = base;
+    a->size = size;
+    a->id = next_id_++;
+    a->device = device;
+    a->kind = kind;
+    chunk->bases[pos] = base;
+    chunk->ends[pos] = base + size;
+    chunk->allocs[pos] = a;
+    if (pos == 0) first_bases_[c] = base;
+    live_++;
+    generation_.fetch_add(1, std::memory_order_release);
+}
+
+FreedAllocation AllocIndex::erase(uint64_t base)
+{
+    FreedAllocation freed;
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (chunks_.empty()) return freed;
+
+    size_t c = chunk_for(base);
+    Chunk* chunk = chunks_[c];
+    uint32_t pos = (uint32_t)(std::lower_bound(chunk->bases, chunk->bases + chunk->count, base) - chunk->bases);
+    if (pos == chunk->count || chunk->bases[pos] != base) return freed;
+
+    Allocation* a = chunk->allocs[pos];
+    freed.found = true;
+    freed.id = a->id;
+    freed.size = a->size;
+    freed.device = a->device;
+    freed.kind = a->kind;
+    release_allocation(a);
+    live_--;
+    generation_.fetch_add(1, std::memory_order_release);
+
+    std::copy(chunk->bases + pos + 1, chunk->bases + chunk->count, chunk->bases + pos);
+    std::copy(chunk->ends + pos + 1, chunk->ends + chunk->count, chunk->ends + pos);
+    std::copy(chunk->allocs + pos + 1, chunk->allocs + chunk->count, chunk->allocs + pos);
+    chunk->count--;
+
+    if (chunk->count == 0 && chunks_.size() > 1) {
+        delete chunk;
+        chunks_.erase(chunks_.begin() + c);
+        first_bases_.erase(first_bases_.begin() + c);
+    } else if (pos == 0 && chunk->count > 0) {
+        first_bases_[c] = chunk->bases[0];
+    }
+    return freed;
+}
+
+size_t AllocIndex::size() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return live_;
+}
+
+void AllocIndex::write_report(FILE* out, size_t top) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (live_ == 0 && freed_count_ == 0) return;
+
+    std::vector<const Allocation*> busiest;
+    for (const Chunk* c : chunks_) {
+        for (uint32_t i = 0; i < c->count; i++) {
+            if (traffic(*c->allocs[i]) != 0) busiest.push_back(c->allocs[i]);
+        }
+    }
+    size_t n = std::min(top, busiest.size());
+    std::partial_sort(busiest.begin(), busiest.begin() + n, busiest.end(),
+                      [](const Allocation* a, const Allocation* b) { return traffic(*a) > traffic(*b); });
+
+    fprintf(out, "[ROCMPROF SUMMARY] allocations: %lu live, %lu freed (read %lu, written %lu, set %lu bytes)\n",
+            (unsigned long)live_, (unsigned long)freed_count_, (unsigned long)freed_read_,
+            (unsigned long)freed_written_, (unsigned long)freed_set_);
+    // allocation ids and addresses are per process: only the totals merge
+    process_report(out, ReportMerge::sum, (double)live_, "allocations.live");
+    process_report(out, ReportMerge::sum, (double)freed_count_, "allocations.freed");
+    process_report(out, ReportMerge::sum, (double)freed_read_, "allocations.freed_read_bytes");
+    process_report(out, ReportMerge::sum, (double)freed_written_, "allocations.freed_written_bytes");
+    process_report(out, ReportMerge::sum, (double)freed_set_, "allocations.freed_set_bytes");
+    for (size_t i = 0; i < n; i++) {
+        const Allocation& a = *busiest[i];
+        fprintf(out, "[ROCMPROF SUMMARY]   #%lu %s dev %d 0x%lx (%lu bytes): read %lu, written %lu, set %lu bytes\n",
+                (unsigned long)a.id, kind_name(a.kind), a.device, (unsigned long)a.base, (unsigned long)a.size,
+                (unsigned long)a.bytes_read.load(std::memory_order_relaxed),
+                (unsigned long)a.bytes_written.load(std::memory_order_relaxed),
+                (unsigned long)a.bytes_set.load(std::memory_order_relaxed));
+    }
+}
+
+AllocIndex& alloc_index()
+{
+    // never destroyed: frees may still arrive while the process exits
+    static auto* index = new AllocIndex();
+    return *index;
+}
+
+} // namespace rocm_accelprof
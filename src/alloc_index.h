@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <shared_mutex>
+#include <vector>
+
+// Address-range index over live allocations.
+//
+// Allocations are kept sorted by base address in fixed-size chunks (a B+-tree with a
+// single inner level): a lookup is a binary search over the first base of every chunk
+// followed by one within the chunk, both over contiguous arrays. Inserts and erases only
+// shift entries inside one chunk, so churn from caching allocators stays cheap with
+// 10^5+ live allocations. Readers share a lock; inserts and erases take it exclusively.
+
+namespace rocm_accelprof {
+
+enum class MemoryKind : uint8_t {
+    device = 0,
+    managed = 1,
+    host = 2,      // pinned host memory from hipHostMalloc
+};
+
+struct Allocation {
+    uint64_t base = 0;
+    uint64_t size = 0;
+    uint64_t id = 0;
+    int32_t device = 0;
+    MemoryKind kind = MemoryKind::device;
+    // traffic attributed to this allocation while it was live
+    std::atomic<uint64_t> bytes_read{0};     // as the source of copies
+    std::atomic<uint64_t> bytes_written{0};  // as the destination of copies
+    std::atomic<uint64_t> bytes_set{0};      // by memsets
+
+    bool on_device() const { return kind != MemoryKind::host; }
+};
+
+// What remains of an allocation once it has been removed from the index.
+struct FreedAllocation {
+    bool found = false;
+    uint64_t id = 0;
+    uint64_t size = 0;
+    int32_t device = 0;
+    MemoryKind kind = MemoryKind::device;
+};
+
+class AllocIndex {
+public:
+    AllocIndex();
+    ~AllocIndex();
+    AllocIndex(const AllocIndex&) = delete;
+    AllocIndex& operator=(const AllocIndex&) = delete;
+
+    void insert(uint64_t base, uint64_t size, int32_t device, MemoryKind kind);
+    FreedAllocation erase(uint64_t base);
+
+    // Resolve a possibly interior pointer and hand the owning allocation to fn while the
+    // index is locked for reading. Returns false when no live allocation contains addr.
+    template <typename F>
+    bool with_allocation(uint64_t addr, F&& fn) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        Allocation* a = find_locked(addr);
+        if (a == nullptr) return false;
+        fn(*a);
+        return true;
+    }
+
+    // Resolve two pointers under one lock acquisition (copies); either may be null.
+    template <typename F>
+    void with_pair(uint64_t a, uint64_t b, F&& fn) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        fn(find_locked(a), find_locked(b));
+    }
+
+    // Resolve n addresses under one lock acquisition; fn(i, allocation or null).
+    template <typename F>
+    void with_each(const uint64_t* addrs, size_t n, F&& fn) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        for (size_t i = 0; i < n; i++) fn(i, find_locked(addrs[i]));
+    }
+
+    // Changes whenever an allocation is inserted or erased, so lookups of the same
+    // addresses can be reused while it stays the same.
+    uint64_t generation() const { return generation_.load(std::memory_order_acquire); }
+
+    size_t size() const;
+
+    void write_report(FILE* out, size_t top) const;
+
+private:
+    static constexpr uint32_t kChunkCapacity = 256;
+
+    struct Chunk {
+        uint32_t count = 0;
+        uint64_t bases[kChunkCapacity];
+        uint64_t ends[kChunkCapacity];
+        Allocation* allocs[kChunkCapacity];
+    };
+
+    Allocation* find_locked(uint64_t addr) const;
+    size_t chunk_for(uint64_t addr) const;
+    void split(size_t c);
+    Allocation* new_allocation();
+    void release_allocation(Allocation* a);
+
+    mutable std::shared_mutex mutex_;
+    std::vector<uint64_t> first_bases_;  // first base of every chunk, for the top-level search
+    std::vector<Chunk*> chunks_;
+    std::vector<Allocation*> free_list_;
+    std::vector<Allocation*> blocks_;
+    uint64_t next_id_ = 1;
+    size_t live_ = 0;
+    std::atomic<uint64_t> generation_{0};
+
+    // totals of allocations that have already been freed
+    uint64_t freed_count_ = 0;
+    uint64_t freed_read_ = 0;
+    uint64_t freed_written_ = 0;
+    uint64_t freed_set_ = 0;
+};
+
+AllocIndex& alloc_index();
+
+} // namespace rocm_accelprof
@@ -0,0 +1,443 @@
+#include "analysis.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "analysis_event.h"
+#include "env.h"
+#include "logger.h"
+#include "overhead.h"
+#include "process.h"
+#include "sanalyzer_forward.h"
+#include "tool_guard.h"
+#include "trace_writer.h"
+
+namespace rocm_accelprof {
+
+namespace {
+
+constexpr uint32_t kRingSlots = 8192;
+
+// Single-producer (the owning thread) single-consumer (the worker) ring.
+struct EventRing {
+    alignas(64) std::atomic<uint64_t> head{0};
+    uint64_t cached_tail = 0;
+    alignas(64) std::atomic<uint64_t> tail{0};
+    std::atomic<bool> owned{false};
+    AnalysisEvent slots[kRingSlots];
+};
+
+struct AnalysisState {
+    std::mutex mutex;                    // guards rings
+    std::vector<EventRing*> rings;       // never freed; rings of exited threads are reused
+    std::mutex forward_mutex;            // sanalyzer is only ever entered under this lock
+    std::thread worker;
+    std::atomic<bool> running{false};
+    alignas(64) std::atomic<uint64_t> next_seq{0};
+    alignas(64) std::atomic<uint32_t> producers{0};   // between the running check and the publish
+    uint64_t next_forward = 0;           // next sequence number to forward, under forward_mutex
+    alignas(64) std::atomic<uint64_t> stalls{0};
+    // forwarding statistics, under forward_mutex; read after the worker has stopped
+    uint64_t forwarded = 0;
+    uint64_t latency_samples = 0;
+    uint64_t total_latency_ns = 0;
+    uint64_t max_latency_ns = 0;
+};
+
+AnalysisState& state()
+{
+    static auto* s = new AnalysisState();
+    return *s;
+}
+
+uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Releases the ring of an exiting thread so that a later thread can take it over.
+struct RingOwner {
+    EventRing* ring = nullptr;
+    ~RingOwner() {
+        if (ring) ring->owned.store(false, std::memory_order_release);
+    }
+};
+
+thread_local RingOwner tls_ring;
+
+EventRing* acquire_ring()
+{
+    auto& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    EventRing* ring = nullptr;
+    for (auto* r : s.rings) {
+        if (!r->owned.load(std::memory_order_acquire) &&
+            r->head.load(std::memory_order_acquire) == r->tail.load(std::memory_order_acquire)) {
+            ring = r;
+            break;
+        }
+    }
+    if (ring == nullptr) {
+        ring = new EventRing();
+        s.rings.push_back(ring);
+    }
+    ring->owned.store(true, std::memory_order_release);
+    return ring;
+}
+
+void forward(const AnalysisEvent& ev)
+{
+    uint64_t start = overhead_active ? overhead_ticks() : 0;
+    forward_to_sanalyzer(ev, [](kernel_name_id_t id) -> const std::string& { return kernel_names().name(id); });
+    if (start != 0) overhead_record_forward(ev.type, overhead_ticks() - start);
+}
+
+// Forward every staged event whose turn has come, merging the rings by sequence number
+// with a small heap over their oldest events. Stops at the first gap, i.e. a sequence
+// number that was stamped but whose event is not visible yet. Called with forward_mutex
+// held; returns the number forwarded.
+uint64_t drain_locked(const std::vector<EventRing*>& rings)
+{
+    auto& s = state();
+    struct Cursor {
+        uint64_t seq;
+        uint32_t ring;
+        bool operator<(const Cursor& other) const { return seq > other.seq; }  // min-heap
+    };
+    std::vector<Cursor> heap;
+    std::vector<uint64_t> heads(rings.size());
+    std::vector<uint64_t> tails(rings.size());
+    for (uint32_t r = 0; r < rings.size(); r++) {
+        tails[r] = rings[r]->tail.load(std::memory_order_relaxed);
+        heads[r] = rings[r]->head.load(std::memory_order_acquire);
+        if (tails[r] != heads[r]) heap.push_back({rings[r]->slots[tails[r] % kRingSlots].seq, r});
+    }
+    std::make_heap(heap.begin(), heap.end());
+
+    uint64_t forwarded = 0;
+    uint64_t& next = s.next_forward;
+    while (!heap.empty() && heap.front().seq == next) {
+        std::pop_heap(heap.begin(), heap.end());
+        uint32_t r = heap.back().ring;
+        heap.pop_back();
+
+        EventRing* ring = rings[r];
+        const AnalysisEvent& ev = ring->slots[tails[r] % kRingSlots];
+        forward(ev);
+        // sample the staging latency, a clock read per event would dominate the worker
+        if ((next & 63) == 0) {
+            uint64_t latency = now_ns() - ev.timestamp;
+            s.total_latency_ns += latency;
+            s.latency_samples++;
+            s.max_latency_ns = std::max(s.max_latency_ns, latency);
+        }
+        ring->tail.store(++tails[r], std::memory_order_release);
+        next++;
+        forwarded++;
+
+        if (tails[r] == heads[r]) heads[r] = ring->head.load(std::memory_order_acquire);
+        if (tails[r] != heads[r]) {
+            heap.push_back({ring->slots[tails[r] % kRingSlots].seq, r});
+            std::push_heap(heap.begin(), heap.end());
+        }
+    }
+    s.forwarded += forwarded;
+    return forwarded;
+}
+
+std::vector<EventRing*> snapshot_rings()
+{
+    auto& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.rings;
+}
+
+// Forwards everything stamped so far, with forward_mutex held. Producers that saw the
+// worker running are drained until they have published (one may be waiting for space in
+// its ring); the ones that come later take the inline path and wait for the lock.
+void drain_all_locked()
+{
+    auto& s = state();
+    while (true) {
+        bool idle = s.producers.load(std::memory_order_seq_cst) == 0;
+        uint64_t n = drain_locked(snapshot_rings());
+        if (idle && s.next_forward == s.next_seq.load(std::memory_order_acquire)) return;
+        if (n == 0) std::this_thread::yield();
+    }
+}
+
+// Without the worker: the staged events go first, then these take the next sequence
+// numbers and are forwarded right away, so the order has no gap.
+void push_inline(AnalysisEvent* evs, uint32_t n)
+{
+    auto& s = state();
+    // as on the worker: a HIP call sanalyzer makes would come back here and self-deadlock
+    ToolHipCall guard;
+    std::lock_guard<std::mutex> lock(s.forward_mutex);
+    drain_all_locked();
+    uint64_t timestamp = now_ns();
+    uint64_t seq = s.next_seq.fetch_add(n, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < n; i++) {
+        evs[i].timestamp = timestamp;
+        evs[i].seq = seq + i;
+        trace_write(evs[i]);
+        forward(evs[i]);
+    }
+    s.next_forward += n;
+}
+
+void worker_loop()
+{
+    // sanalyzer's own HIP calls must not be traced back into the pipeline
+    in_tool_hip_call = true;
+
+    auto& s = state();
+    uint32_t idle = 0;
+    std::vector<EventRing*> rings;
+    while (true) {
+        rings = snapshot_rings();
+        uint64_t n;
+        {
+            std::lock_guard<std::mutex> lock(s.forward_mutex);
+            n = drain_locked(rings);
+        }
+        if (n != 0) {
+            idle = 0;
+            continue;
+        }
+        // stop once no producer is between stamping and publishing and everything that
+        // was stamped has been forwarded; producers that come later go inline
+        if (!s.running.load(std::memory_order_seq_cst) && s.producers.load(std::memory_order_seq_cst) == 0) {
+            std::lock_guard<std::mutex> lock(s.forward_mutex);
+            if (s.next_forward == s.next_seq.load(std::memory_order_acquire)) break;
+        }
+        if (++idle < 64) std::this_thread::yield();
+        else std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+void write_report(FILE* out)
+{
+    auto& s = state();
+    if (s.forwarded == 0) return;
+    uint64_t samples = std::max<uint64_t>(s.latency_samples, 1);
+    fprintf(out, "[ROCMPROF SUMMARY] analysis: %lu events forwarded, staging latency mean %lu ns, max %lu ns, "
+                 "%lu producer stalls\n",
+            (unsigned long)s.forwarded, (unsigned long)(s.total_latency_ns / samples),
+            (unsigned long)s.max_latency_ns, (unsigned long)s.stalls.load(std::memory_order_relaxed));
+    process_report(out, ReportMerge::sum, (double)s.forwarded, "analysis.events");
+    process_report_mean(out, (double)s.total_latency_ns / (double)samples, (double)s.latency_samples,
+                        "analysis.staging_latency_mean_ns");
+    process_report(out, ReportMerge::max, (double)s.max_latency_ns, "analysis.staging_latency_max_ns");
+    process_report(out, ReportMerge::sum, (double)s.stalls.load(std::memory_order_relaxed), "analysis.stalls");
+}
+
+// Stages n events (at most kRingSlots) under consecutive sequence numbers, so nothing
+// another thread stages lands between them.
+void push(AnalysisEvent* evs, uint32_t n)
+{
+    auto& s = state();
+    // a forked child is detached: HIP and sanalyzer's state are the parent's
+    if (process_is_fork_child()) return;
+
+    // counted from before the running check to after the publish, so the worker never
+    // exits while a producer that saw it running still has to stamp or publish
+    s.producers.fetch_add(1, std::memory_order_seq_cst);
+    if (!s.running.load(std::memory_order_seq_cst)) {
+        s.producers.fetch_sub(1, std::memory_order_release);
+        push_inline(evs, n);
+        return;
+    }
+
+    if (tls_ring.ring == nullptr) tls_ring.ring = acquire_ring();
+    EventRing* ring = tls_ring.ring;
+
+    // wait for space before taking a sequence number, so that every stamped event is
+    // published without blocking and the worker never waits on a stalled producer
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head + n - ring->cached_tail > kRingSlots) {
+        ring->cached_tail = ring->tail.load(std::memory_order_acquire);
+        if (head + n - ring->cached_tail > kRingSlots) s.stalls.fetch_add(1, std::memory_order_relaxed);
+        while (head + n - ring->cached_tail > kRingSlots) {
+            if (!s.running.load(std::memory_order_seq_cst)) {
+                s.producers.fetch_sub(1, std::memory_order_release);
+                push_inline(evs, n);
+                return;
+            }
+            std::this_thread::yield();
+            ring->cached_tail = ring->tail.load(std::memory_order_acquire);
+        }
+    }
+
+    // the clock is read before the number is taken: a preempted producer can still stamp a
+    // later number with an earlier time, which readers of the trace have to tolerate
+    uint64_t timestamp = now_ns();
+    uint64_t seq = s.next_seq.fetch_add(n, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < n; i++) {
+        evs[i].timestamp = timestamp;
+        evs[i].seq = seq + i;
+        trace_write(evs[i]);
+        ring->slots[(head + i) % kRingSlots] = evs[i];
+    }
+    ring->head.store(head + n, std::memory_order_release);
+    s.producers.fetch_sub(1, std::memory_order_release);
+}
+
+void push(AnalysisEvent& ev)
+{
+    push(&ev, 1);
+}
+
+AnalysisEvent make_event(EventType type, uint64_t correlation_id, int device_id)
+{
+    AnalysisEvent ev{};
+    ev.type = type;
+    ev.correlation_id = correlation_id;
+    ev.device = device_id;
+    return ev;
+}
+
+// Fork: both locks are held across it so the child never inherits them locked. The
+// child has no worker and drops the events the parent had staged, they are the parent's
+// to forward.
+void before_fork()
+{
+    auto& s = state();
+    s.mutex.lock();
+    s.forward_mutex.lock();
+}
+
+void after_fork_parent()
+{
+    auto& s = state();
+    s.forward_mutex.unlock();
+    s.mutex.unlock();
+}
+
+void after_fork_child()
+{
+    auto& s = state();
+    s.forward_mutex.unlock();
+    s.mutex.unlock();
+    s.running.store(false, std::memory_order_relaxed);
+    new (&s.worker) std::thread();   // the parent's worker does not exist here
+    for (auto* ring : s.rings) {
+        ring->tail.store(ring->head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        ring->cached_tail = ring->tail.load(std::memory_order_relaxed);
+        ring->owned.store(ring == tls_ring.ring, std::memory_order_relaxed);
+    }
+    s.forwarded = 0;
+}
+
+} // namespace
+
+void analysis_init()
+{
+    auto& s = state();
+    static bool fork_handlers = false;
+    if (!fork_handlers) {
+        fork_handlers = true;
+        process_init();
+        pthread_atfork(before_fork, after_fork_parent, after_fork_child);
+    }
+    if (s.running.load() || !env_bool("ACCELPROF_ANALYSIS_THREAD", true)) return;
+    s.running.store(true, std::memory_order_release);
+    s.worker = std::thread(worker_loop);
+    log_add_summary(write_report);
+}
+
+void analysis_shutdown()
+{
+    auto& s = state();
+    if (!s.running.exchange(false)) return;
+    if (s.worker.joinable()) s.worker.join();
+    // a producer that stamped while the worker was deciding to stop is forwarded here
+    ToolHipCall guard;
+    std::lock_guard<std::mutex> lock(s.forward_mutex);
+    drain_all_locked();
+}
+
+void analysis_alloc(uint64_t correlation_id, uint64_t ptr, uint64_t size, int type, int device_id)
+{
+    AnalysisEvent ev = make_event(EventType::alloc, correlation_id, device_id);
+    ev.a = ptr;
+    ev.b = size;
+    ev.arg = (uint32_t)type;
+    push(ev);
+}
+
+void analysis_free(uint64_t correlation_id, uint64_t ptr, uint64_t size, int device_id)
+{
+    AnalysisEvent ev = make_event(EventType::free, correlation_id, device_id);
+    ev.a = ptr;
+    ev.b = size;
+    push(ev);
+}
+
+void analysis_memcpy(uint64_t correlation_id, uint64_t dst, uint64_t src, uint64_t size, bool is_async,
+                     uint32_t kind, int device_id)
+{
+    AnalysisEvent ev = make_event(EventType::memcpy, correlation_id, device_id);
+    ev.a = dst;
+    ev.b = src;
+    ev.c = size;
+    ev.is_async = is_async;
+    ev.arg = kind;
+    push(ev);
+}
+
+void analysis_memset(uint64_t correlation_id, uint64_t dst, uint64_t size, int value, bool is_async,
+                     int device_id)
+{
+    AnalysisEvent ev = make_event(EventType::memset, correlation_id, device_id);
+    ev.a = dst;
+    ev.b = size;
+    ev.is_async = is_async;
+    ev.arg = (uint32_t)value;
+    push(ev);
+}
+
+void analysis_kernel_start(uint64_t correlation_id, kernel_name_id_t name_id, int device_id,
+                           const KernelBuffer* buffers, uint32_t num_buffers)
+{
+    AnalysisEvent evs[kMaxKernelBuffers + 1];
+    // nobody reads working sets without the sanalyzer hook or a trace
+    if (!sanalyzer_takes_kernel_buffers() && !trace_active) num_buffers = 0;
+    num_buffers = std::min(num_buffers, kMaxKernelBuffers);
+    for (uint32_t b = 0; b < num_buffers; b++) {
+        evs[b] = make_event(EventType::kernel_buffer, correlation_id, device_id);
+        evs[b].a = buffers[b].base;
+        evs[b].b = buffers[b].size;
+        evs[b].arg = buffers[b].arg_index;
+    }
+    evs[num_buffers] = make_event(EventType::kernel_start, correlation_id, device_id);
+    evs[num_buffers].arg = name_id;
+    push(evs, num_buffers + 1);
+}
+
+void analysis_kernel_end(uint64_t correlation_id, int device_id, uint64_t start_ns, uint64_t end_ns)
+{
+    AnalysisEvent ev = make_event(EventType::kernel_end, correlation_id, device_id);
+    ev.a = start_ns;
+    ev.b = std::max(end_ns, start_ns);
+    push(ev);
+}
+
+void analysis_memcpy_end(uint64_t correlation_id, int device_id, uint64_t start_ns, uint64_t end_ns)
+{
+    // only the trace reads copy completions
+    if (!trace_active) return;
+    AnalysisEvent ev = make_event(EventType::memcpy_end, correlation_id, device_id);
+    ev.a = start_ns;
+    ev.b = std::max(end_ns, start_ns);
+    push(ev);
+}
+
+} // namespace rocm_accelprof
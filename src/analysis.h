@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+#include "kernel_args.h"
+#include "kernel_names.h"
+
+// Single entry point into sanalyzer.
+//
+// Producers (application threads, the buffered tracing consumer) never call yosemite_*
+// themselves: each analysis_* call stamps a compact event with a global sequence number,
+// the correlation ID and a timestamp, and pushes it into the calling thread's lock-free
+// single-producer ring. One analysis worker merges the rings by sequence number and
+// forwards the events in exactly the order they were stamped, so sanalyzer only ever
+// runs on one thread and the order is deterministic for a given interleaving.
+//
+// ACCELPROF_ANALYSIS_THREAD=0 forwards inline under a lock instead (for debugging).
+// A full ring blocks its producer until the worker catches up; events are never dropped.
+
+namespace rocm_accelprof {
+
+// Starts the worker, before any producer runs; before that (and after shutdown) events
+// are forwarded inline, after everything staged, under the same sequence numbering.
+void analysis_init();
+
+// Forwards everything staged so far and stops the worker; safe while producers still run.
+void analysis_shutdown();
+
+void analysis_alloc(uint64_t correlation_id, uint64_t ptr, uint64_t size, int type, int device_id);
+void analysis_free(uint64_t correlation_id, uint64_t ptr, uint64_t size, int device_id);
+void analysis_memcpy(uint64_t correlation_id, uint64_t dst, uint64_t src, uint64_t size, bool is_async,
+                     uint32_t kind, int device_id);
+void analysis_memset(uint64_t correlation_id, uint64_t dst, uint64_t size, int value, bool is_async,
+                     int device_id);
+// The launch's working set is staged right ahead of the start, under consecutive sequence
+// numbers: sanalyzer sees each kernel's buffers immediately before it, on any thread. It
+// is left out unless sanalyzer has the buffer hook or a trace is written.
+void analysis_kernel_start(uint64_t correlation_id, kernel_name_id_t name_id, int device_id,
+                           const KernelBuffer* buffers = nullptr, uint32_t num_buffers = 0);
+// Completion of a dispatch (buffered mode) with its device start and end, already on the
+// steady clock the events are stamped with.
+void analysis_kernel_end(uint64_t correlation_id, int device_id, uint64_t start_ns, uint64_t end_ns);
+// Completion of a copy (buffered mode), likewise; sanalyzer has no callback for it, so it
+// is staged for the trace only.
+void analysis_memcpy_end(uint64_t correlation_id, int device_id, uint64_t start_ns, uint64_t end_ns);
+
+} // namespace rocm_accelprof
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+// One call into sanalyzer as staged by analysis.cpp, written by the trace writer and read
+// back by the offline tools. Plain data, one cache line.
+
+namespace rocm_accelprof {
+
+// 0 is reserved: it ends the record stream of a trace segment.
+enum class EventType : uint8_t {
+    alloc = 1,
+    free,
+    memcpy,
+    memset,
+    kernel_start,
+    kernel_end,
+    kernel_buffer,   // an allocation of the kernel_start that directly follows the launch's buffers
+    memcpy_end,      // device completion of a buffered copy, same correlation ID as its memcpy
+};
+constexpr uint32_t kNumEventTypes = (uint32_t)EventType::memcpy_end + 1;
+
+struct AnalysisEvent {
+    uint64_t seq;             // global order across threads
+    uint64_t correlation_id;
+    uint64_t timestamp;       // steady clock, ns
+    EventType type;
+    uint8_t is_async;
+    int32_t device;
+    uint64_t a;               // ptr / dst / kernel_end, memcpy_end: device start (steady clock ns)
+    uint64_t b;               // size / src / kernel_end, memcpy_end: device end
+    uint64_t c;               // memcpy size
+    uint32_t arg;             // alloc type, memcpy kind, memset value, kernel name id or argument index
+    uint32_t pad;
+};
+static_assert(sizeof(AnalysisEvent) == 64, "analysis events are one cache line");
+
+} // namespace rocm_accelprof
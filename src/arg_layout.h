@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// Argument layout cache for rocprofiler API payloads.
+//
+// rocprofiler only exposes API arguments by name through
+// rocprofiler_iterate_callback_tracing_kind_operation_args, which stringifies every
+// argument on each call. A handler describes the arguments it needs once (name and
+// size), the layout is resolved against a synthetic record in tool_init, and the hot
+// path then reads arguments by slot index. This header is independent of the
+// rocprofiler headers so it can be exercised by the standalone benchmark.
+
+namespace rocm_accelprof {
+
+constexpr uint32_t kMaxLayoutSlots = 12;
+constexpr uint32_t kMaxOperationArgs = 32;
+constexpr uint32_t kScratchStride = 16;
+constexpr uint16_t kInvalidOffset = 0xffff;
+constexpr uint8_t kNoSlot = 0xff;
+
+// What a handler asks for: the rocprofiler argument name and the size of its C type.
+struct ArgSpec {
+    const char* name;
+    uint16_t size;
+};
+
+struct ArgSlot {
+    const char* name = nullptr;
+    const char* type = nullptr;     // mangled type name reported by rocprofiler
+    uint16_t size = 0;
+    uint16_t offset = kInvalidOffset;  // byte offset inside the API payload
+    int32_t arg_num = -1;
+};
+
+class OpArgLayout {
+public:
+    // Declare the arguments the handler reads; slot i corresponds to specs[i].
+    void declare(const ArgSpec* specs, uint32_t num_specs) {
+        num_slots_ = num_specs < kMaxLayoutSlots ? num_specs : kMaxLayoutSlots;
+        for (uint32_t i = 0; i < num_slots_; i++) {
+            slots_[i] = ArgSlot{};
+            slots_[i].name = specs[i].name;
+            slots_[i].size = specs[i].size < kScratchStride ? specs[i].size : kScratchStride;
+        }
+        memset(slot_of_arg_, kNoSlot, sizeof(slot_of_arg_));
+        resolved_ = false;
+        direct_ = false;
+    }
+
+    // Called once per argument while iterating a synthetic record. offset is the byte
+    // offset of the argument value from the payload base, or -1 if the iterator handed
+    // out an address outside of the payload (e.g. a copy).
+    void bind(uint32_t arg_num, const char* name, const char* type, int64_t offset) {
+        if (name == nullptr || arg_num >= kMaxOperationArgs) return;
+        for (uint32_t i = 0; i < num_slots_; i++) {
+            if (strcmp(slots_[i].name, name) != 0) continue;
+            slots_[i].arg_num = (int32_t)arg_num;
+            slots_[i].type = type;
+            slots_[i].offset = (offset >= 0 && offset < kInvalidOffset) ? (uint16_t)offset
+                                                                          : kInvalidOffset;
+            slot_of_arg_[arg_num] = (uint8_t)i;
+            return;
+        }
+    }
+
+    // Finish binding. Returns the first slot name that was not found, or nullptr.
+    const char* finalize() {
+        const char* missing = nullptr;
+        bool direct = true;  // nothing to read for operations without arguments
+        for (uint32_t i = 0; i < num_slots_; i++) {
+            if (slots_[i].arg_num < 0 && missing == nullptr) missing = slots_[i].name;
+            if (slots_[i].offset == kInvalidOffset) direct = false;
+        }
+        resolved_ = true;
+        direct_ = direct;
+        return missing;
+    }
+
+    bool resolved() const { return resolved_; }
+    // true when every slot can be read straight from the payload without iterating
+    bool direct() const { return direct_; }
+    uint32_t num_slots() const { return num_slots_; }
+    const ArgSlot& slot(uint32_t i) const { return slots_[i]; }
+
+    uint8_t slot_of_arg(uint32_t arg_num) const {
+        return arg_num < kMaxOperationArgs ? slot_of_arg_[arg_num] : kNoSlot;
+    }
+
+private:
+    ArgSlot slots_[kMaxLayoutSlots];
+    uint8_t slot_of_arg_[kMaxOperationArgs];
+    uint32_t num_slots_ = 0;
+    bool resolved_ = false;
+    bool direct_ = false;
+};
+
+// Reads the declared arguments of one record. In direct mode values are loaded from the
+// payload at the cached offsets; otherwise the caller iterates the record once and feeds
+// every argument to capture(), which copies the declared ones into scratch space.
+class ArgReader {
+public:
+    ArgReader(const OpArgLayout& layout, const void* payload)
+        : layout_(layout),
+          base_(static_cast<const char*>(payload)) {}
+
+    bool needs_capture() const { return !layout_.direct(); }
+
+    void capture(uint32_t arg_num, const void* arg_value_addr) {
+        uint8_t s = layout_.slot_of_arg(arg_num);
+        if (s == kNoSlot || arg_value_addr == nullptr) return;
+        memcpy(scratch_ + s * kScratchStride, arg_value_addr, layout_.slot(s).size);
+        captured_ |= (1u << s);
+    }
+
+    template <typename T>
+    T get(uint32_t slot) const {
+        static_assert(sizeof(T) <= kScratchStride, "argument too large for a layout slot");
+        T value{};
+        if (slot >= layout_.num_slots()) return value;
+        const ArgSlot& s = layout_.slot(slot);
+        size_t n = sizeof(T) < s.size ? sizeof(T) : s.size;
+        if (layout_.direct()) {
+            if (base_ != nullptr) memcpy(&value, base_ + s.offset, n);
+        } else if (captured_ & (1u << slot)) {
+            memcpy(&value, scratch_ + slot * kScratchStride, n);
+        }
+        return value;
+    }
+
+private:
+    const OpArgLayout& layout_;
+    const char* base_;
+    uint32_t captured_ = 0;
+    alignas(16) char scratch_[kMaxLayoutSlots * kScratchStride];
+};
+
+} // namespace rocm_accelprof
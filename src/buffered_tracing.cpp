@@ -0,0 +1,302 @@
+#include "buffered_tracing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "analysis.h"
+#include "env.h"
+#include "logger.h"
+#include "process.h"
+#include "rocprofiler_call.h"
+
+namespace rocm_accelprof {
+
+namespace {
+
+bool enabled = false;
+rocprofiler_buffer_id_t buffer = {};
+
+// rocprofiler timestamp minus steady clock, so device times line up with the events
+int64_t clock_offset = 0;
+
+// Launches and copies waiting for their device record, sharded by correlation ID so
+// application threads rarely contend with each other or with the consumer. The kernels and
+// copies of a graph launch share its correlation ID: the entry counts both and is analyzed
+// if any of them is. Correlation IDs increase, so a shard's first entry is its oldest.
+struct PendingOp {
+    kernel_name_id_t name_id = kUnknownKernel;
+    int32_t launch_device = 0;
+    int32_t copy_device = 0;
+    bool analyze = false;
+    uint32_t launches = 0;
+    uint32_t copies = 0;
+};
+
+constexpr uint32_t kPendingShards = 16;
+constexpr size_t kMaxPendingPerShard = 1 << 16;
+
+struct PendingShard {
+    std::mutex mutex;
+    std::map<uint64_t, PendingOp> ops;
+};
+
+PendingShard pending[kPendingShards];
+std::atomic<uint64_t> evicted_ops{0};
+
+template <typename Note>
+void note_pending(uint64_t correlation_id, Note&& note)
+{
+    auto& shard = pending[correlation_id % kPendingShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // records that never come back (dropped, failed calls) must not grow the map forever;
+    // the oldest go first, the operations still in flight keep their entries
+    if (shard.ops.size() >= kMaxPendingPerShard && shard.ops.count(correlation_id) == 0) {
+        shard.ops.erase(shard.ops.begin());
+        evicted_ops.fetch_add(1, std::memory_order_relaxed);
+    }
+    note(shard.ops[correlation_id]);
+}
+
+bool take_pending(uint64_t correlation_id, uint32_t PendingOp::*count, PendingOp& info)
+{
+    auto& shard = pending[correlation_id % kPendingShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.ops.find(correlation_id);
+    if (it == shard.ops.end() || it->second.*count == 0) return false;
+    info = it->second;
+    --(it->second.*count);
+    if (it->second.launches + it->second.copies == 0) shard.ops.erase(it);
+    return true;
+}
+
+// Consumer-side statistics; the mutex only guards against the final report.
+struct KernelTiming {
+    uint64_t count = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+};
+
+struct CopyTiming {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    uint64_t total_ns = 0;
+};
+
+std::mutex stats_mutex;
+std::unordered_map<kernel_name_id_t, KernelTiming> kernel_timing;
+CopyTiming copy_timing[ROCPROFILER_MEMORY_COPY_DEVICE_TO_DEVICE + 1];
+uint64_t dropped_records = 0;
+uint64_t unmatched_dispatches = 0;
+uint64_t unmatched_copies = 0;
+
+void on_dispatch(const rocprofiler_buffer_tracing_kernel_dispatch_record_t& record)
+{
+    const auto& info = record.dispatch_info;
+    kernel_name_id_t name_id = kernel_names().find(KernelNameTable::kKernelId, info.kernel_id);
+
+    // the start was staged by the launching thread in API order; only the completion,
+    // with the device times, is forwarded from here, on the device the launch stream is on
+    // (the agent's node id is not the HIP ordinal under HIP_VISIBLE_DEVICES)
+    PendingOp launch;
+    if (take_pending(record.correlation_id.internal, &PendingOp::launches, launch)) {
+        if (name_id == kUnknownKernel) name_id = launch.name_id;
+        if (launch.analyze)
+            analysis_kernel_end(record.correlation_id.internal, launch.launch_device,
+                                record.start_timestamp - clock_offset, record.end_timestamp - clock_offset);
+    } else {
+        unmatched_dispatches++;
+    }
+
+    uint64_t ns = record.end_timestamp > record.start_timestamp
+                      ? record.end_timestamp - record.start_timestamp : 0;
+    auto& t = kernel_timing[name_id];
+    t.count++;
+    t.total_ns += ns;
+    t.max_ns = std::max(t.max_ns, ns);
+}
+
+void on_copy(const rocprofiler_buffer_tracing_memory_copy_record_t& record)
+{
+    // matched to its API call like a dispatch; the copy itself went to sanalyzer from there
+    PendingOp copy;
+    if (take_pending(record.correlation_id.internal, &PendingOp::copies, copy)) {
+        if (copy.analyze)
+            analysis_memcpy_end(record.correlation_id.internal, copy.copy_device,
+                                record.start_timestamp - clock_offset, record.end_timestamp - clock_offset);
+    } else {
+        unmatched_copies++;
+    }
+
+    uint32_t op = static_cast<uint32_t>(record.operation);
+    if (op > ROCPROFILER_MEMORY_COPY_DEVICE_TO_DEVICE) return;
+    auto& t = copy_timing[op];
+    t.count++;
+    t.bytes += record.bytes;
+    if (record.end_timestamp > record.start_timestamp)
+        t.total_ns += record.end_timestamp - record.start_timestamp;
+}
+
+void buffer_callback(rocprofiler_context_id_t,
+                     rocprofiler_buffer_id_t,
+                     rocprofiler_record_header_t** headers,
+                     size_t num_headers,
+                     void*,
+                     uint64_t drop_count)
+{
+    using dispatch_record_t = rocprofiler_buffer_tracing_kernel_dispatch_record_t;
+    using copy_record_t = rocprofiler_buffer_tracing_memory_copy_record_t;
+
+    // forward the dispatches and copies of a batch in device start order
+    std::vector<std::pair<uint64_t, const rocprofiler_record_header_t*>> records;
+    records.reserve(num_headers);
+
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    dropped_records += drop_count;
+    for (size_t i = 0; i < num_headers; i++) {
+        auto* header = headers[i];
+        if (header->category != ROCPROFILER_BUFFER_CATEGORY_TRACING) continue;
+        if (header->kind == ROCPROFILER_BUFFER_TRACING_KERNEL_DISPATCH) {
+            records.emplace_back(static_cast<const dispatch_record_t*>(header->payload)->start_timestamp, header);
+        } else if (header->kind == ROCPROFILER_BUFFER_TRACING_MEMORY_COPY) {
+            records.emplace_back(static_cast<const copy_record_t*>(header->payload)->start_timestamp, header);
+        }
+    }
+
+    std::stable_sort(records.begin(), records.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (const auto& r : records) {
+        if (r.second->kind == ROCPROFILER_BUFFER_TRACING_KERNEL_DISPATCH)
+            on_dispatch(*static_cast<const dispatch_record_t*>(r.second->payload));
+        else
+            on_copy(*static_cast<const copy_record_t*>(r.second->payload));
+    }
+}
+
+void write_report(FILE* out)
+{
+    std::lock_guard<std::mutex> lock(stats_mutex);
+
+    std::vector<std::pair<kernel_name_id_t, KernelTiming>> kernels(kernel_timing.begin(), kernel_timing.end());
+    std::sort(kernels.begin(), kernels.end(), [](const auto& a, const auto& b) {
+        return a.second.total_ns > b.second.total_ns;
+    });
+    if (kernels.size() > 20) kernels.resize(20);
+
+    fprintf(out, "[ROCMPROF SUMMARY] device time by kernel (top %zu)\n", kernels.size());
+    fprintf(out, "[ROCMPROF SUMMARY] %10s %14s %12s %12s  %s\n", "count", "total(us)", "avg(us)", "max(us)", "kernel");
+    for (const auto& k : kernels) {
+        const auto& t = k.second;
+        fprintf(out, "[ROCMPROF SUMMARY] %10lu %14.1f %12.2f %12.2f  %s\n", (unsigned long)t.count,
+                t.total_ns / 1e3, t.total_ns / 1e3 / t.count, t.max_ns / 1e3,
+                kernel_names().name(k.first).c_str());
+    }
+    // every kernel, not only the top ones, so the job totals are complete
+    for (const auto& k : kernel_timing) {
+        const char* name = kernel_names().name(k.first).c_str();
+        process_report(out, ReportMerge::sum, (double)k.second.count, "kernel.%s.dispatches", name);
+        process_report(out, ReportMerge::sum, (double)k.second.total_ns, "kernel.%s.device_ns", name);
+        process_report(out, ReportMerge::max, (double)k.second.max_ns, "kernel.%s.max_device_ns", name);
+    }
+
+    static const char* directions[] = {"none", "HtoH", "HtoD", "DtoH", "DtoD"};
+    for (uint32_t op = 1; op <= ROCPROFILER_MEMORY_COPY_DEVICE_TO_DEVICE; op++) {
+        const auto& t = copy_timing[op];
+        if (t.count == 0) continue;
+        double gbps = t.total_ns > 0 ? (double)t.bytes / t.total_ns : 0.0;
+        fprintf(out, "[ROCMPROF SUMMARY] copy %s: %lu copies, %lu bytes, %.1f us, %.2f GB/s\n",
+                directions[op], (unsigned long)t.count, (unsigned long)t.bytes, t.total_ns / 1e3, gbps);
+        process_report(out, ReportMerge::sum, (double)t.count, "copy.%s.copies", directions[op]);
+        process_report(out, ReportMerge::sum, (double)t.bytes, "copy.%s.bytes", directions[op]);
+        process_report(out, ReportMerge::sum, (double)t.total_ns, "copy.%s.device_ns", directions[op]);
+    }
+    uint64_t evicted = evicted_ops.load(std::memory_order_relaxed);
+    if (dropped_records > 0 || unmatched_dispatches > 0 || unmatched_copies > 0 || evicted > 0)
+        fprintf(out, "[ROCMPROF SUMMARY] buffered records dropped: %lu, dispatches without API match: %lu, "
+                     "copies without API match: %lu, calls evicted before their record: %lu\n",
+                (unsigned long)dropped_records, (unsigned long)unmatched_dispatches,
+                (unsigned long)unmatched_copies, (unsigned long)evicted);
+    process_report(out, ReportMerge::sum, (double)dropped_records, "buffered.dropped_records");
+    process_report(out, ReportMerge::sum, (double)unmatched_dispatches, "buffered.unmatched_dispatches");
+    process_report(out, ReportMerge::sum, (double)unmatched_copies, "buffered.unmatched_copies");
+    process_report(out, ReportMerge::sum, (double)evicted, "buffered.evicted_calls");
+}
+
+void calibrate_clock()
+{
+    rocprofiler_timestamp_t device_now = 0;
+    ROCPROFILER_CALL(rocprofiler_get_timestamp(&device_now), "failed to read the timestamp");
+    int64_t steady_now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now().time_since_epoch()).count();
+    clock_offset = (int64_t)device_now - steady_now;
+}
+
+} // namespace
+
+bool buffered_tracing_enabled()
+{
+    return enabled;
+}
+
+void buffered_tracing_init(rocprofiler_context_id_t ctx)
+{
+    if (!env_bool("ACCELPROF_BUFFERED", false)) return;
+
+    calibrate_clock();
+
+    size_t size = env_u64("ACCELPROF_BUFFER_SIZE", 8 << 20);
+    size_t watermark = size - size / 8;
+    ROCPROFILER_CALL(rocprofiler_create_buffer(ctx, size, watermark, ROCPROFILER_BUFFER_POLICY_LOSSLESS,
+                                               buffer_callback, nullptr, &buffer),
+                     "buffer creation failed");
+
+    rocprofiler_buffer_tracing_kind_t kinds[] = {
+        ROCPROFILER_BUFFER_TRACING_KERNEL_DISPATCH,
+        ROCPROFILER_BUFFER_TRACING_MEMORY_COPY,
+    };
+    for (auto kind : kinds) {
+        ROCPROFILER_CALL(rocprofiler_configure_buffer_tracing_service(ctx, kind, nullptr, 0, buffer),
+                         "buffer tracing service failed to configure");
+    }
+
+    // drain on a dedicated thread instead of whichever thread fills the buffer
+    auto thread = rocprofiler_callback_thread_t{};
+    ROCPROFILER_CALL(rocprofiler_create_callback_thread(&thread), "callback thread creation failed");
+    ROCPROFILER_CALL(rocprofiler_assign_callback_thread(buffer, thread), "callback thread assignment failed");
+
+    log_add_summary(write_report);
+    enabled = true;
+}
+
+void buffered_tracing_flush()
+{
+    if (!enabled) return;
+    ROCPROFILER_CALL(rocprofiler_flush_buffer(buffer), "buffer flush failed");
+}
+
+void buffered_note_launch(uint64_t correlation_id, kernel_name_id_t name_id, int device, bool analyze)
+{
+    note_pending(correlation_id, [&](PendingOp& op) {
+        if (op.launches++ == 0) {
+            op.name_id = name_id;
+            op.launch_device = device;
+        }
+        op.analyze |= analyze;
+    });
+}
+
+void buffered_note_copy(uint64_t correlation_id, int device, bool analyze)
+{
+    note_pending(correlation_id, [&](PendingOp& op) {
+        if (op.copies++ == 0) op.copy_device = device;
+        op.analyze |= analyze;
+    });
+}
+
+} // namespace rocm_accelprof
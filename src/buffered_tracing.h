@@ -0,0 +1,37 @@
+#pragma once
+
+#include <rocprofiler-sdk/rocprofiler.h>
+
+#include <cstdint>
+
+#include "kernel_names.h"
+
+// Optional buffered (asynchronous) tracing, enabled with ACCELPROF_BUFFERED=1.
+//
+// Kernel dispatch and memory copy completion records are collected by rocprofiler into a
+// buffer and drained on a dedicated rocprofiler callback thread. The kernel start and the
+// copy are still staged by the calling thread, in API order with the rest of its calls; the
+// API handler also records the call under its correlation ID, and the consumer stages the
+// kernel end or copy end with the device start and end times once the record arrives.
+// sanalyzer has no copy completion callback, so copy ends only reach the trace.
+
+namespace rocm_accelprof {
+
+bool buffered_tracing_enabled();
+
+// Reads the environment and, when enabled, configures buffer tracing on ctx.
+void buffered_tracing_init(rocprofiler_context_id_t ctx);
+
+// Drain what is left in the buffers; called at tool finalization.
+void buffered_tracing_flush();
+
+// Remember the launch behind a correlation ID so the dispatch record can be matched;
+// device is the launch stream's. Launches the sampling policy skipped are timed but their
+// end is not forwarded.
+void buffered_note_launch(uint64_t correlation_id, kernel_name_id_t name_id, int device, bool analyze);
+
+// The same for a copy, so its memory copy record can be matched; device is the one the
+// copy was staged on.
+void buffered_note_copy(uint64_t correlation_id, int device, bool analyze);
+
+} // namespace rocm_accelprof
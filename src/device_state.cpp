@@ -0,0 +1,122 @@
+#include "device_state.h"
+
+#include <hip/hip_runtime.h>
+
+#include <cstdio>
+#include <mutex>
+
+#include "address_map.h"
+#include "logger.h"
+#include "process.h"
+#include "tool_guard.h"
+
+namespace rocm_accelprof {
+
+namespace {
+
+DeviceShard shards[kMaxDevices];
+
+thread_local int tls_device = -1;
+
+// stream handle -> device + 1 (0 means unknown)
+std::mutex streams_mutex;
+AddressMap streams;
+
+// the null stream, hipStreamLegacy and hipStreamPerThread are small sentinel values
+bool is_default_stream(const void* stream)
+{
+    return reinterpret_cast<uintptr_t>(stream) < 16;
+}
+
+void write_report(FILE* out)
+{
+    for (int d = 0; d < kMaxDevices; d++) {
+        auto& s = shards[d];
+        uint64_t launches = s.launches.load(std::memory_order_relaxed);
+        uint64_t allocs = s.allocs.load(std::memory_order_relaxed);
+        uint64_t memcpys = s.memcpys.load(std::memory_order_relaxed);
+        uint64_t memsets = s.memsets.load(std::memory_order_relaxed);
+        if (launches + allocs + memcpys + memsets == 0) continue;
+        fprintf(out, "[ROCMPROF SUMMARY] device %d: %lu launches, %lu allocs (%lu bytes), %lu frees, "
+                     "%lu memcpys (%lu bytes), %lu memsets (%lu bytes)\n",
+                d, (unsigned long)launches, (unsigned long)allocs,
+                (unsigned long)s.alloc_bytes.load(std::memory_order_relaxed),
+                (unsigned long)s.frees.load(std::memory_order_relaxed), (unsigned long)memcpys,
+                (unsigned long)s.memcpy_bytes.load(std::memory_order_relaxed), (unsigned long)memsets,
+                (unsigned long)s.memset_bytes.load(std::memory_order_relaxed));
+        process_report(out, ReportMerge::sum, (double)launches, "device.%d.launches", d);
+        process_report(out, ReportMerge::sum, (double)allocs, "device.%d.allocs", d);
+        process_report(out, ReportMerge::sum, (double)s.alloc_bytes.load(std::memory_order_relaxed),
+                       "device.%d.alloc_bytes", d);
+        process_report(out, ReportMerge::sum, (double)s.frees.load(std::memory_order_relaxed), "device.%d.frees", d);
+        process_report(out, ReportMerge::sum, (double)memcpys, "device.%d.memcpys", d);
+        process_report(out, ReportMerge::sum, (double)s.memcpy_bytes.load(std::memory_order_relaxed),
+                       "device.%d.memcpy_bytes", d);
+        process_report(out, ReportMerge::sum, (double)memsets, "device.%d.memsets", d);
+        process_report(out, ReportMerge::sum, (double)s.memset_bytes.load(std::memory_order_relaxed),
+                       "device.%d.memset_bytes", d);
+    }
+}
+
+} // namespace
+
+DeviceShard& device_shard(int device)
+{
+    if (device < 0) device = 0;
+    return shards[device % kMaxDevices];
+}
+
+int current_device()
+{
+    if (tls_device < 0) {
+        int device = 0;
+        ToolHipCall guard;
+        if (hipGetDevice(&device) != hipSuccess) device = 0;
+        tls_device = device;
+    }
+    return tls_device;
+}
+
+void set_current_device(int device)
+{
+    tls_device = device;
+}
+
+int stream_device(const void* stream)
+{
+    if (is_default_stream(stream)) return current_device();
+
+    uint32_t known = streams.find(reinterpret_cast<uint64_t>(stream));
+    if (known != 0) return (int)known - 1;
+
+    // a stream created before the tool attached, or by another library; ask once
+    hipDevice_t device = 0;
+    {
+        ToolHipCall guard;
+        if (hipStreamGetDevice(static_cast<hipStream_t>(const_cast<void*>(stream)), &device) != hipSuccess)
+            return current_device();
+    }
+    note_stream_created(stream, device);
+    return device;
+}
+
+void note_stream_created(const void* stream, int device)
+{
+    if (is_default_stream(stream)) return;
+    std::lock_guard<std::mutex> lock(streams_mutex);
+    streams.insert(reinterpret_cast<uint64_t>(stream), (uint32_t)device + 1);
+}
+
+void note_stream_destroyed(const void* stream)
+{
+    if (is_default_stream(stream)) return;
+    std::lock_guard<std::mutex> lock(streams_mutex);
+    streams.insert(reinterpret_cast<uint64_t>(stream), 0);
+}
+
+void device_state_init()
+{
+    log_add_summary(write_report);
+}
+
+} // namespace rocm_accelprof
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Device attribution and per-device state.
+//
+// The current device is tracked per host thread from hipSetDevice, the device of a
+// stream is remembered when the stream is created (or asked from HIP once), and all
+// per-device state lives in cache-line aligned shards so threads driving different GPUs
+// never touch the same lines.
+
+namespace rocm_accelprof {
+
+constexpr int kMaxDevices = 64;
+
+struct alignas(64) DeviceShard {
+    std::atomic<uint64_t> allocs{0};
+    std::atomic<uint64_t> alloc_bytes{0};
+    std::atomic<uint64_t> frees{0};
+    std::atomic<uint64_t> memcpys{0};
+    std::atomic<uint64_t> memcpy_bytes{0};
+    std::atomic<uint64_t> memsets{0};
+    std::atomic<uint64_t> memset_bytes{0};
+    std::atomic<uint64_t> launches{0};
+};
+
+// Out-of-range ids are clamped into the shard array.
+DeviceShard& device_shard(int device);
+
+// Device of the calling host thread, asked from HIP on first use.
+int current_device();
+void set_current_device(int device);
+
+// Device a stream belongs to; the null and per-thread streams follow the current device.
+int stream_device(const void* stream);
+void note_stream_created(const void* stream, int device);
+void note_stream_destroyed(const void* stream);
+
+// Registers the per-device summary with the logger.
+void device_state_init();
+
+} // namespace rocm_accelprof
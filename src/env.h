@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <strings.h>
+
+// Small helpers for the ACCELPROF_* environment configuration.
+
+namespace rocm_accelprof {
+
+inline const char* env_cstr(const char* name)
+{
+    const char* value = getenv(name);
+    return (value != nullptr && value[0] != '\0') ? value : nullptr;
+}
+
+inline std::string env_string(const char* name, const char* default_value = "")
+{
+    const char* value = env_cstr(name);
+    return value ? value : default_value;
+}
+
+inline uint64_t env_u64(const char* name, uint64_t default_value)
+{
+    const char* value = env_cstr(name);
+    if (value == nullptr) return default_value;
+    char* end = nullptr;
+    unsigned long long v = strtoull(value, &end, 0);
+    return (end != value) ? (uint64_t)v : default_value;
+}
+
+inline bool env_bool(const char* name, bool default_value)
+{
+    const char* value = env_cstr(name);
+    if (value == nullptr) return default_value;
+    return !(strcmp(value, "0") == 0 || strcasecmp(value, "false") == 0 ||
+             strcasecmp(value, "off") == 0 || strcasecmp(value, "no") == 0);
+}
+
+} // namespace rocm_accelprof
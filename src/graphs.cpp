@@ -0,0 +1,365 @@
+#include "graphs.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "env.h"
+#include "logger.h"
+#include "process.h"
+
+namespace rocm_accelprof {
+
+std::atomic<uint32_t> graph_captures{0};
+bool graphs_active = false;
+
+namespace {
+
+// One stream capture: the stream that began it and the streams that joined it.
+struct Capture {
+    GraphNodes nodes;
+    std::vector<const void*> streams;
+};
+
+constexpr size_t kReportedExecs = 10;
+
+struct GraphExec {
+    uint64_t id = 0;
+    std::shared_ptr<const GraphNodes> nodes;
+    uint64_t kinds[5] = {};
+    std::atomic<uint64_t> launches{0};
+};
+
+// What the report keeps of an executable graph.
+struct ExecSummary {
+    uint64_t id = 0;
+    uint64_t launches = 0;
+    size_t nodes = 0;
+    uint64_t kinds[5] = {};
+
+    uint64_t replayed() const { return launches * nodes; }
+};
+
+// Capture and graph construction, guarded by mutex.
+std::mutex mutex;
+std::unordered_map<const void*, Capture*> capture_streams;   // capturing and joined streams
+std::unordered_map<const void*, Capture*> capture_events;    // events recorded in a capture
+std::unordered_map<const void*, GraphNodes> graphs;
+uint64_t captured_graphs = 0;
+uint64_t built_graphs = 0;
+
+// Executable graphs, read by every launch. Destroyed ones are freed and only the
+// kReportedExecs that replayed the most nodes are kept for the report.
+std::shared_mutex execs_mutex;
+std::unordered_map<const void*, GraphExec*> execs;
+std::vector<ExecSummary> destroyed_execs;
+uint64_t instantiated_execs = 0;
+
+std::atomic<uint64_t> launches{0};
+std::atomic<uint64_t> replayed_nodes{0};
+std::atomic<uint64_t> unknown_launches{0};
+
+const char* const kKindNames[] = {"kernels", "copies", "memsets", "allocs", "frees"};
+
+void end_capture_locked(Capture* capture)
+{
+    for (const void* stream : capture->streams) capture_streams.erase(stream);
+    graph_captures.fetch_sub((uint32_t)capture->streams.size(), std::memory_order_relaxed);
+    for (auto it = capture_events.begin(); it != capture_events.end();) {
+        if (it->second == capture) it = capture_events.erase(it);
+        else ++it;
+    }
+    delete capture;
+}
+
+ExecSummary summarize(const GraphExec& e)
+{
+    ExecSummary summary;
+    summary.id = e.id;
+    summary.launches = e.launches.load(std::memory_order_relaxed);
+    summary.nodes = e.nodes->size();
+    std::copy(std::begin(e.kinds), std::end(e.kinds), summary.kinds);
+    return summary;
+}
+
+// Keeps the kReportedExecs summaries that replayed the most nodes first.
+void keep_top(std::vector<ExecSummary>& summaries)
+{
+    auto more_replayed = [](const ExecSummary& a, const ExecSummary& b) { return a.replayed() > b.replayed(); };
+    size_t top = std::min(summaries.size(), kReportedExecs);
+    std::partial_sort(summaries.begin(), summaries.begin() + top, summaries.end(), more_replayed);
+    summaries.resize(top);
+}
+
+std::string kind_counts(const uint64_t* kinds)
+{
+    std::string text;
+    char part[64];
+    for (uint32_t k = 0; k < 5; k++) {
+        if (kinds[k] == 0) continue;
+        snprintf(part, sizeof(part), "%s%lu %s", text.empty() ? "" : ", ", (unsigned long)kinds[k], kKindNames[k]);
+        text += part;
+    }
+    return text.empty() ? "empty" : text;
+}
+
+void write_report(FILE* out)
+{
+    uint64_t captured, built;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        captured = captured_graphs;
+        built = built_graphs;
+    }
+    std::shared_lock<std::shared_mutex> lock(execs_mutex);
+    uint64_t unknown = unknown_launches.load(std::memory_order_relaxed);
+    if (instantiated_execs == 0 && captured == 0 && built == 0 && unknown == 0) return;
+
+    fprintf(out, "[ROCMPROF SUMMARY] hip graphs: %lu captured, %lu built, %lu instantiated (%zu live), %lu "
+                 "launches replaying %lu nodes, %lu launches of graphs instantiated before attach\n",
+            (unsigned long)captured, (unsigned long)built, (unsigned long)instantiated_execs, execs.size(),
+            (unsigned long)launches.load(std::memory_order_relaxed),
+            (unsigned long)replayed_nodes.load(std::memory_order_relaxed), (unsigned long)unknown);
+    // exec ids are per process: only the totals merge
+    process_report(out, ReportMerge::sum, (double)captured, "graphs.captured");
+    process_report(out, ReportMerge::sum, (double)built, "graphs.built");
+    process_report(out, ReportMerge::sum, (double)instantiated_execs, "graphs.instantiated");
+    process_report(out, ReportMerge::sum, (double)launches.load(std::memory_order_relaxed), "graphs.launches");
+    process_report(out, ReportMerge::sum, (double)replayed_nodes.load(std::memory_order_relaxed),
+                   "graphs.replayed_nodes");
+    process_report(out, ReportMerge::sum, (double)unknown, "graphs.launches_before_attach");
+
+    std::vector<ExecSummary> sorted = destroyed_execs;
+    for (const auto& entry : execs) sorted.push_back(summarize(*entry.second));
+    keep_top(sorted);
+    for (const ExecSummary& e : sorted) {
+        fprintf(out, "[ROCMPROF SUMMARY]   graph exec %lu: %lu launches of %zu nodes (%s)\n", (unsigned long)e.id,
+                (unsigned long)e.launches, e.nodes, kind_counts(e.kinds).c_str());
+    }
+}
+
+} // namespace
+
+GraphNode GraphNode::kernel(uint32_t operation, kernel_name_id_t name_id, std::vector<uint8_t> args)
+{
+    GraphNode node;
+    node.kind = GraphNodeKind::kernel;
+    node.operation = operation;
+    node.name_id = name_id;
+    node.args = std::move(args);
+    return node;
+}
+
+GraphNode GraphNode::copy(uint32_t operation, uint64_t dst, uint64_t src, uint64_t size, uint32_t kind)
+{
+    GraphNode node;
+    node.kind = GraphNodeKind::copy;
+    node.operation = operation;
+    node.dst = dst;
+    node.src = src;
+    node.size = size;
+    node.copy_kind = kind;
+    return node;
+}
+
+GraphNode GraphNode::memset(uint32_t operation, uint64_t dst, int32_t value, uint64_t size)
+{
+    GraphNode node;
+    node.kind = GraphNodeKind::memset;
+    node.operation = operation;
+    node.dst = dst;
+    node.value = value;
+    node.size = size;
+    return node;
+}
+
+GraphNode GraphNode::alloc(uint32_t operation, uint64_t ptr, uint64_t size, int32_t device)
+{
+    GraphNode node;
+    node.kind = GraphNodeKind::alloc;
+    node.operation = operation;
+    node.dst = ptr;
+    node.size = size;
+    node.device = device;
+    return node;
+}
+
+GraphNode GraphNode::free(uint32_t operation, uint64_t ptr)
+{
+    GraphNode node;
+    node.kind = GraphNodeKind::free;
+    node.operation = operation;
+    node.dst = ptr;
+    return node;
+}
+
+void graphs_init()
+{
+    graphs_active = env_bool("ACCELPROF_GRAPHS", true);
+    if (graphs_active) log_add_summary(write_report);
+}
+
+bool graph_capturing_slow(const void* stream)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return capture_streams.count(stream) != 0;
+}
+
+void graph_capture_node(const void* stream, GraphNode node)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = capture_streams.find(stream);
+    if (it != capture_streams.end()) it->second->nodes.push_back(std::move(node));
+}
+
+void graph_begin_capture(const void* stream)
+{
+    if (!graphs_active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (capture_streams.count(stream) != 0) return;
+    auto* capture = new Capture();
+    capture->streams.push_back(stream);
+    capture_streams.emplace(stream, capture);
+    graph_captures.fetch_add(1, std::memory_order_relaxed);
+}
+
+void graph_end_capture(const void* stream, const void* graph)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = capture_streams.find(stream);
+    if (it == capture_streams.end()) return;
+    Capture* capture = it->second;
+    if (graph != nullptr) {
+        graphs[graph] = std::move(capture->nodes);
+        captured_graphs++;
+    }
+    end_capture_locked(capture);
+}
+
+void graph_event_recorded(const void* event, const void* stream)
+{
+    if (graph_captures.load(std::memory_order_relaxed) == 0) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = capture_streams.find(stream);
+    if (it != capture_streams.end()) capture_events[event] = it->second;
+    else capture_events.erase(event);
+}
+
+bool graph_stream_waits(const void* stream, const void* event)
+{
+    if (graph_captures.load(std::memory_order_relaxed) == 0) return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (capture_streams.count(stream) != 0) return true;
+    auto it = capture_events.find(event);
+    if (it == capture_events.end()) return false;
+    // the stream forks off the capture until the capture ends
+    it->second->streams.push_back(stream);
+    capture_streams.emplace(stream, it->second);
+    graph_captures.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void graph_add_node(const void* graph, GraphNode node)
+{
+    if (!graphs_active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = graphs.find(graph);
+    if (it == graphs.end()) {
+        it = graphs.emplace(graph, GraphNodes()).first;
+        built_graphs++;
+    }
+    it->second.push_back(std::move(node));
+}
+
+void graph_add_child(const void* graph, const void* child)
+{
+    if (!graphs_active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = graphs.find(child);
+    if (found == graphs.end()) return;
+    GraphNodes inlined = found->second;
+    auto it = graphs.find(graph);
+    if (it == graphs.end()) {
+        it = graphs.emplace(graph, GraphNodes()).first;
+        built_graphs++;
+    }
+    for (GraphNode& node : inlined) it->second.push_back(std::move(node));
+}
+
+void graph_cloned(const void* clone, const void* original)
+{
+    if (!graphs_active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = graphs.find(original);
+    if (it != graphs.end()) graphs[clone] = GraphNodes(it->second);
+}
+
+void graph_destroyed(const void* graph)
+{
+    if (!graphs_active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    graphs.erase(graph);
+}
+
+void graph_instantiated(const void* exec, const void* graph)
+{
+    if (!graphs_active) return;
+    std::shared_ptr<const GraphNodes> nodes;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = graphs.find(graph);
+        // a graph without nodes recorded here was built before we attached
+        if (it == graphs.end()) return;
+        nodes = std::make_shared<const GraphNodes>(it->second);
+    }
+
+    std::unique_lock<std::shared_mutex> lock(execs_mutex);
+    GraphExec*& e = execs[exec];
+    if (e == nullptr) {
+        e = new GraphExec();
+        e->id = ++instantiated_execs;
+    }
+    e->nodes = nodes;
+    std::fill(std::begin(e->kinds), std::end(e->kinds), 0);
+    for (const GraphNode& node : *nodes) e->kinds[(uint32_t)node.kind]++;
+}
+
+void graph_exec_destroyed(const void* exec)
+{
+    if (!graphs_active) return;
+    std::unique_lock<std::shared_mutex> lock(execs_mutex);
+    auto it = execs.find(exec);
+    if (it == execs.end()) return;
+    GraphExec* e = it->second;
+    execs.erase(it);
+    destroyed_execs.push_back(summarize(*e));
+    if (destroyed_execs.size() > 2 * kReportedExecs) keep_top(destroyed_execs);
+    delete e;
+}
+
+std::shared_ptr<const GraphNodes> graph_launch_nodes(const void* exec)
+{
+    if (!graphs_active) return nullptr;
+    std::shared_ptr<const GraphNodes> nodes;
+    {
+        std::shared_lock<std::shared_mutex> lock(execs_mutex);
+        auto it = execs.find(exec);
+        if (it != execs.end()) {
+            nodes = it->second->nodes;
+            it->second->launches.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (nodes == nullptr) {
+        unknown_launches.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    launches.fetch_add(1, std::memory_order_relaxed);
+    replayed_nodes.fetch_add(nodes->size(), std::memory_order_relaxed);
+    return nodes;
+}
+
+} // namespace rocm_accelprof
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "kernel_names.h"
+
+// HIP graphs: capture, instantiation and the node list of every executable graph.
+//
+// Work enqueued on a capturing stream does not run, it becomes a node of the graph being
+// captured: the handlers hand it here instead of issuing it. A stream joins a capture by
+// waiting on an event recorded in it, as multi-stream capture does. Nodes added with
+// hipGraphAdd*Node are recorded the same way and child graphs are inlined. Either way a
+// node's dependencies exist before it, so the order nodes arrive in is a valid order to
+// replay them in.
+//
+// hipGraphInstantiate freezes the graph's node list for the executable graph, and each
+// hipGraphLaunch replays it through the regular handlers on the launch stream: O(nodes),
+// without asking the runtime anything. Kernel arguments are copied when the node is
+// recorded, so replayed launches resolve their working sets like direct ones.
+//
+// ACCELPROF_GRAPHS=0 disables it; work on capturing streams is then issued as it is
+// enqueued and graph launches are not analyzed.
+
+namespace rocm_accelprof {
+
+enum class GraphNodeKind : uint8_t {
+    kernel = 0,
+    copy,
+    memset,
+    alloc,
+    free,
+};
+
+struct GraphNode {
+    GraphNodeKind kind = GraphNodeKind::kernel;
+    uint32_t operation = 0;              // the call that recorded the node
+    kernel_name_id_t name_id = kUnknownKernel;
+    uint64_t dst = 0;                    // copy and memset destination, alloc and free pointer
+    uint64_t src = 0;
+    uint64_t size = 0;
+    uint32_t copy_kind = 0;              // hipMemcpyKind
+    int32_t value = 0;                   // memset value
+    int32_t device = 0;                  // alloc device
+    std::vector<uint8_t> args;           // kernel arguments in kernarg layout, empty if unknown
+
+    static GraphNode kernel(uint32_t operation, kernel_name_id_t name_id, std::vector<uint8_t> args);
+    static GraphNode copy(uint32_t operation, uint64_t dst, uint64_t src, uint64_t size, uint32_t kind);
+    static GraphNode memset(uint32_t operation, uint64_t dst, int32_t value, uint64_t size);
+    static GraphNode alloc(uint32_t operation, uint64_t ptr, uint64_t size, int32_t device);
+    static GraphNode free(uint32_t operation, uint64_t ptr);
+};
+
+using GraphNodes = std::vector<GraphNode>;
+
+// Number of streams capturing right now; only updated while graphs are tracked.
+extern std::atomic<uint32_t> graph_captures;
+
+// Set once by graphs_init, read-only afterwards.
+extern bool graphs_active;
+
+void graphs_init();
+
+bool graph_capturing_slow(const void* stream);
+
+// True when work enqueued on stream is captured rather than run.
+inline bool graph_capturing(const void* stream)
+{
+    return graph_captures.load(std::memory_order_relaxed) != 0 && graph_capturing_slow(stream);
+}
+
+void graph_capture_node(const void* stream, GraphNode node);
+
+void graph_begin_capture(const void* stream);
+// graph is null when the capture failed
+void graph_end_capture(const void* stream, const void* graph);
+
+// hipEventRecord and hipStreamWaitEvent; graph_stream_waits returns true when the wait
+// is part of a capture (the stream was capturing or has joined one).
+void graph_event_recorded(const void* event, const void* stream);
+bool graph_stream_waits(const void* stream, const void* event);
+
+void graph_add_node(const void* graph, GraphNode node);
+void graph_add_child(const void* graph, const void* child);
+void graph_cloned(const void* clone, const void* original);
+void graph_destroyed(const void* graph);
+
+// Instantiation and hipGraphExecUpdate: the executable graph takes the graph's nodes.
+void graph_instantiated(const void* exec, const void* graph);
+void graph_exec_destroyed(const void* exec);
+
+// Nodes to replay for a launch of exec, null for a graph instantiated before we attached.
+std::shared_ptr<const GraphNodes> graph_launch_nodes(const void* exec);
+
+} // namespace rocm_accelprof
@@ -0,0 +1,560 @@
+#include "kernel_args.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "alloc_index.h"
+#include "analysis.h"
+#include "env.h"
+#include "logger.h"
+#include "process.h"
+
+namespace rocm_accelprof {
+
+bool kernel_args_active = false;
+
+namespace {
+
+constexpr uint32_t kMaxCandidates = 64;       // pointer-sized values looked up per launch
+constexpr uint32_t kMaxByValueScan = 256;     // bytes of a by-value argument scanned for pointers
+constexpr uint32_t kCacheEntries = 64;        // per thread, direct mapped
+constexpr uint32_t kNoteAmdgpuMetadata = 32;  // NT_AMDGPU_METADATA
+
+struct KernelArg {
+    uint32_t offset;
+    uint32_t size;
+    bool pointer;      // .value_kind global_buffer
+    bool scan;         // by_value, scanned word by word
+};
+
+// Argument layout of one kernel and the footprint of its launches.
+struct KernelArgLayout {
+    kernel_name_id_t name_id = kUnknownKernel;
+    std::vector<KernelArg> args;   // explicit arguments, in order
+    std::atomic<uint64_t> launches{0};
+    std::atomic<uint64_t> cache_hits{0};
+    std::atomic<uint64_t> buffers{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> max_bytes{0};
+};
+
+std::shared_mutex layouts_mutex;
+std::unordered_map<kernel_name_id_t, KernelArgLayout*> layouts;   // never freed
+std::atomic<uint64_t> layouts_version{0};
+std::atomic<uint64_t> code_objects{0};
+std::atomic<uint64_t> unknown_launches{0};
+
+struct LayoutCache {
+    uint64_t version = UINT64_MAX;
+    std::unordered_map<kernel_name_id_t, KernelArgLayout*> map;   // null: no metadata
+};
+
+struct CacheEntry {
+    uint64_t hash = 0;
+    uint64_t generation = 0;
+    const KernelArgLayout* layout = nullptr;
+    uint32_t num_values = 0;
+    uint32_t num_buffers = 0;
+    uint64_t bytes = 0;
+    uint64_t values[kMaxCandidates];
+    KernelBuffer buffers[kMaxKernelBuffers];
+};
+
+thread_local LayoutCache tls_layouts;
+thread_local std::unique_ptr<CacheEntry[]> tls_cache;
+
+// ----------- code object metadata -----------
+
+// Just enough msgpack for the AMDGPU metadata: maps, arrays, strings and integers are
+// read, everything else is skipped. Any malformed input sets fail.
+struct MsgPack {
+    const uint8_t* p;
+    const uint8_t* end;
+    bool fail = false;
+
+    uint64_t be(uint32_t n)
+    {
+        if ((size_t)(end - p) < n) {
+            fail = true;
+            p = end;
+            return 0;
+        }
+        uint64_t v = 0;
+        for (uint32_t i = 0; i < n; i++) v = v << 8 | *p++;
+        return v;
+    }
+
+    // Reads a map (or array) header; false leaves the value in place.
+    bool container(bool map, uint32_t& n)
+    {
+        if (p >= end) return false;
+        uint8_t b = *p;
+        uint8_t fix = map ? 0x80 : 0x90;
+        uint8_t c16 = map ? 0xde : 0xdc;
+        if ((b & 0xf0) == fix) {
+            p++;
+            n = b & 0x0f;
+        } else if (b == c16) {
+            p++;
+            n = (uint32_t)be(2);
+        } else if (b == c16 + 1) {
+            p++;
+            n = (uint32_t)be(4);
+        } else {
+            return false;
+        }
+        return !fail;
+    }
+
+    bool string(std::string& s)
+    {
+        if (p >= end) return false;
+        uint8_t b = *p;
+        uint64_t n;
+        if ((b & 0xe0) == 0xa0) {
+            p++;
+            n = b & 0x1f;
+        } else if (b >= 0xd9 && b <= 0xdb) {
+            p++;
+            n = be(1u << (b - 0xd9));
+        } else {
+            return false;
+        }
+        if (fail || (uint64_t)(end - p) < n) {
+            fail = true;
+            return false;
+        }
+        s.assign(reinterpret_cast<const char*>(p), n);
+        p += n;
+        return true;
+    }
+
+    bool integer(uint64_t& v)
+    {
+        if (p >= end) return false;
+        uint8_t b = *p;
+        if (b < 0x80) {
+            p++;
+            v = b;
+        } else if (b >= 0xcc && b <= 0xcf) {
+            p++;
+            v = be(1u << (b - 0xcc));
+        } else if (b >= 0xd0 && b <= 0xd3) {
+            p++;
+            v = be(1u << (b - 0xd0));
+        } else {
+            return false;
+        }
+        return !fail;
+    }
+
+    // Skips one value, nested ones included, without recursion.
+    void skip()
+    {
+        uint64_t pending = 1;
+        while (pending != 0 && !fail) {
+            pending--;
+            if (p >= end) {
+                fail = true;
+                return;
+            }
+            uint8_t b = *p++;
+            if (b < 0x80 || b >= 0xe0 || (b >= 0xc0 && b <= 0xc3)) continue;
+            if ((b & 0xf0) == 0x80) pending += 2 * (uint64_t)(b & 0x0f);
+            else if ((b & 0xf0) == 0x90) pending += b & 0x0f;
+            else if ((b & 0xe0) == 0xa0) advance(b & 0x1f);
+            else if (b >= 0xc4 && b <= 0xc6) advance(be(1u << (b - 0xc4)));                 // bin
+            else if (b >= 0xc7 && b <= 0xc9) advance(be(1u << (b - 0xc7)) + 1);             // ext
+            else if (b == 0xca) advance(4);
+            else if (b == 0xcb) advance(8);
+            else if (b >= 0xcc && b <= 0xcf) advance(1u << (b - 0xcc));
+            else if (b >= 0xd0 && b <= 0xd3) advance(1u << (b - 0xd0));
+            else if (b >= 0xd4 && b <= 0xd8) advance((1u << (b - 0xd4)) + 1);              // fixext
+            else if (b >= 0xd9 && b <= 0xdb) advance(be(1u << (b - 0xd9)));                 // str
+            else if (b == 0xdc) pending += be(2);
+            else if (b == 0xdd) pending += be(4);
+            else if (b == 0xde) pending += 2 * be(2);
+            else if (b == 0xdf) pending += 2 * be(4);
+            else fail = true;
+        }
+    }
+
+    void advance(uint64_t n)
+    {
+        if ((uint64_t)(end - p) < n) {
+            fail = true;
+            p = end;
+        } else {
+            p += n;
+        }
+    }
+};
+
+// One entry of a kernel's .args; hidden arguments are not part of the launch's values.
+bool parse_arg(MsgPack& in, KernelArg& arg, bool& explicit_arg)
+{
+    uint32_t n;
+    if (!in.container(true, n)) return false;
+    arg = KernelArg{0, 0, false, false};
+    std::string key, kind;
+    for (uint32_t i = 0; i < n && !in.fail; i++) {
+        uint64_t v = 0;
+        if (!in.string(key)) return false;
+        if (key == ".offset" && in.integer(v)) arg.offset = (uint32_t)v;
+        else if (key == ".size" && in.integer(v)) arg.size = (uint32_t)v;
+        else if (key == ".value_kind" && in.string(kind)) continue;
+        else in.skip();
+    }
+    explicit_arg = kind.compare(0, 7, "hidden_") != 0;
+    arg.pointer = kind == "global_buffer";
+    arg.scan = kind == "by_value" && arg.size >= sizeof(uint64_t);
+    return !in.fail;
+}
+
+bool parse_kernel(MsgPack& in, std::string& name, std::vector<KernelArg>& args)
+{
+    uint32_t n;
+    if (!in.container(true, n)) return false;
+    std::string key;
+    for (uint32_t i = 0; i < n && !in.fail; i++) {
+        if (!in.string(key)) return false;
+        uint32_t num_args;
+        if (key == ".name" && in.string(name)) continue;
+        if (key != ".args" || !in.container(false, num_args)) {
+            in.skip();
+            continue;
+        }
+        for (uint32_t a = 0; a < num_args && !in.fail; a++) {
+            KernelArg arg;
+            bool explicit_arg;
+            if (!parse_arg(in, arg, explicit_arg)) return false;
+            if (explicit_arg) args.push_back(arg);
+        }
+    }
+    return !in.fail;
+}
+
+void add_layouts(const uint8_t* metadata, size_t size)
+{
+    MsgPack in{metadata, metadata + size};
+    uint32_t n;
+    if (!in.container(true, n)) return;
+    std::string key;
+    for (uint32_t i = 0; i < n && !in.fail; i++) {
+        uint32_t num_kernels;
+        if (!in.string(key)) return;
+        if (key != "amdhsa.kernels" || !in.container(false, num_kernels)) {
+            in.skip();
+            continue;
+        }
+        for (uint32_t k = 0; k < num_kernels && !in.fail; k++) {
+            std::string name;
+            std::vector<KernelArg> args;
+            if (!parse_kernel(in, name, args) || name.empty()) return;
+
+            kernel_name_id_t id = kernel_names().intern(name.c_str());
+            std::unique_lock<std::shared_mutex> lock(layouts_mutex);
+            // the same code object is loaded once per device
+            if (layouts.count(id) != 0) continue;
+            auto* layout = new KernelArgLayout();
+            layout->name_id = id;
+            layout->args = std::move(args);
+            layouts.emplace(id, layout);
+            layouts_version.fetch_add(1, std::memory_order_release);
+        }
+    }
+}
+
+// Walks the notes of a 64-bit ELF image, by program headers or else by sections.
+void parse_elf(const uint8_t* image, size_t size)
+{
+    if (size < sizeof(Elf64_Ehdr) || memcmp(image, ELFMAG, SELFMAG) != 0 || image[EI_CLASS] != ELFCLASS64) return;
+    Elf64_Ehdr eh;
+    memcpy(&eh, image, sizeof(eh));
+
+    std::vector<std::pair<uint64_t, uint64_t>> notes;   // offset, size
+    for (uint32_t i = 0; i < eh.e_phnum; i++) {
+        uint64_t at = eh.e_phoff + (uint64_t)i * eh.e_phentsize;
+        if (eh.e_phentsize < sizeof(Elf64_Phdr) || at + sizeof(Elf64_Phdr) > size) break;
+        Elf64_Phdr ph;
+        memcpy(&ph, image + at, sizeof(ph));
+        if (ph.p_type == PT_NOTE) notes.emplace_back(ph.p_offset, ph.p_filesz);
+    }
+    for (uint32_t i = 0; notes.empty() && i < eh.e_shnum; i++) {
+        uint64_t at = eh.e_shoff + (uint64_t)i * eh.e_shentsize;
+        if (eh.e_shentsize < sizeof(Elf64_Shdr) || at + sizeof(Elf64_Shdr) > size) break;
+        Elf64_Shdr sh;
+        memcpy(&sh, image + at, sizeof(sh));
+        if (sh.sh_type == SHT_NOTE) notes.emplace_back(sh.sh_offset, sh.sh_size);
+    }
+
+    auto align4 = [](uint64_t v) { return (v + 3) & ~(uint64_t)3; };
+    for (const auto& note : notes) {
+        if (note.first > size || note.second > size - note.first) continue;
+        const uint8_t* p = image + note.first;
+        const uint8_t* end = p + note.second;
+        while ((size_t)(end - p) >= sizeof(Elf64_Nhdr)) {
+            Elf64_Nhdr nh;
+            memcpy(&nh, p, sizeof(nh));
+            p += sizeof(nh);
+            uint64_t name_bytes = align4(nh.n_namesz);
+            uint64_t desc_bytes = align4(nh.n_descsz);
+            if (name_bytes > (uint64_t)(end - p) || nh.n_descsz > (uint64_t)(end - p) - name_bytes) break;
+            if (nh.n_type == kNoteAmdgpuMetadata && nh.n_namesz == 7 && memcmp(p, "AMDGPU", 7) == 0) {
+                add_layouts(p + name_bytes, nh.n_descsz);
+                code_objects.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            p += std::min<uint64_t>(name_bytes + desc_bytes, (uint64_t)(end - p));
+        }
+    }
+}
+
+// ----------- launches -----------
+
+KernelArgLayout* find_layout(kernel_name_id_t name_id)
+{
+    LayoutCache& cache = tls_layouts;
+    uint64_t version = layouts_version.load(std::memory_order_acquire);
+    if (cache.version != version) {
+        cache.map.clear();
+        cache.version = version;
+    }
+    auto it = cache.map.find(name_id);
+    if (it != cache.map.end()) return it->second;
+
+    KernelArgLayout* layout = nullptr;
+    {
+        std::shared_lock<std::shared_mutex> lock(layouts_mutex);
+        auto found = layouts.find(name_id);
+        if (found != layouts.end()) layout = found->second;
+    }
+    cache.map.emplace(name_id, layout);
+    return layout;
+}
+
+// Pointer-sized argument values worth looking up, with the argument they came from.
+uint32_t gather_values(const KernelArgLayout& layout, const KernelArgValues& values, uint64_t* out,
+                       uint32_t* arg_of)
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < layout.args.size() && n < kMaxCandidates; i++) {
+        const KernelArg& arg = layout.args[i];
+        if (!arg.pointer && !arg.scan) continue;
+        const uint8_t* value;
+        if (values.args != nullptr) {
+            value = static_cast<const uint8_t*>(values.args[i]);
+        } else {
+            if ((uint64_t)arg.offset + arg.size > values.packed_size) continue;
+            value = static_cast<const uint8_t*>(values.packed) + arg.offset;
+        }
+        if (value == nullptr) continue;
+
+        uint32_t bytes = arg.pointer ? (uint32_t)sizeof(uint64_t) : std::min(arg.size, kMaxByValueScan);
+        for (uint32_t at = 0; at + sizeof(uint64_t) <= bytes && n < kMaxCandidates; at += sizeof(uint64_t)) {
+            uint64_t v;
+            memcpy(&v, value + at, sizeof(v));
+            if (v == 0) continue;
+            out[n] = v;
+            arg_of[n] = i;
+            n++;
+        }
+    }
+    return n;
+}
+
+uint64_t signature(kernel_name_id_t name_id, const uint64_t* values, uint32_t n)
+{
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ name_id;
+    for (uint32_t i = 0; i < n; i++) {
+        h = (h ^ values[i]) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+void resolve(CacheEntry& e, const uint64_t* values, const uint32_t* arg_of, uint32_t n)
+{
+    e.num_buffers = 0;
+    e.bytes = 0;
+    alloc_index().with_each(values, n, [&](size_t i, const Allocation* a) {
+        if (a == nullptr || e.num_buffers == kMaxKernelBuffers) return;
+        for (uint32_t b = 0; b < e.num_buffers; b++)
+            if (e.buffers[b].base == a->base) return;
+        e.buffers[e.num_buffers++] = KernelBuffer{a->base, a->size, arg_of[i]};
+        e.bytes += a->size;
+    });
+}
+
+void write_report(FILE* out)
+{
+    std::vector<const KernelArgLayout*> used;
+    {
+        std::shared_lock<std::shared_mutex> lock(layouts_mutex);
+        for (const auto& entry : layouts)
+            if (entry.second->launches.load(std::memory_order_relaxed) != 0) used.push_back(entry.second);
+    }
+    uint64_t unknown = unknown_launches.load(std::memory_order_relaxed);
+    if (used.empty() && unknown == 0) return;
+
+    uint64_t launches = 0, hits = 0;
+    for (const KernelArgLayout* l : used) {
+        launches += l->launches.load(std::memory_order_relaxed);
+        hits += l->cache_hits.load(std::memory_order_relaxed);
+    }
+    fprintf(out, "[ROCMPROF SUMMARY] kernel working sets: %zu kernels from %lu code objects, %lu launches "
+                 "resolved (%.1f%% cached), %lu launches without argument metadata\n",
+            used.size(), (unsigned long)code_objects.load(std::memory_order_relaxed), (unsigned long)launches,
+            launches ? 100.0 * (double)hits / (double)launches : 0.0, (unsigned long)unknown);
+    process_report(out, ReportMerge::sum, (double)launches, "working_sets.launches_resolved");
+    process_report_mean(out, launches ? (double)hits / (double)launches : 0.0, (double)launches,
+                        "working_sets.cache_hit_ratio");
+    process_report(out, ReportMerge::sum, (double)unknown, "working_sets.launches_without_metadata");
+
+    std::sort(used.begin(), used.end(), [](const KernelArgLayout* a, const KernelArgLayout* b) {
+        return a->max_bytes.load(std::memory_order_relaxed) > b->max_bytes.load(std::memory_order_relaxed);
+    });
+    for (size_t i = 0; i < std::min<size_t>(used.size(), 15); i++) {
+        const KernelArgLayout* l = used[i];
+        uint64_t n = l->launches.load(std::memory_order_relaxed);
+        fprintf(out, "[ROCMPROF SUMMARY]   max %lu bytes, mean %.0f bytes in %.1f buffers, %lu launches: %s\n",
+                (unsigned long)l->max_bytes.load(std::memory_order_relaxed),
+                (double)l->bytes.load(std::memory_order_relaxed) / (double)n,
+                (double)l->buffers.load(std::memory_order_relaxed) / (double)n, (unsigned long)n,
+                kernel_names().name(l->name_id).c_str());
+    }
+    // every kernel, not only the top ones, so the job totals are complete
+    for (const KernelArgLayout* l : used) {
+        uint64_t n = l->launches.load(std::memory_order_relaxed);
+        const char* name = kernel_names().name(l->name_id).c_str();
+        process_report(out, ReportMerge::max, (double)l->max_bytes.load(std::memory_order_relaxed),
+                       "kernel.%s.working_set_max_bytes", name);
+        process_report_mean(out, (double)l->bytes.load(std::memory_order_relaxed) / (double)n, (double)n,
+                            "kernel.%s.working_set_mean_bytes", name);
+    }
+}
+
+} // namespace
+
+void kernel_args_init()
+{
+    kernel_args_active = env_bool("ACCELPROF_KERNEL_ARGS", true);
+    if (kernel_args_active) log_add_summary(write_report);
+}
+
+void kernel_args_code_object(const void* image, size_t size)
+{
+    if (!kernel_args_active || image == nullptr) return;
+    parse_elf(static_cast<const uint8_t*>(image), size);
+}
+
+// file://<path>#offset=<n>&size=<n>, the path percent-encoded; size 0 is the whole file
+void kernel_args_code_object_uri(const char* uri)
+{
+    if (!kernel_args_active || uri == nullptr || strncmp(uri, "file://", 7) != 0) return;
+    std::string spec = uri + 7;
+    std::string path;
+    uint64_t offset = 0, size = 0;
+    size_t hash = spec.find('#');
+    for (size_t i = 0; i < std::min(hash, spec.size()); i++) {
+        if (spec[i] == '%' && i + 2 < spec.size()) {
+            path += (char)strtol(spec.substr(i + 1, 2).c_str(), nullptr, 16);
+            i += 2;
+        } else {
+            path += spec[i];
+        }
+    }
+    if (hash != std::string::npos) {
+        const char* params = spec.c_str() + hash + 1;
+        if (const char* o = strstr(params, "offset=")) offset = strtoull(o + 7, nullptr, 0);
+        if (const char* s = strstr(params, "size=")) size = strtoull(s + 5, nullptr, 0);
+    }
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    if (size == 0) {
+        off_t end = lseek(fd, 0, SEEK_END);
+        size = end > (off_t)offset ? (uint64_t)end - offset : 0;
+    }
+    std::vector<uint8_t> image(size);
+    ssize_t got = size ? pread(fd, image.data(), size, (off_t)offset) : 0;
+    close(fd);
+    if (got == (ssize_t)size && size != 0) parse_elf(image.data(), size);
+}
+
+uint32_t kernel_args_launch(kernel_name_id_t name_id, const KernelArgValues& values, const KernelBuffer** buffers)
+{
+    *buffers = nullptr;
+    if (!kernel_args_active || (values.args == nullptr && values.packed == nullptr)) return 0;
+    KernelArgLayout* layout = find_layout(name_id);
+    if (layout == nullptr) {
+        unknown_launches.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+
+    uint64_t candidates[kMaxCandidates];
+    uint32_t arg_of[kMaxCandidates];
+    uint32_t n = gather_values(*layout, values, candidates, arg_of);
+    uint64_t hash = signature(name_id, candidates, n);
+    uint64_t generation = alloc_index().generation();
+
+    if (!tls_cache) tls_cache.reset(new CacheEntry[kCacheEntries]);
+    CacheEntry& e = tls_cache[hash % kCacheEntries];
+    bool hit = e.hash == hash && e.layout == layout && e.generation == generation && e.num_values == n &&
+               std::equal(candidates, candidates + n, e.values);
+    if (!hit) {
+        e.hash = hash;
+        e.layout = layout;
+        e.generation = generation;
+        e.num_values = n;
+        std::copy(candidates, candidates + n, e.values);
+        resolve(e, candidates, arg_of, n);
+    }
+
+    layout->launches.fetch_add(1, std::memory_order_relaxed);
+    if (hit) layout->cache_hits.fetch_add(1, std::memory_order_relaxed);
+    layout->buffers.fetch_add(e.num_buffers, std::memory_order_relaxed);
+    layout->bytes.fetch_add(e.bytes, std::memory_order_relaxed);
+    uint64_t max = layout->max_bytes.load(std::memory_order_relaxed);
+    while (e.bytes > max && !layout->max_bytes.compare_exchange_weak(max, e.bytes, std::memory_order_relaxed)) {}
+
+    *buffers = e.buffers;
+    return e.num_buffers;
+}
+
+std::vector<uint8_t> kernel_args_pack(kernel_name_id_t name_id, const KernelArgValues& values)
+{
+    std::vector<uint8_t> packed;
+    if (!kernel_args_active) return packed;
+    if (values.args == nullptr) {
+        if (values.packed != nullptr) {
+            const uint8_t* bytes = static_cast<const uint8_t*>(values.packed);
+            packed.assign(bytes, bytes + values.packed_size);
+        }
+        return packed;
+    }
+    KernelArgLayout* layout = find_layout(name_id);
+    if (layout == nullptr) return packed;
+    uint32_t size = 0;
+    for (const KernelArg& arg : layout->args) size = std::max(size, arg.offset + arg.size);
+    packed.resize(size);
+    for (uint32_t i = 0; i < layout->args.size(); i++) {
+        const KernelArg& arg = layout->args[i];
+        if (values.args[i] != nullptr) memcpy(packed.data() + arg.offset, values.args[i], arg.size);
+    }
+    return packed;
+}
+
+} // namespace rocm_accelprof
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "kernel_names.h"
+
+// Per-launch working sets from kernel argument buffers.
+//
+// Code objects are parsed as they are loaded: their AMDGPU metadata note (msgpack) gives
+// the offset, size and kind of every explicit argument of every kernel. At launch the
+// argument values are read, from the args array of hipLaunchKernel/kernelParams or from
+// the packed kernarg buffer passed in hipModuleLaunchKernel's extra, and the pointer-sized
+// values (global buffer arguments, and the 8-byte words of by-value arguments such as
+// structs of pointers) are resolved against the live allocations. The allocations found,
+// each once, are the launch's working set: the launch handler stages them for the
+// analysis immediately ahead of the kernel start, and they are summed per kernel for the
+// summary.
+//
+// Resolution is cached per thread by kernel and argument values and reused while the set
+// of live allocations is unchanged, so a steady-state loop (or a caching allocator)
+// resolves each distinct launch once. ACCELPROF_KERNEL_ARGS=0 disables all of it.
+
+namespace rocm_accelprof {
+
+constexpr uint32_t kMaxKernelBuffers = 32;
+
+struct KernelBuffer {
+    uint64_t base;
+    uint64_t size;
+    uint32_t arg_index;   // first explicit argument that refers to the allocation
+};
+
+// Where the argument values of one launch are: an array with a pointer to each explicit
+// argument, or a packed kernarg buffer.
+struct KernelArgValues {
+    void** args = nullptr;
+    const void* packed = nullptr;
+    size_t packed_size = 0;
+};
+
+// Set once by kernel_args_init, read-only afterwards.
+extern bool kernel_args_active;
+
+void kernel_args_init();
+
+// Argument layouts of the kernels in a loaded code object, from memory or a file:// URI
+// with offset and size.
+void kernel_args_code_object(const void* image, size_t size);
+void kernel_args_code_object_uri(const char* uri);
+
+// Resolves the working set of a launch and counts it for the kernel. Returns the number of
+// buffers; *buffers stays valid until the calling thread's next launch.
+uint32_t kernel_args_launch(kernel_name_id_t name_id, const KernelArgValues& values, const KernelBuffer** buffers);
+
+// Copies the explicit arguments of a launch into a buffer in kernarg layout, to be passed
+// back as packed values later (graph nodes outlive the argument array). Empty when the
+// kernel's layout is unknown.
+std::vector<uint8_t> kernel_args_pack(kernel_name_id_t name_id, const KernelArgValues& values);
+
+} // namespace rocm_accelprof
@@ -0,0 +1,84 @@
+#include "kernel_names.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h> // for kernel name demangling
+
+namespace rocm_accelprof {
+
+KernelNameTable::KernelNameTable()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    add_locked("", "unknown");
+}
+
+kernel_name_id_t KernelNameTable::add_locked(const std::string& key, std::string name)
+{
+    auto it = ids_.find(key);
+    if (it != ids_.end()) return it->second;
+
+    uint32_t id = count_.load(std::memory_order_relaxed);
+    uint32_t chunk = id >> kChunkBits;
+    if (chunk >= kMaxChunks) return kUnknownKernel;
+
+    std::string* names = chunks_[chunk].load(std::memory_order_relaxed);
+    if (names == nullptr) {
+        names = new std::string[kChunkMask + 1];
+        chunks_[chunk].store(names, std::memory_order_release);
+    }
+    names[id & kChunkMask] = std::move(name);
+    ids_.emplace(key, id);
+    count_.store(id + 1, std::memory_order_release);
+    return id;
+}
+
+kernel_name_id_t KernelNameTable::intern(const char* mangled_name)
+{
+    if (mangled_name == nullptr || mangled_name[0] == '\0') return kUnknownKernel;
+
+    std::string key(mangled_name);
+    // descriptor symbols carry a ".kd" suffix
+    if (key.size() > 3 && key.compare(key.size() - 3, 3, ".kd") == 0) key.resize(key.size() - 3);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = ids_.find(key);
+    if (it != ids_.end()) return it->second;
+
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(key.c_str(), nullptr, nullptr, &status);
+    std::string name = (status == 0 && demangled) ? std::string(demangled) : key;
+    free(demangled);
+    return add_locked(key, std::move(name));
+}
+
+void KernelNameTable::bind(Key kind, uint64_t key, kernel_name_id_t id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    maps_[kind].insert(key, id);
+}
+
+kernel_name_id_t KernelNameTable::resolve(Key kind, uint64_t key)
+{
+    kernel_name_id_t id = maps_[kind].find(key);
+    if (id != kUnknownKernel || key == 0) return id;
+
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "func-0x%lx", (unsigned long)key);
+    std::lock_guard<std::mutex> lock(mutex_);
+    // another thread may have bound a real name meanwhile
+    id = maps_[kind].find(key);
+    if (id != kUnknownKernel) return id;
+    id = add_locked(buffer, buffer);
+    maps_[kind].insert(key, id);
+    return id;
+}
+
+KernelNameTable& kernel_names()
+{
+    // never destroyed: launches may still resolve names while the process exits
+    static auto* table = new KernelNameTable();
+    return *table;
+}
+
+} // namespace rocm_accelprof
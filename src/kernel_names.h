@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "address_map.h"
+
+// Interned kernel names.
+//
+// Code-object tracing registers every kernel symbol once; launches then resolve their
+// function address (or kernel object / kernel id / hipFunction_t) to a small integer id
+// with one lock-free hash lookup and no allocation. Names are demangled when interned.
+
+namespace rocm_accelprof {
+
+using kernel_name_id_t = uint32_t;
+constexpr kernel_name_id_t kUnknownKernel = 0;
+
+class KernelNameTable {
+public:
+    enum Key {
+        kHostFunction,    // host stub address passed to hipLaunchKernel
+        kKernelObject,    // kernel descriptor address
+        kKernelId,        // rocprofiler kernel id
+        kModuleFunction,  // hipFunction_t passed to hipModuleLaunchKernel
+        kNumKeys,
+    };
+
+    KernelNameTable();
+
+    // Demangle and intern a symbol name; the same mangled name always yields the same id.
+    kernel_name_id_t intern(const char* mangled_name);
+
+    void bind(Key kind, uint64_t key, kernel_name_id_t id);
+
+    kernel_name_id_t find(Key kind, uint64_t key) const { return maps_[kind].find(key); }
+
+    // Like find, but interns a "func-0x..." placeholder for an address that was never
+    // registered, so repeated launches of it are still allocation-free.
+    kernel_name_id_t resolve(Key kind, uint64_t key);
+
+    const std::string& name(kernel_name_id_t id) const {
+        return chunks_[id >> kChunkBits].load(std::memory_order_acquire)[id & kChunkMask];
+    }
+
+    uint32_t size() const { return count_.load(std::memory_order_acquire); }
+
+private:
+    static constexpr uint32_t kChunkBits = 12;
+    static constexpr uint32_t kChunkMask = (1u << kChunkBits) - 1;
+    static constexpr uint32_t kMaxChunks = 1024;
+
+    kernel_name_id_t add_locked(const std::string& key, std::string name);
+
+    std::mutex mutex_;  // serializes interning and binding
+    std::unordered_map<std::string, kernel_name_id_t> ids_;
+    std::atomic<std::string*> chunks_[kMaxChunks] = {};
+    std::atomic<uint32_t> count_{0};
+    AddressMap maps_[kNumKeys];
+};
+
+KernelNameTable& kernel_names();
+
+} // namespace rocm_accelprof
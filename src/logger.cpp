@@ -0,0 +1,384 @@
+#include "logger.h"
+#include "env.h"
+#include "process.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <stdio_ext.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace rocm_accelprof {
+
+int log_level = static_cast<int>(LogLevel::off);
+
+namespace {
+
+// One ring slot. A null fmt marks a text record: args[0] holds the length and the text
+// follows in the next slots.
+struct LogSlot {
+    const char* fmt;
+    uint64_t correlation_id;
+    uint64_t args[kMaxLogArgs];
+};
+static_assert(sizeof(LogSlot) == 64, "log slots are one cache line");
+
+constexpr uint32_t kRingSlots = 4096;
+constexpr uint32_t kMaxTextSlots = 64;
+
+// Single-producer (the owning thread) single-consumer (the writer thread) ring.
+struct LogRing {
+    alignas(64) std::atomic<uint64_t> head{0};
+    uint64_t cached_tail = 0;
+    alignas(64) std::atomic<uint64_t> tail{0};
+    alignas(64) std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> owned{false};
+    uint64_t thread_id = 0;
+    std::atomic<uint64_t> op_counts[kMaxLogOps] = {};
+    LogSlot* slots = nullptr;   // kRingSlots, only from the api level up
+};
+
+struct LoggerState {
+    std::mutex mutex;                // guards rings and the condition variable
+    std::condition_variable cv;
+    std::vector<LogRing*> rings;     // never freed; rings of exited threads are reused
+    std::thread writer;
+    std::atomic<bool> running{false};
+    FILE* out = stdout;
+    log_op_name_fn op_name = nullptr;
+    std::vector<log_summary_fn> summaries;
+};
+
+LoggerState& state()
+{
+    static auto* s = new LoggerState();
+    return *s;
+}
+
+uint64_t current_tid()
+{
+    return static_cast<uint64_t>(syscall(SYS_gettid));
+}
+
+// Releases the ring of an exiting thread so that a later thread can take it over.
+struct RingOwner {
+    LogRing* ring = nullptr;
+    ~RingOwner() {
+        if (ring) ring->owned.store(false, std::memory_order_release);
+    }
+};
+
+thread_local RingOwner tls_ring;
+
+LogRing* acquire_ring()
+{
+    auto& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    LogRing* ring = nullptr;
+    for (auto* r : s.rings) {
+        if (!r->owned.load(std::memory_order_acquire) &&
+            r->head.load(std::memory_order_acquire) == r->tail.load(std::memory_order_acquire)) {
+            ring = r;
+            break;
+        }
+    }
+    if (ring == nullptr) {
+        ring = new LogRing();
+        s.rings.push_back(ring);
+    }
+    if (ring->slots == nullptr && log_enabled(LogLevel::api)) ring->slots = new LogSlot[kRingSlots];
+    ring->owned.store(true, std::memory_order_release);
+    ring->thread_id = current_tid();
+    return ring;
+}
+
+inline LogRing* thread_ring()
+{
+    if (tls_ring.ring == nullptr) tls_ring.ring = acquire_ring();
+    return tls_ring.ring;
+}
+
+// Reserve n consecutive slots; returns the first sequence number or UINT64_MAX when full.
+inline uint64_t reserve(LogRing* ring, uint32_t n)
+{
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head + n - ring->cached_tail > kRingSlots) {
+        ring->cached_tail = ring->tail.load(std::memory_order_acquire);
+        if (head + n - ring->cached_tail > kRingSlots) {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed);
+            return UINT64_MAX;
+        }
+    }
+    return head;
+}
+
+void write_slot(FILE* out, const LogRing* ring, const LogSlot& slot)
+{
+    fprintf(out, "[ROCMPROF INFO] tid=%lu, cid=%lu, ", (unsigned long)ring->thread_id,
+            (unsigned long)slot.correlation_id);
+    const uint64_t* a = slot.args;
+    fprintf(out, slot.fmt, a[0], a[1], a[2], a[3], a[4], a[5]);
+    fputc('\n', out);
+}
+
+// Drain everything currently published in the ring. Returns the number of slots consumed.
+uint64_t drain(LogRing* ring, FILE* out)
+{
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    uint64_t consumed = head - tail;
+
+    while (tail < head) {
+        const LogSlot& slot = ring->slots[tail % kRingSlots];
+        if (slot.fmt != nullptr) {
+            write_slot(out, ring, slot);
+            tail++;
+            continue;
+        }
+        size_t len = slot.args[0];
+        fputs("[ROCMPROF INFO] ", out);
+        tail++;
+        while (len > 0) {
+            size_t chunk = std::min(len, sizeof(LogSlot));
+            fwrite(&ring->slots[tail % kRingSlots], 1, chunk, out);
+            len -= chunk;
+            tail++;
+        }
+        fputc('\n', out);
+    }
+    ring->tail.store(tail, std::memory_order_release);
+    return consumed;
+}
+
+std::vector<LogRing*> snapshot_rings()
+{
+    auto& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.rings;
+}
+
+void writer_loop()
+{
+    auto& s = state();
+    while (s.running.load(std::memory_order_acquire)) {
+        uint64_t consumed = 0;
+        for (auto* ring : snapshot_rings()) consumed += drain(ring, s.out);
+        if (consumed == 0) {
+            fflush(s.out);
+            std::unique_lock<std::mutex> lock(s.mutex);
+            s.cv.wait_for(lock, std::chrono::milliseconds(2));
+        }
+    }
+}
+
+void write_summary(FILE* out)
+{
+    auto& s = state();
+    std::vector<uint64_t> totals(kMaxLogOps, 0);
+    uint64_t dropped = 0;
+    for (auto* ring : snapshot_rings()) {
+        for (uint32_t op = 0; op < kMaxLogOps; op++)
+            totals[op] += ring->op_counts[op].load(std::memory_order_relaxed);
+        dropped += ring->dropped.load(std::memory_order_relaxed);
+    }
+
+    std::vector<std::pair<uint64_t, uint32_t>> order;
+    for (uint32_t op = 0; op < kMaxLogOps; op++)
+        if (totals[op] > 0) order.emplace_back(totals[op], op);
+    std::sort(order.rbegin(), order.rend());
+
+    for (const auto& entry : order) {
+        const char* name = s.op_name ? s.op_name(entry.second) : nullptr;
+        if (name) {
+            fprintf(out, "[ROCMPROF SUMMARY] %-32s %lu\n", name, (unsigned long)entry.first);
+            process_report(out, ReportMerge::sum, (double)entry.first, "calls.%s", name);
+        } else {
+            fprintf(out, "[ROCMPROF SUMMARY] op-%-29u %lu\n", entry.second, (unsigned long)entry.first);
+            process_report(out, ReportMerge::sum, (double)entry.first, "calls.op-%u", entry.second);
+        }
+    }
+    if (dropped > 0) {
+        fprintf(out, "[ROCMPROF SUMMARY] %lu log records dropped (ring full)\n", (unsigned long)dropped);
+        process_report(out, ReportMerge::sum, (double)dropped, "log.dropped_records");
+    }
+
+    for (auto fn : s.summaries) fn(out);
+}
+
+// The summary goes to the log output and, when a job aggregator is configured, its records
+// to the aggregator; it is built once in memory so every section runs a single time.
+void write_summaries()
+{
+    auto& s = state();
+    if (!process_aggregating()) {
+        write_summary(s.out);
+        return;
+    }
+    char* text = nullptr;
+    size_t len = 0;
+    FILE* mem = open_memstream(&text, &len);
+    if (mem == nullptr) {
+        write_summary(s.out);
+        return;
+    }
+    write_summary(mem);
+    fclose(mem);
+    std::string display, records;
+    process_split_report(text, len, display, records);
+    free(text);
+    fwrite(display.data(), 1, display.size(), s.out);
+    process_send_report("hip", records.data(), records.size());
+}
+
+// Fork: the mutex is held across it so the child never inherits it locked. The child has
+// no writer thread and must not write the parent's pending records or count its calls: it
+// drops them, discards what the parent left buffered in the log file and stays silent.
+void before_fork() { state().mutex.lock(); }
+
+void after_fork_parent() { state().mutex.unlock(); }
+
+void after_fork_child()
+{
+    auto& s = state();
+    s.mutex.unlock();
+    log_level = static_cast<int>(LogLevel::off);
+    s.running.store(false, std::memory_order_relaxed);
+    new (&s.writer) std::thread();   // the parent's writer does not exist here
+    for (auto* ring : s.rings) {
+        ring->tail.store(ring->head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        ring->cached_tail = ring->tail.load(std::memory_order_relaxed);
+        ring->dropped.store(0, std::memory_order_relaxed);
+        for (auto& count : ring->op_counts) count.store(0, std::memory_order_relaxed);
+        ring->owned.store(ring == tls_ring.ring, std::memory_order_relaxed);
+    }
+    if (s.out != stdout) __fpurge(s.out);
+}
+
+LogLevel parse_level(const char* value)
+{
+    // nothing by default; a configured job aggregator waits for the summary, so it gets one
+    if (value == nullptr) return process_aggregating() ? LogLevel::summary : LogLevel::off;
+    if (strcmp(value, "off") == 0 || strcmp(value, "0") == 0) return LogLevel::off;
+    if (strcmp(value, "summary") == 0 || strcmp(value, "1") == 0) return LogLevel::summary;
+    if (strcmp(value, "api") == 0 || strcmp(value, "2") == 0) return LogLevel::api;
+    if (strcmp(value, "full") == 0 || strcmp(value, "3") == 0) return LogLevel::full;
+    fprintf(stderr, "[ROCMPROF WARNING] unknown ACCELPROF_LOG_LEVEL '%s', using summary\n", value);
+    return LogLevel::summary;
+}
+
+} // namespace
+
+void log_init(log_op_name_fn op_name)
+{
+    auto& s = state();
+    if (s.running.load()) return;
+
+    static bool fork_handlers = false;
+    if (!fork_handlers) {
+        fork_handlers = true;
+        process_init();
+        pthread_atfork(before_fork, after_fork_parent, after_fork_child);
+    }
+
+    LogLevel level = parse_level(env_cstr("ACCELPROF_LOG_LEVEL"));
+    s.op_name = op_name;
+    if (level == LogLevel::off) return;
+
+    // %p, %r and %h give every process of a job its own file
+    if (const char* pattern = env_cstr("ACCELPROF_LOG_FILE")) {
+        std::string path = process_expand_path(pattern);
+        if (FILE* f = fopen(path.c_str(), "w")) {
+            static char out_buffer[1 << 20];
+            setvbuf(f, out_buffer, _IOFBF, sizeof(out_buffer));
+            s.out = f;
+        } else {
+            fprintf(stderr, "[ROCMPROF WARNING] cannot open ACCELPROF_LOG_FILE '%s', using stdout\n", path.c_str());
+        }
+    }
+
+    s.running.store(true, std::memory_order_release);
+    if (level >= LogLevel::api) s.writer = std::thread(writer_loop);
+    log_level = static_cast<int>(level);
+}
+
+void log_shutdown()
+{
+    auto& s = state();
+    if (!s.running.exchange(false)) return;
+    log_level = static_cast<int>(LogLevel::off);
+
+    s.cv.notify_all();
+    if (s.writer.joinable()) s.writer.join();
+    for (auto* ring : snapshot_rings()) drain(ring, s.out);
+
+    write_summaries();
+    fflush(s.out);
+    if (s.out != stdout) {
+        fclose(s.out);
+        s.out = stdout;
+    }
+}
+
+void log_add_summary(log_summary_fn fn)
+{
+    auto& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.summaries.push_back(fn);
+}
+
+void log_count(uint32_t operation)
+{
+    if (operation >= kMaxLogOps) return;
+    auto& counter = thread_ring()->op_counts[operation];
+    // only the owning thread writes its counters
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void log_record(uint64_t correlation_id, const char* fmt, const uint64_t* args, uint32_t num_args)
+{
+    LogRing* ring = thread_ring();
+    if (ring->slots == nullptr) return;
+    uint64_t seq = reserve(ring, 1);
+    if (seq == UINT64_MAX) return;
+
+    LogSlot& slot = ring->slots[seq % kRingSlots];
+    slot.fmt = fmt;
+    slot.correlation_id = correlation_id;
+    for (uint32_t i = 0; i < kMaxLogArgs; i++) slot.args[i] = i < num_args ? args[i] : 0;
+    ring->head.store(seq + 1, std::memory_order_release);
+}
+
+void log_text(uint64_t correlation_id, const char* text, size_t len)
+{
+    len = std::min<size_t>(len, kMaxTextSlots * sizeof(LogSlot));
+    uint32_t n = 1 + static_cast<uint32_t>((len + sizeof(LogSlot) - 1) / sizeof(LogSlot));
+
+    LogRing* ring = thread_ring();
+    if (ring->slots == nullptr) return;
+    uint64_t seq = reserve(ring, n);
+    if (seq == UINT64_MAX) return;
+
+    LogSlot& header = ring->slots[seq % kRingSlots];
+    header.fmt = nullptr;
+    header.correlation_id = correlation_id;
+    header.args[0] = len;
+    for (uint32_t i = 1; i < n; i++) {
+        size_t off = (i - 1) * sizeof(LogSlot);
+        size_t chunk = std::min(len - off, sizeof(LogSlot));
+        memcpy(&ring->slots[(seq + i) % kRingSlots], text + off, chunk);
+    }
+    ring->head.store(seq + n, std::memory_order_release);
+}
+
+} // namespace rocm_accelprof
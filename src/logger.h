@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <type_traits>
+
+// Leveled asynchronous logger.
+//
+// ACCELPROF_LOG_LEVEL selects what is logged:
+//   off     - nothing (the default, or summary with ACCELPROF_AGGREGATE set)
+//   summary - per-operation call counts and the report sections, written at shutdown
+//   api     - one line per handled HIP API call
+//   full    - every traced call with all of its arguments stringified
+// ACCELPROF_LOG_FILE redirects the output (default stdout); %p, %r and %h in it expand to
+// the pid, rank and host (process.h).
+//
+// Producers never format or do I/O: they copy a format pointer and up to six integer
+// arguments into a per-thread ring, and a background thread formats and writes them.
+// When the ring is full the record is dropped and counted. At the summary level a thread
+// only keeps its call counters, the ring is not allocated; off skips the counters too.
+
+namespace rocm_accelprof {
+
+enum class LogLevel : int {
+    off = 0,
+    summary = 1,
+    api = 2,
+    full = 3,
+};
+
+constexpr uint32_t kMaxLogArgs = 6;
+constexpr uint32_t kMaxLogOps = 1024;
+
+// Set once by log_init before tracing starts, read-only afterwards.
+extern int log_level;
+
+inline bool log_enabled(LogLevel level) { return log_level >= static_cast<int>(level); }
+
+using log_op_name_fn = const char* (*)(uint32_t operation);
+using log_summary_fn = void (*)(FILE* out);
+
+void log_init(log_op_name_fn op_name);
+void log_shutdown();
+
+// Register a report section written after the call counts at summary level and above.
+void log_add_summary(log_summary_fn fn);
+
+// per-thread call counter for the summary
+void log_count(uint32_t operation);
+
+// Format strings may only use 64-bit conversions (%lu, %ld, %lx); every argument is
+// widened to 64 bits before it is stored.
+void log_record(uint64_t correlation_id, const char* fmt, const uint64_t* args, uint32_t num_args);
+
+// Preformatted text, copied into the ring (used by the full level).
+void log_text(uint64_t correlation_id, const char* text, size_t len);
+
+template <typename T>
+inline uint64_t log_arg(T value)
+{
+    if constexpr (std::is_pointer<T>::value) {
+        return reinterpret_cast<uintptr_t>(value);
+    } else if constexpr (std::is_enum<T>::value) {
+        return static_cast<uint64_t>(static_cast<typename std::underlying_type<T>::type>(value));
+    } else if constexpr (std::is_signed<T>::value) {
+        return static_cast<uint64_t>(static_cast<int64_t>(value));
+    } else {
+        return static_cast<uint64_t>(value);
+    }
+}
+
+template <typename... Args>
+inline void log_api(uint64_t correlation_id, const char* fmt, Args... args)
+{
+    static_assert(sizeof...(Args) <= kMaxLogArgs, "too many log arguments");
+    uint64_t values[kMaxLogArgs + 1] = {log_arg(args)...};
+    log_record(correlation_id, fmt, values, sizeof...(Args));
+}
+
+} // namespace rocm_accelprof
+
+#define LOG_API(cid, fmt, ...)                                                     \
+    do {                                                                           \
+        if (rocm_accelprof::log_enabled(rocm_accelprof::LogLevel::api))            \
+            rocm_accelprof::log_api((cid), fmt, ##__VA_ARGS__);                    \
+    } while (0)
@@ -0,0 +1,66 @@
+#include "op_selection.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "env.h"
+
+namespace rocm_accelprof {
+
+namespace {
+
+void add_entry(OpSelection& selection, const std::string& entry, uint32_t active_groups)
+{
+    uint32_t dependencies = kOpState | (active_groups & kOpSyncOrGraph);
+    if (entry.empty()) return;
+    if (entry == "full" || entry == "all") selection.all = true;
+    else if (entry == "handled") selection.groups |= kOpMemory | kOpLaunch | dependencies;
+    else if (entry == "memory") selection.groups |= kOpMemory | dependencies;
+    else if (entry == "launches") selection.groups |= kOpLaunch | dependencies;
+    else selection.names.push_back(entry);
+}
+
+void add_entries(OpSelection& selection, std::istream& in, uint32_t active_groups)
+{
+    std::string line;
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        for (char& c : line)
+            if (c == ',') c = ' ';
+        std::istringstream words(line);
+        std::string entry;
+        while (words >> entry) add_entry(selection, entry, active_groups);
+    }
+}
+
+} // namespace
+
+OpSelection read_op_selection(bool default_all, uint32_t active_groups)
+{
+    OpSelection selection;
+    bool configured = false;
+
+    if (const char* spec = env_cstr("ACCELPROF_OPS")) {
+        std::istringstream in(spec);
+        add_entries(selection, in, active_groups);
+        configured = true;
+    }
+    if (const char* path = env_cstr("ACCELPROF_OPS_FILE")) {
+        std::ifstream in(path);
+        if (in) {
+            add_entries(selection, in, active_groups);
+            configured = true;
+        } else {
+            fprintf(stderr, "[ROCMPROF WARNING] cannot open ACCELPROF_OPS_FILE '%s', ignoring it\n", path);
+        }
+    }
+
+    if (!configured) {
+        if (default_all) selection.all = true;
+        else add_entry(selection, "handled", active_groups);
+    }
+    return selection;
+}
+
+} // namespace rocm_accelprof
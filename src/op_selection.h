@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Which HIP runtime operations the tool subscribes to.
+//
+// ACCELPROF_OPS is a comma separated list of presets and API names:
+//   handled  - every operation with a handler that has work to do (default)
+//   memory   - allocations, frees, copies and memsets
+//   launches - kernel launches
+//   full     - every HIP runtime API (default at the full log level)
+//   hipXxx   - one more API, e.g. to count it in the summary
+// Each preset keeps the device and stream operations attribution depends on, the
+// synchronization operations while the stream timeline runs, and the graph operations
+// while graphs are tracked. Event records and stream waits order the timeline and join
+// streams to captures, so either keeps them. ACCELPROF_OPS_FILE
+// reads the same entries from a file, separated by commas or whitespace, with # comments.
+// The result is handed to rocprofiler as the operation filter, so everything else never
+// reaches our callback.
+
+namespace rocm_accelprof {
+
+enum OpGroup : uint32_t {
+    kOpMemory = 1u << 0,
+    kOpLaunch = 1u << 1,
+    kOpState = 1u << 2,   // hipSetDevice and stream lifetime
+    kOpSync = 1u << 3,    // stream, event and device synchronization
+    kOpGraph = 1u << 4,   // stream capture, graph nodes, instantiation and launch
+    kOpSyncOrGraph = kOpSync | kOpGraph,   // hipEventRecord and hipStreamWaitEvent
+};
+
+struct OpSelection {
+    bool all = false;
+    uint32_t groups = 0;
+    std::vector<std::string> names;
+};
+
+// default_all selects every operation when nothing is configured. active_groups are the
+// groups whose handlers have work to do; presets leave the others out.
+OpSelection read_op_selection(bool default_all, uint32_t active_groups);
+
+} // namespace rocm_accelprof
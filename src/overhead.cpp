@@ -0,0 +1,286 @@
+#include "overhead.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <semaphore.h>
+
+#include "env.h"
+#include "process.h"
+
+namespace rocm_accelprof {
+
+bool overhead_active = false;
+
+namespace {
+
+// Log-linear buckets: exact below 4 ticks, then four buckets per power of two.
+constexpr uint32_t kSubBits = 2;
+constexpr uint32_t kBuckets = 64 << kSubBits;
+
+inline uint32_t bucket_of(uint64_t v)
+{
+    if (v < (1u << kSubBits)) return (uint32_t)v;
+    uint32_t e = 63 - __builtin_clzll(v);
+    return ((e - kSubBits + 1) << kSubBits) | (uint32_t)((v >> (e - kSubBits)) & ((1u << kSubBits) - 1));
+}
+
+// midpoint of a bucket
+inline uint64_t bucket_value(uint32_t b)
+{
+    if (b < (1u << kSubBits)) return b;
+    uint32_t e = (b >> kSubBits) + kSubBits - 1;
+    uint64_t width = 1ull << (e - kSubBits);
+    return (1ull << e) + (b & ((1u << kSubBits) - 1)) * width + width / 2;
+}
+
+// Written by one thread at a time with plain load/store pairs, read by the report.
+struct Histogram {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> max{0};
+    std::atomic<uint64_t> buckets[kBuckets] = {};
+
+    void add(uint64_t v)
+    {
+        auto bump = [](std::atomic<uint64_t>& a, uint64_t d) {
+            a.store(a.load(std::memory_order_relaxed) + d, std::memory_order_relaxed);
+        };
+        bump(count, 1);
+        bump(sum, v);
+        bump(buckets[bucket_of(v)], 1);
+        if (v > max.load(std::memory_order_relaxed)) max.store(v, std::memory_order_relaxed);
+    }
+};
+
+struct OpOverhead {
+    Histogram phases[kNumOverheadPhases];
+};
+
+// per thread, never freed so that the report still sees threads that have exited
+struct ThreadOverhead {
+    std::atomic<OpOverhead*> ops[kMaxLogOps] = {};
+};
+
+std::mutex threads_mutex;
+std::vector<ThreadOverhead*> threads;
+thread_local ThreadOverhead* tls_overhead = nullptr;
+
+// the analysis worker (or an inline forward under the analysis lock) is the only writer
+Histogram forward_histograms[kNumEventTypes];
+
+log_op_name_fn op_name = nullptr;
+uint64_t start_ticks = 0;
+std::chrono::steady_clock::time_point start_time;
+sem_t report_sem;
+
+const char* phase_name(uint32_t phase)
+{
+    static const char* names[] = {"args", "handler", "log", "total"};
+    return names[phase];
+}
+
+const char* event_type_name(uint32_t type)
+{
+    static const char* names[] = {"?", "alloc", "free", "memcpy", "memset", "kernel_start", "kernel_end",
+                                  "kernel_buffer", "memcpy_end"};
+    return type < kNumEventTypes ? names[type] : "?";
+}
+
+ThreadOverhead* register_thread()
+{
+    auto* t = new ThreadOverhead();
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    threads.push_back(t);
+    return t;
+}
+
+// Snapshot of one or more histograms added together.
+struct Merged {
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    uint64_t buckets[kBuckets] = {};
+
+    void add(const Histogram& h)
+    {
+        count += h.count.load(std::memory_order_relaxed);
+        sum += h.sum.load(std::memory_order_relaxed);
+        max = std::max(max, h.max.load(std::memory_order_relaxed));
+        for (uint32_t b = 0; b < kBuckets; b++) buckets[b] += h.buckets[b].load(std::memory_order_relaxed);
+    }
+
+    uint64_t percentile(double p) const
+    {
+        uint64_t n = 0;
+        for (uint32_t b = 0; b < kBuckets; b++) n += buckets[b];
+        uint64_t target = std::max<uint64_t>(1, (uint64_t)(p * (double)n + 0.5));
+        uint64_t seen = 0;
+        for (uint32_t b = 0; b < kBuckets; b++) {
+            seen += buckets[b];
+            if (seen >= target) return std::min(bucket_value(b), max);
+        }
+        return max;
+    }
+};
+
+void write_report(FILE* out)
+{
+    double wall_ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - start_time).count();
+    uint64_t elapsed_ticks = overhead_ticks() - start_ticks;
+    double ns_per_tick = elapsed_ticks ? wall_ns / (double)elapsed_ticks : 1.0;
+    auto ns = [ns_per_tick](uint64_t ticks) { return (unsigned long)((double)ticks * ns_per_tick); };
+
+    std::vector<ThreadOverhead*> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        snapshot = threads;
+    }
+    std::vector<Merged> ops(kMaxLogOps * kNumOverheadPhases);
+    for (auto* t : snapshot) {
+        for (uint32_t op = 0; op < kMaxLogOps; op++) {
+            OpOverhead* o = t->ops[op].load(std::memory_order_acquire);
+            if (o == nullptr) continue;
+            for (uint32_t p = 0; p < kNumOverheadPhases; p++) ops[op * kNumOverheadPhases + p].add(o->phases[p]);
+        }
+    }
+
+    constexpr uint32_t kTotal = (uint32_t)OverheadPhase::total;
+    std::vector<std::pair<uint64_t, uint32_t>> order;
+    uint64_t calls = 0, total = 0;
+    for (uint32_t op = 0; op < kMaxLogOps; op++) {
+        const Merged& m = ops[op * kNumOverheadPhases + kTotal];
+        if (m.count == 0) continue;
+        calls += m.count;
+        total += m.sum;
+        order.emplace_back(m.sum, op);
+    }
+    std::sort(order.begin(), order.end(), std::greater<>());
+
+    fprintf(out, "[ROCMPROF SUMMARY] tool overhead: %.3f ms in %lu callbacks on %zu threads over %.3f s wall "
+                 "(%.3f%% of it, summed over threads)\n",
+            (double)ns(total) / 1e6, (unsigned long)calls, snapshot.size(), wall_ns / 1e9,
+            wall_ns > 0 ? 100.0 * (double)ns(total) / wall_ns : 0.0);
+    process_report(out, ReportMerge::sum, (double)ns(total), "overhead.callback_ns");
+    process_report(out, ReportMerge::sum, (double)calls, "overhead.callbacks");
+    process_report_mean(out, (double)ns(total) / wall_ns, wall_ns, "overhead.share_of_wall");
+    for (const auto& entry : order) {
+        uint32_t op = entry.second;
+        const char* name = op_name ? op_name(op) : nullptr;
+        if (name == nullptr) name = "?";
+        const Merged& t = ops[op * kNumOverheadPhases + kTotal];
+        fprintf(out, "[ROCMPROF SUMMARY]   %-32s %10lu calls %10.3f ms  p50/p99/max %lu/%lu/%lu ns", name,
+                (unsigned long)t.count, (double)ns(t.sum) / 1e6, ns(t.percentile(0.50)), ns(t.percentile(0.99)),
+                ns(t.max));
+        for (uint32_t p = 0; p < kTotal; p++) {
+            const Merged& m = ops[op * kNumOverheadPhases + p];
+            if (m.count == 0) continue;
+            fprintf(out, "  %s %lu/%lu", phase_name(p), ns(m.percentile(0.50)), ns(m.percentile(0.99)));
+        }
+        fprintf(out, "\n");
+        // percentiles of different ranks do not combine: the job gets the worst rank's
+        process_report(out, ReportMerge::sum, (double)t.count, "overhead.%s.calls", name);
+        process_report(out, ReportMerge::sum, (double)ns(t.sum), "overhead.%s.total_ns", name);
+        process_report(out, ReportMerge::max, (double)ns(t.percentile(0.99)), "overhead.%s.p99_ns", name);
+        process_report(out, ReportMerge::max, (double)ns(t.max), "overhead.%s.max_ns", name);
+    }
+
+    uint64_t forward_total = 0;
+    for (uint32_t type = 1; type < kNumEventTypes; type++)
+        forward_total += forward_histograms[type].sum.load(std::memory_order_relaxed);
+    if (forward_total == 0) return;
+    fprintf(out, "[ROCMPROF SUMMARY] sanalyzer callbacks: %.3f ms (%.3f%% of wall)\n", (double)ns(forward_total) / 1e6,
+            wall_ns > 0 ? 100.0 * (double)ns(forward_total) / wall_ns : 0.0);
+    process_report(out, ReportMerge::sum, (double)ns(forward_total), "sanalyzer.callback_ns");
+    for (uint32_t type = 1; type < kNumEventTypes; type++) {
+        Merged m;
+        m.add(forward_histograms[type]);
+        if (m.count == 0) continue;
+        fprintf(out, "[ROCMPROF SUMMARY]   %-32s %10lu calls %10.3f ms  p50/p99/max %lu/%lu/%lu ns\n",
+                event_type_name(type), (unsigned long)m.count, (double)ns(m.sum) / 1e6, ns(m.percentile(0.50)),
+                ns(m.percentile(0.99)), ns(m.max));
+        process_report(out, ReportMerge::sum, (double)m.count, "sanalyzer.%s.calls", event_type_name(type));
+        process_report(out, ReportMerge::sum, (double)ns(m.sum), "sanalyzer.%s.total_ns", event_type_name(type));
+        process_report(out, ReportMerge::max, (double)ns(m.percentile(0.99)), "sanalyzer.%s.p99_ns",
+                       event_type_name(type));
+        process_report(out, ReportMerge::max, (double)ns(m.max), "sanalyzer.%s.max_ns", event_type_name(type));
+    }
+}
+
+void on_report_signal(int)
+{
+    sem_post(&report_sem);  // async-signal-safe, the reporter thread does the writing
+}
+
+void reporter_loop()
+{
+    while (true) {
+        if (sem_wait(&report_sem) != 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        write_report(stderr);
+        fflush(stderr);
+    }
+}
+
+void install_signal(int signo)
+{
+    struct sigaction old{};
+    if (sigaction(signo, nullptr, &old) == 0 && old.sa_handler != SIG_DFL && old.sa_handler != SIG_IGN) {
+        fprintf(stderr, "[ROCMPROF WARNING] signal %d already has a handler, overhead report only at exit\n", signo);
+        return;
+    }
+    if (sem_init(&report_sem, 0, 0) != 0) return;
+    std::thread(reporter_loop).detach();
+
+    struct sigaction action{};
+    action.sa_handler = on_report_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(signo, &action, nullptr);
+}
+
+} // namespace
+
+void overhead_init(log_op_name_fn name_fn)
+{
+    if (!env_bool("ACCELPROF_OVERHEAD", false)) return;
+    op_name = name_fn;
+    start_time = std::chrono::steady_clock::now();
+    start_ticks = overhead_ticks();
+    overhead_active = true;
+    log_add_summary(write_report);
+
+    int signo = (int)env_u64("ACCELPROF_OVERHEAD_SIGNAL", SIGUSR2);
+    if (signo > 0 && signo < NSIG) install_signal(signo);
+}
+
+void overhead_record(uint32_t operation, const uint64_t* ticks, uint32_t mask)
+{
+    if (operation >= kMaxLogOps) return;
+    ThreadOverhead* t = tls_overhead;
+    if (t == nullptr) t = tls_overhead = register_thread();
+    OpOverhead* o = t->ops[operation].load(std::memory_order_relaxed);
+    if (o == nullptr) {
+        o = new OpOverhead();
+        t->ops[operation].store(o, std::memory_order_release);
+    }
+    for (uint32_t p = 0; p < kNumOverheadPhases; p++)
+        if (mask & (1u << p)) o->phases[p].add(ticks[p]);
+}
+
+void overhead_record_forward(EventType type, uint64_t ticks)
+{
+    if ((uint32_t)type < kNumEventTypes) forward_histograms[(uint32_t)type].add(ticks);
+}
+
+} // namespace rocm_accelprof
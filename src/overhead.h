@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+
+#include "analysis_event.h"
+#include "logger.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Self-profiling of the tool's own overhead, enabled with ACCELPROF_OVERHEAD=1.
+//
+// Every HIP runtime callback is timed with the TSC (steady clock elsewhere) and split into
+// argument extraction, handling (which stages the sanalyzer events) and logging; the
+// analysis worker times the sanalyzer callbacks themselves per event type. Each thread
+// records into its own log-linear histograms, lazily allocated per operation and written
+// only by that thread, so recording is a few relaxed stores and never takes a lock.
+//
+// The report (p50/p99/max per operation and phase, total overhead against wall time) is
+// part of the shutdown summary and is written to stderr on ACCELPROF_OVERHEAD_SIGNAL
+// (default SIGUSR2, 0 disables).
+
+namespace rocm_accelprof {
+
+enum class OverheadPhase : uint8_t {
+    args = 0,   // locating and reading the callback arguments
+    handler,    // the operation handler, including staging for sanalyzer
+    log,        // call counting and the full-level argument dump
+    total,      // the whole callback
+};
+constexpr uint32_t kNumOverheadPhases = 4;
+
+extern bool overhead_active;
+
+void overhead_init(log_op_name_fn op_name);
+
+inline uint64_t overhead_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// ticks[phase] of one callback of operation; phases whose bit is clear in mask did not run.
+void overhead_record(uint32_t operation, const uint64_t* ticks, uint32_t mask);
+
+// Time the analysis worker spent in one sanalyzer callback.
+void overhead_record_forward(EventType type, uint64_t ticks);
+
+// Times one callback; phases are charged the time since the previous mark.
+class OverheadProbe {
+public:
+    explicit OverheadProbe(uint32_t operation)
+        : operation_(operation), start_(overhead_active ? overhead_ticks() : 0), last_(start_) {}
+
+    void mark(OverheadPhase phase)
+    {
+        if (start_ == 0) return;
+        uint64_t now = overhead_ticks();
+        ticks_[(int)phase] += now - last_;
+        mask_ |= 1u << (int)phase;
+        last_ = now;
+    }
+
+    ~OverheadProbe()
+    {
+        if (start_ == 0) return;
+        ticks_[(int)OverheadPhase::total] = overhead_ticks() - start_;
+        overhead_record(operation_, ticks_, mask_ | 1u << (int)OverheadPhase::total);
+    }
+
+    OverheadProbe(const OverheadProbe&) = delete;
+    OverheadProbe& operator=(const OverheadProbe&) = delete;
+
+private:
+    uint32_t operation_;
+    uint32_t mask_ = 0;
+    uint64_t start_;
+    uint64_t last_;
+    uint64_t ticks_[kNumOverheadPhases] = {};
+};
+
+} // namespace rocm_accelprof
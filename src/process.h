@@ -0,0 +1,198 @@
+#pragma once
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "env.h"
+
+// Process identity, fork handling and the hand-off of reports to the job aggregator.
+//
+// Header-only like env.h, shared by the HIP backend and the torch backend.
+//
+// The rank comes from the launcher's environment: RANK (torchrun), OMPI_COMM_WORLD_RANK,
+// PMI_RANK or SLURM_PROCID, and is -1 outside a multi-rank job. Output paths
+// (ACCELPROF_LOG_FILE, ACCELPROF_TRACE_DIR, ACCELPROF_TORCH_TRACE) expand %p to the pid,
+// %r to the rank and %h to the host name, so every process of a job gets its own sinks.
+//
+// A forked child inherits the tool's state but not its threads, and HIP is not usable
+// after fork. Each module registers pthread_atfork handlers that take its locks around
+// the fork and, in the child, drop the staging buffers it inherited; the child then stays
+// detached and reports nothing, so the parent's records and statistics are never written
+// twice.
+//
+// With ACCELPROF_AGGREGATE=<socket>, the end-of-run summary of every process is also
+// streamed to tools/accelprof-aggregate listening on that Unix socket, which merges the
+// summaries of all ranks into one job report. What is merged are structured records, not
+// the text: next to its [ROCMPROF SUMMARY] lines, a summary section reports each value
+// worth merging with process_report / process_report_mean under a key that names it,
+// identity included ("device.0.launches"), and the way the ranks' values combine:
+//   sum   counts and totals
+//   max   maxima, peaks and percentiles: the job value is the worst rank's
+//   min   minima
+//   mean  weighted, sum(value * weight) / sum(weight): means (weighted by the count they
+//         are taken over) and ratios (by their denominator)
+// The records travel in the summary stream as [ROCMPROF RECORD] lines, only while an
+// aggregator is configured; process_split_report takes them out again before the text is
+// displayed. The text is never parsed.
+
+namespace rocm_accelprof {
+
+inline std::atomic<bool> process_forked{false};
+
+// Registers the fork-child marker once per library; call before the modules register
+// their own handlers.
+inline void process_init()
+{
+    static std::atomic<bool> registered{false};
+    if (registered.exchange(true)) return;
+    pthread_atfork(nullptr, nullptr, [] { process_forked.store(true, std::memory_order_relaxed); });
+}
+
+inline bool process_is_fork_child() { return process_forked.load(std::memory_order_relaxed); }
+
+inline int process_rank()
+{
+    static const int rank = [] {
+        for (const char* name : {"RANK", "OMPI_COMM_WORLD_RANK", "PMI_RANK", "SLURM_PROCID"})
+            if (const char* value = env_cstr(name)) return atoi(value);
+        return -1;
+    }();
+    return rank;
+}
+
+inline std::string process_expand_path(const std::string& pattern)
+{
+    std::string path;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        if (pattern[i] != '%' || i + 1 == pattern.size()) {
+            path += pattern[i];
+            continue;
+        }
+        char c = pattern[++i];
+        if (c == 'p') {
+            path += std::to_string(getpid());
+        } else if (c == 'r') {
+            path += std::to_string(process_rank());
+        } else if (c == 'h') {
+            char host[256] = {};
+            gethostname(host, sizeof(host) - 1);
+            path += host;
+        } else {
+            path += '%';
+            path += c;
+        }
+    }
+    return path;
+}
+
+enum class ReportMerge : uint8_t { sum, max, min, mean };
+
+constexpr char kReportRecordPrefix[] = "[ROCMPROF RECORD] ";
+
+inline bool process_aggregating() { return env_cstr("ACCELPROF_AGGREGATE") != nullptr; }
+
+inline void process_report_record(FILE* out, ReportMerge merge, double value, double weight, const char* key_fmt,
+                                  va_list args)
+{
+    static const char* const kMergeNames[] = {"sum", "max", "min", "mean"};
+    char key[1024];
+    vsnprintf(key, sizeof(key), key_fmt, args);
+    // a record is one line, whatever a kernel or range name holds
+    for (char* c = key; *c != '\0'; c++)
+        if (*c == '\n' || *c == '\r') *c = ' ';
+    fprintf(out, "%s%s %.17g %.17g %s\n", kReportRecordPrefix, kMergeNames[(int)merge], value, weight, key);
+}
+
+// Reports one value of a summary section to the aggregator; the key is printf-formatted.
+__attribute__((format(printf, 4, 5))) inline void process_report(FILE* out, ReportMerge merge, double value,
+                                                                 const char* key_fmt, ...)
+{
+    if (!process_aggregating()) return;
+    va_list args;
+    va_start(args, key_fmt);
+    process_report_record(out, merge, value, 1, key_fmt, args);
+    va_end(args);
+}
+
+// A mean or ratio, merged over the job weighted by weight.
+__attribute__((format(printf, 4, 5))) inline void process_report_mean(FILE* out, double value, double weight,
+                                                                      const char* key_fmt, ...)
+{
+    if (!process_aggregating() || weight <= 0) return;
+    va_list args;
+    va_start(args, key_fmt);
+    process_report_record(out, ReportMerge::mean, value, weight, key_fmt, args);
+    va_end(args);
+}
+
+// Separates a summary written with records into the text to display and the records,
+// without their prefix, for process_send_report.
+inline void process_split_report(const char* text, size_t len, std::string& display, std::string& records)
+{
+    constexpr size_t kPrefixLen = sizeof(kReportRecordPrefix) - 1;
+    const char* end = text + len;
+    while (text < end) {
+        const char* eol = static_cast<const char*>(memchr(text, '\n', (size_t)(end - text)));
+        const char* next = eol ? eol + 1 : end;
+        if ((size_t)(next - text) > kPrefixLen && memcmp(text, kReportRecordPrefix, kPrefixLen) == 0)
+            records.append(text + kPrefixLen, next);
+        else
+            display.append(text, next);
+        text = next;
+    }
+}
+
+// Sends one report to the aggregator: a header line naming the backend it comes from
+// ("hip", "torch") and the process, then the records, one per line:
+//   <sum|max|min|mean> <value> <weight> <key>
+// Gives up with a warning on a missing aggregator and after 5 s on a stuck one, the
+// process is exiting. Returns false when nothing was sent.
+inline bool process_send_report(const char* source, const char* records, size_t len)
+{
+    const char* path = env_cstr("ACCELPROF_AGGREGATE");
+    if (path == nullptr || process_is_fork_child()) return false;
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) return false;
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    timeval timeout{5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        fprintf(stderr, "[ROCMPROF WARNING] no aggregator at ACCELPROF_AGGREGATE '%s', summary kept local\n", path);
+        close(fd);
+        return false;
+    }
+
+    char host[256] = {};
+    gethostname(host, sizeof(host) - 1);
+    char header[512];
+    int n = snprintf(header, sizeof(header), "ACCELPROF-REPORT 2 source=%s rank=%d pid=%d host=%s\n", source,
+                     process_rank(), (int)getpid(), host);
+    bool ok = send(fd, header, (size_t)n, MSG_NOSIGNAL) == n;
+    while (ok && len > 0) {
+        ssize_t sent = send(fd, records, len, MSG_NOSIGNAL);
+        ok = sent > 0;
+        if (ok) {
+            records += sent;
+            len -= (size_t)sent;
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+} // namespace rocm_accelprof
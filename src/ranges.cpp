@@ -0,0 +1,352 @@
+#include "ranges.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fnmatch.h>
+
+#include "device_state.h"
+#include "env.h"
+#include "logger.h"
+#include "process.h"
+
+namespace rocm_accelprof {
+
+bool range_filter_active = false;
+thread_local RangeCounters* tls_range_counters = nullptr;
+thread_local uint32_t tls_selected_ranges = 0;
+std::atomic<uint32_t> selected_process_ranges{0};
+
+namespace {
+
+constexpr size_t kMaxRangeNames = 1u << 14;
+constexpr size_t kMaxCachedNames = 1024;   // per thread
+
+struct RangePattern {
+    std::string glob;
+    uint64_t first = 0;
+    uint64_t last = UINT64_MAX;
+};
+
+struct SharedCounters {
+    std::atomic<uint64_t> allocs{0};
+    std::atomic<uint64_t> alloc_bytes{0};
+    std::atomic<uint64_t> copies{0};
+    std::atomic<uint64_t> copy_bytes{0};
+    std::atomic<uint64_t> memsets{0};
+    std::atomic<uint64_t> memset_bytes{0};
+    std::atomic<uint64_t> launches{0};
+};
+
+// Everything known about one range name (or mark message). name and pattern_mask are
+// set before the name is published and never change.
+struct RangeName {
+    std::string name;
+    uint64_t pattern_mask = 0;      // patterns whose glob matches the name
+    std::atomic<uint64_t> occurrences{0};
+    std::atomic<uint64_t> selected{0};
+    std::atomic<uint64_t> marks{0};
+    std::atomic<uint64_t> total_ns{0};
+    SharedCounters totals;
+};
+
+struct Frame {
+    RangeName* name;
+    bool selected;
+    uint64_t start_ns;
+    RangeCounters counters;
+};
+
+struct ProcessRange {
+    RangeName* name;
+    bool selected;
+    uint64_t start_ns;
+    RangeCounters start;
+};
+
+std::mutex mutex;   // guards the tables below
+std::vector<RangePattern> patterns;                  // read-only after ranges_init
+std::unordered_map<std::string, RangeName*> names;   // never freed, frames point into it
+std::unordered_map<uint64_t, RangeName*> folded;     // names past the cap, by pattern mask
+uint64_t folded_names = 0;
+std::unordered_map<uint64_t, ProcessRange> process_ranges;
+
+thread_local std::vector<Frame> tls_frames;
+thread_local std::unordered_map<const char*, RangeName*> tls_names;   // by message pointer
+
+uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void add(SharedCounters& into, const RangeCounters& c)
+{
+    into.allocs.fetch_add(c.allocs, std::memory_order_relaxed);
+    into.alloc_bytes.fetch_add(c.alloc_bytes, std::memory_order_relaxed);
+    into.copies.fetch_add(c.copies, std::memory_order_relaxed);
+    into.copy_bytes.fetch_add(c.copy_bytes, std::memory_order_relaxed);
+    into.memsets.fetch_add(c.memsets, std::memory_order_relaxed);
+    into.memset_bytes.fetch_add(c.memset_bytes, std::memory_order_relaxed);
+    into.launches.fetch_add(c.launches, std::memory_order_relaxed);
+}
+
+void add(RangeCounters& into, const RangeCounters& c)
+{
+    into.allocs += c.allocs;
+    into.alloc_bytes += c.alloc_bytes;
+    into.copies += c.copies;
+    into.copy_bytes += c.copy_bytes;
+    into.memsets += c.memsets;
+    into.memset_bytes += c.memset_bytes;
+    into.launches += c.launches;
+}
+
+// What all devices have done so far, for process-wide ranges.
+RangeCounters device_totals()
+{
+    RangeCounters c;
+    for (int d = 0; d < kMaxDevices; d++) {
+        auto& s = device_shard(d);
+        c.allocs += s.allocs.load(std::memory_order_relaxed);
+        c.alloc_bytes += s.alloc_bytes.load(std::memory_order_relaxed);
+        c.copies += s.memcpys.load(std::memory_order_relaxed);
+        c.copy_bytes += s.memcpy_bytes.load(std::memory_order_relaxed);
+        c.memsets += s.memsets.load(std::memory_order_relaxed);
+        c.memset_bytes += s.memset_bytes.load(std::memory_order_relaxed);
+        c.launches += s.launches.load(std::memory_order_relaxed);
+    }
+    return c;
+}
+
+RangeName* name_locked(const char* message)
+{
+    std::string key = message;
+    auto it = names.find(key);
+    if (it != names.end()) return it->second;
+    uint64_t mask = 0;
+    for (size_t p = 0; p < patterns.size(); p++)
+        if (fnmatch(patterns[p].glob.c_str(), key.c_str(), 0) == 0) mask |= 1ull << p;
+
+    if (names.size() >= kMaxRangeNames) {
+        folded_names++;
+        RangeName*& n = folded[mask];
+        if (n == nullptr) {
+            n = new RangeName();
+            n->name = "<other>";
+            const char* separator = " matching ";
+            for (size_t p = 0; p < patterns.size(); p++) {
+                if (!(mask >> p & 1)) continue;
+                n->name += separator + patterns[p].glob;
+                separator = "|";
+            }
+            n->pattern_mask = mask;
+        }
+        return n;
+    }
+    auto* n = new RangeName();
+    n->name = key;
+    n->pattern_mask = mask;
+    names.emplace(key, n);
+    return n;
+}
+
+// The thread remembers where it saw a message; a buffer that now holds other text misses.
+RangeName* lookup_name(const char* message)
+{
+    if (message == nullptr) message = "";
+    auto it = tls_names.find(message);
+    if (it != tls_names.end() && it->second->name == message) return it->second;
+    RangeName* n;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        n = name_locked(message);
+    }
+    // folded names never match their text and always take the lock
+    if (n->name == message) {
+        if (tls_names.size() >= kMaxCachedNames) tls_names.clear();
+        tls_names[message] = n;
+    }
+    return n;
+}
+
+// Counts an occurrence of the name and decides whether it selects analysis.
+bool begin(RangeName* n)
+{
+    uint64_t occurrence = n->occurrences.fetch_add(1, std::memory_order_relaxed);
+    bool selected = false;
+    for (size_t p = 0; p < patterns.size() && !selected; p++)
+        selected = (n->pattern_mask >> p & 1) && occurrence >= patterns[p].first && occurrence <= patterns[p].last;
+    if (selected) n->selected.fetch_add(1, std::memory_order_relaxed);
+    return selected;
+}
+
+void end(RangeName* n, const RangeCounters& c, uint64_t ns)
+{
+    add(n->totals, c);
+    n->total_ns.fetch_add(ns, std::memory_order_relaxed);
+}
+
+void parse_patterns(const std::string& spec)
+{
+    std::string list = spec;
+    std::replace(list.begin(), list.end(), ',', ' ');
+    std::istringstream words(list);
+    std::string word;
+    while (words >> word) {
+        if (patterns.size() == 64) {
+            fprintf(stderr, "[ROCMPROF WARNING] ACCELPROF_RANGES: only the first 64 patterns are used\n");
+            break;
+        }
+        RangePattern p;
+        size_t at = word.rfind('@');
+        p.glob = word.substr(0, at);
+        if (at != std::string::npos) {
+            const char* bounds = word.c_str() + at + 1;
+            char* end = nullptr;
+            p.first = strtoull(bounds, &end, 10);
+            p.last = (*end == '-') ? strtoull(end + 1, nullptr, 10) : p.first;
+        }
+        patterns.push_back(p);
+    }
+}
+
+void write_report(FILE* out)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<const RangeName*> sorted;
+    for (const auto& entry : names) sorted.push_back(entry.second);
+    for (const auto& entry : folded) sorted.push_back(entry.second);
+    if (sorted.empty()) return;
+    auto total_ns = [](const RangeName* n) { return n->total_ns.load(std::memory_order_relaxed); };
+    std::sort(sorted.begin(), sorted.end(),
+              [&](const RangeName* a, const RangeName* b) { return total_ns(a) > total_ns(b); });
+
+    fprintf(out, "[ROCMPROF SUMMARY] roctx ranges: %zu names, %lu more past the cap of %zu%s\n", names.size(),
+            (unsigned long)folded_names, kMaxRangeNames,
+            range_filter_active ? ", analysis restricted to ACCELPROF_RANGES" : "");
+    for (const RangeName* n : sorted) {
+        uint64_t occurrences = n->occurrences.load(std::memory_order_relaxed);
+        if (occurrences == 0) {
+            fprintf(out, "[ROCMPROF SUMMARY]   mark '%s': %lu\n", n->name.c_str(),
+                    (unsigned long)n->marks.load(std::memory_order_relaxed));
+            process_report(out, ReportMerge::sum, (double)n->marks.load(std::memory_order_relaxed),
+                           "range.%s.marks", n->name.c_str());
+            continue;
+        }
+        const SharedCounters& c = n->totals;
+        fprintf(out, "[ROCMPROF SUMMARY]   '%s': %lu times (%lu selected), %.3f ms, %lu launches, %lu allocs "
+                     "(%lu bytes), %lu copies (%lu bytes), %lu memsets (%lu bytes)\n",
+                n->name.c_str(), (unsigned long)occurrences,
+                (unsigned long)n->selected.load(std::memory_order_relaxed), (double)total_ns(n) / 1e6,
+                (unsigned long)c.launches.load(std::memory_order_relaxed),
+                (unsigned long)c.allocs.load(std::memory_order_relaxed),
+                (unsigned long)c.alloc_bytes.load(std::memory_order_relaxed),
+                (unsigned long)c.copies.load(std::memory_order_relaxed),
+                (unsigned long)c.copy_bytes.load(std::memory_order_relaxed),
+                (unsigned long)c.memsets.load(std::memory_order_relaxed),
+                (unsigned long)c.memset_bytes.load(std::memory_order_relaxed));
+        const char* name = n->name.c_str();
+        process_report(out, ReportMerge::sum, (double)occurrences, "range.%s.occurrences", name);
+        process_report(out, ReportMerge::sum, (double)n->selected.load(std::memory_order_relaxed),
+                       "range.%s.selected", name);
+        process_report(out, ReportMerge::sum, (double)total_ns(n), "range.%s.total_ns", name);
+        process_report(out, ReportMerge::sum, (double)c.launches.load(std::memory_order_relaxed),
+                       "range.%s.launches", name);
+        process_report(out, ReportMerge::sum, (double)c.allocs.load(std::memory_order_relaxed),
+                       "range.%s.allocs", name);
+        process_report(out, ReportMerge::sum, (double)c.alloc_bytes.load(std::memory_order_relaxed),
+                       "range.%s.alloc_bytes", name);
+        process_report(out, ReportMerge::sum, (double)c.copies.load(std::memory_order_relaxed),
+                       "range.%s.copies", name);
+        process_report(out, ReportMerge::sum, (double)c.copy_bytes.load(std::memory_order_relaxed),
+                       "range.%s.copy_bytes", name);
+        process_report(out, ReportMerge::sum, (double)c.memsets.load(std::memory_order_relaxed),
+                       "range.%s.memsets", name);
+        process_report(out, ReportMerge::sum, (double)c.memset_bytes.load(std::memory_order_relaxed),
+                       "range.%s.memset_bytes", name);
+    }
+}
+
+} // namespace
+
+void ranges_init()
+{
+    if (const char* spec = env_cstr("ACCELPROF_RANGES")) {
+        parse_patterns(spec);
+        range_filter_active = !patterns.empty();
+    }
+    if (range_filter_active) fprintf(stdout, "[ROCMPROF INFO] analysis restricted to %zu roctx range patterns\n",
+                                     patterns.size());
+    log_add_summary(write_report);
+}
+
+void range_push(const char* message)
+{
+    Frame frame{};
+    frame.name = lookup_name(message);
+    frame.selected = begin(frame.name);
+    frame.start_ns = now_ns();
+    if (frame.selected) tls_selected_ranges++;
+    tls_frames.push_back(frame);
+    tls_range_counters = &tls_frames.back().counters;
+}
+
+void range_pop()
+{
+    if (tls_frames.empty()) return;  // pushed before we attached
+    Frame frame = tls_frames.back();
+    tls_frames.pop_back();
+    if (frame.selected) tls_selected_ranges--;
+    tls_range_counters = tls_frames.empty() ? nullptr : &tls_frames.back().counters;
+    if (tls_range_counters) add(*tls_range_counters, frame.counters);
+    end(frame.name, frame.counters, now_ns() - frame.start_ns);
+}
+
+void range_mark(const char* message)
+{
+    lookup_name(message)->marks.fetch_add(1, std::memory_order_relaxed);
+}
+
+void range_start(uint64_t id, const char* message)
+{
+    ProcessRange range{};
+    range.start = device_totals();
+    range.start_ns = now_ns();
+    range.name = lookup_name(message);
+    range.selected = begin(range.name);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (range.selected) selected_process_ranges.fetch_add(1, std::memory_order_relaxed);
+    process_ranges[id] = range;
+}
+
+void range_stop(uint64_t id)
+{
+    RangeCounters now = device_totals();
+    uint64_t end_ns = now_ns();
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = process_ranges.find(id);
+    if (it == process_ranges.end()) return;
+    const ProcessRange& range = it->second;
+    if (range.selected) selected_process_ranges.fetch_sub(1, std::memory_order_relaxed);
+
+    RangeCounters delta;
+    delta.allocs = now.allocs - range.start.allocs;
+    delta.alloc_bytes = now.alloc_bytes - range.start.alloc_bytes;
+    delta.copies = now.copies - range.start.copies;
+    delta.copy_bytes = now.copy_bytes - range.start.copy_bytes;
+    delta.memsets = now.memsets - range.start.memsets;
+    delta.memset_bytes = now.memset_bytes - range.start.memset_bytes;
+    delta.launches = now.launches - range.start.launches;
+    end(range.name, delta, end_ns - range.start_ns);
+    process_ranges.erase(it);
+}
+
+} // namespace rocm_accelprof
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// ROCTx ranges: per-range aggregation and range-scoped analysis.
+//
+// roctxRangePush/Pop maintain a per-thread range stack; every frame counts the bytes
+// allocated, copied and set and the kernels launched by its thread while it is open, and
+// adds them to its parent when it is popped, so the totals per range name are inclusive.
+// roctxRangeStart/Stop ranges are process-wide and are measured from the per-device
+// totals. roctxMark is counted per message.
+//
+// ACCELPROF_RANGES=<pattern>[@first[-last]],... restricts the analysis of launches, copies
+// and memsets to the inside of matching ranges (glob patterns; first/last count the
+// occurrences of each range name from 0). Allocations and frees are always analyzed.
+//
+// Names are interned once; each thread then finds them by message pointer (checked
+// against the text) without locking, and the counters of a name are atomic. At most
+// kMaxRangeNames names are kept: later ones are counted together, one entry per set of
+// patterns they match, so they still select analysis by glob.
+
+namespace rocm_accelprof {
+
+struct RangeCounters {
+    uint64_t allocs = 0;
+    uint64_t alloc_bytes = 0;
+    uint64_t copies = 0;
+    uint64_t copy_bytes = 0;
+    uint64_t memsets = 0;
+    uint64_t memset_bytes = 0;
+    uint64_t launches = 0;
+};
+
+// Set once by ranges_init, read-only afterwards.
+extern bool range_filter_active;
+
+// Counters of the innermost open push/pop range of this thread, null outside of ranges.
+extern thread_local RangeCounters* tls_range_counters;
+// Open ranges of this thread that select analysis.
+extern thread_local uint32_t tls_selected_ranges;
+// Open process-wide ranges that select analysis.
+extern std::atomic<uint32_t> selected_process_ranges;
+
+void ranges_init();
+
+void range_push(const char* message);
+void range_pop();
+void range_mark(const char* message);
+void range_start(uint64_t id, const char* message);
+void range_stop(uint64_t id);
+
+// True when launches and memory operations of this thread should be analyzed.
+inline bool range_selected()
+{
+    return !range_filter_active || tls_selected_ranges != 0 ||
+           selected_process_ranges.load(std::memory_order_relaxed) != 0;
+}
+
+inline void range_note_alloc(uint64_t bytes)
+{
+    if (RangeCounters* c = tls_range_counters) {
+        c->allocs++;
+        c->alloc_bytes += bytes;
+    }
+}
+
+inline void range_note_copy(uint64_t bytes)
+{
+    if (RangeCounters* c = tls_range_counters) {
+        c->copies++;
+        c->copy_bytes += bytes;
+    }
+}
+
+inline void range_note_memset(uint64_t bytes)
+{
+    if (RangeCounters* c = tls_range_counters) {
+        c->memsets++;
+        c->memset_bytes += bytes;
+    }
+}
+
+inline void range_note_launch()
+{
+    if (RangeCounters* c = tls_range_counters) c->launches++;
+}
+
+} // namespace rocm_accelprof
@@ -5,6 +5,7 @@
 #include <rocprofiler-sdk/fwd.h>
 #include <hip/hip_runtime.h>
 
+#include <array>
 #include <cassert>
 #include <cstdint>
 #include <cstdio>
@@ -18,34 +19,25 @@
 #include <cxxabi.h> // for type demangling
 
 #include "sanalyzer.h"
-
-#define AMDROCM_VERBOSE 1
-
-#if AMDROCM_VERBOSE
-#define PRINT(...) do { fprintf(stdout, __VA_ARGS__); fflush(stdout); } while (0)
-#else
-#define PRINT(...)
-#endif
-
-#define ROCPROFILER_VAR_NAME_COMBINE(X, Y) X##Y
-#define ROCPROFILER_VARIABLE(X, Y)         ROCPROFILER_VAR_NAME_COMBINE(X, Y)
-#define ROCPROFILER_CALL(result, msg)                                                              \
-    {                                                                                              \
-        rocprofiler_status_t ROCPROFILER_VARIABLE(CHECKSTATUS, __LINE__) = result;                 \
-        if(ROCPROFILER_VARIABLE(CHECKSTATUS, __LINE__) != ROCPROFILER_STATUS_SUCCESS)              \
-        {                                                                                          \
-            std::string status_msg =                                                               \
-                rocprofiler_get_status_string(ROCPROFILER_VARIABLE(CHECKSTATUS, __LINE__));        \
-            std::cerr << "[" #result "][" << __FILE__ << ":" << __LINE__ << "] " << msg            \
-                      << " failed with error code " << ROCPROFILER_VARIABLE(CHECKSTATUS, __LINE__) \
-                      << ": " << status_msg << std::endl;                                          \
-            std::stringstream errmsg{};                                                            \
-            errmsg << "[" #result "][" << __FILE__ << ":" << __LINE__ << "] " << msg " failure ("  \
-                   << status_msg << ")";                                                           \
-            throw std::runtime_error(errmsg.str());                                                \
-        }                                                                                          \
-    }
-
+#include "alloc_index.h"
+#include "analysis.h"
+#include "arg_layout.h"
+#include "buffered_tracing.h"
+#include "device_state.h"
+#include "graphs.h"
+#include "kernel_args.h"
+#include "kernel_names.h"
+#include "logger.h"
+#include "op_selection.h"
+#include "overhead.h"
+#include "process.h"
+#include "ranges.h"
+#include "rocprofiler_call.h"
+#include "sampling.h"
+#include "stream_timeline.h"
+#include "tensor_segments.h"
+#include "tool_guard.h"
+#include "trace_writer.h"
 
 namespace rocm_accelprof {
 
@@ -72,203 +64,860 @@ void tool_tracing_ctrl_callback(rocprofiler_callback_tracing_record_t record,
     }
 }
 
-void tool_tracing_callback(rocprofiler_callback_tracing_record_t record,
-                           rocprofiler_user_data_t* user_data,
-                           void* callback_data)
+// Argument layouts of the traced HIP runtime operations, resolved once in tool_init.
+OpArgLayout hip_arg_layouts[ROCPROFILER_HIP_RUNTIME_API_ID_LAST];
+
+using hip_api_data_t = rocprofiler_callback_tracing_hip_api_data_t;
+using op_handler_t = void (*)(const rocprofiler_callback_tracing_record_t&, const ArgReader&);
+
+inline hipError_t hip_retval(const rocprofiler_callback_tracing_record_t& record)
 {
-    if (record.kind != ROCPROFILER_CALLBACK_TRACING_HIP_RUNTIME_API) return;
+    return static_cast<const hip_api_data_t*>(record.payload)->retval.hipError_t_retval;
+}
 
-    if (record.operation == ROCPROFILER_HIP_RUNTIME_API_ID_hipMalloc
-            && record.phase == ROCPROFILER_CALLBACK_PHASE_ENTER) {
-        void* raw_ptr = nullptr;
-        uint64_t size = 0;
-        std::pair<void**, uint64_t*> out{&raw_ptr, &size};
-        auto cb = [](rocprofiler_callback_tracing_kind_t,
-            rocprofiler_tracing_operation_t,
-            uint32_t arg_num,
-            const void* const arg_value_addr,
-            int32_t,
-            const char* arg_type,
-            const char* arg_name,
-            const char*,
-            int32_t,
-            void* cb_data) -> int {
-            auto* pair = static_cast<std::pair<void**, uint64_t*>*>(cb_data);
-            if (std::string(arg_name) == "ptr") {
-                *pair->first = *static_cast<void* const*>(arg_value_addr);
-            } else if (std::string(arg_name) == "size") {
-                *pair->second = *static_cast<const uint64_t*>(arg_value_addr);
-            }
+// Operations of one family share the slot order of their ArgSpec arrays, so a single
+// handler serves e.g. hipMemcpy and hipMemcpyAsync.
 
-            return 0;
-        };
+// Handlers resolve the device from the stream slot of their family. Synchronous variants
+// have no such slot, the read yields the null stream and thus the thread's current device.
+inline int op_device(const ArgReader& args, uint32_t stream_slot)
+{
+    return stream_device(args.get<const void*>(stream_slot));
+}
 
-        ROCPROFILER_CALL(
-            rocprofiler_iterate_callback_tracing_kind_operation_args(record, cb, /*max_deref=*/1, &out),
-            "failed to iterate hipMalloc arguments");
-
-        PRINT("[ROCMPROF INFO] hipMalloc: ptr=%p, size=%zu\n", raw_ptr, size);
-        yosemite_alloc_callback((uint64_t)raw_ptr, size, 0, 0 /*device_id*/);
-    } else if (record.operation == ROCPROFILER_HIP_RUNTIME_API_ID_hipFree
-                && record.phase == ROCPROFILER_CALLBACK_PHASE_ENTER) {
-        void* ptr = nullptr;
-        auto cb = [](rocprofiler_callback_tracing_kind_t,
-                    rocprofiler_tracing_operation_t,
-                    uint32_t,
-                    const void* const arg_value_addr,
-                    int32_t,
-                    const char*,
-                    const char* arg_name,
-                    const char*,
-                    int32_t,
-                    void* cb_data) -> int {
-            if (std::string(arg_name) == "ptr") {
-                *static_cast<void**>(cb_data) = *static_cast<void* const*>(arg_value_addr);
-            }
-            return 0;
-        };
+enum : uint32_t { kAllocOut, kAllocSize, kAllocStream };
+constexpr ArgSpec hipMalloc_args[] = {{"ptr", sizeof(void**)}, {"size", sizeof(size_t)}};
+constexpr ArgSpec hipMallocAsync_args[] = {{"dev_ptr", sizeof(void**)}, {"size", sizeof(size_t)},
+                                           {"stream", sizeof(hipStream_t)}};
+constexpr ArgSpec hipMallocManaged_args[] = {{"dev_ptr", sizeof(void**)}, {"size", sizeof(size_t)}};
 
-        ROCPROFILER_CALL(
-            rocprofiler_iterate_callback_tracing_kind_operation_args(record, cb, 1, &ptr),
-            "failed to iterate hipFree arguments");
-
-        PRINT("[ROCMPROF INFO] hipFree: ptr=%p\n", ptr);
-        yosemite_free_callback((uint64_t)ptr, 0, 0, 0 /*device_id*/);
-    } else if (record.operation == ROCPROFILER_HIP_RUNTIME_API_ID_hipMemcpy
-                && record.phase == ROCPROFILER_CALLBACK_PHASE_ENTER) {
-        void* dst = nullptr;
-        const void* src = nullptr;
-        size_t size = 0;
-        hipMemcpyKind kind;
-        struct memcpy_args {
-            void** dst;
-            const void** src;
-            size_t* size;
-            hipMemcpyKind* kind;
-        };
-        memcpy_args out{&dst, &src, &size, &kind};
-        auto cb = [](rocprofiler_callback_tracing_kind_t,
-                    rocprofiler_tracing_operation_t,
-                    uint32_t,
-                    const void* const arg_value_addr,
-                    int32_t,
-                    const char*,
-                    const char* arg_name,
-                    const char*,
-                    int32_t,
-                    void* cb_data) -> int {
-            auto* p = static_cast<memcpy_args*>(cb_data);
-            if (std::string(arg_name) == "dst") {
-                *p->dst = *static_cast<void* const*>(arg_value_addr);
-            } else if (std::string(arg_name) == "src") {
-                *p->src = *static_cast<void* const*>(arg_value_addr);
-            } else if (std::string(arg_name) == "sizeBytes") {
-                *p->size = *static_cast<const size_t*>(arg_value_addr);
-            } else if (std::string(arg_name) == "kind") {
-                *p->kind = *static_cast<const hipMemcpyKind*>(arg_value_addr);
-            }
-            return 0;
-        };
+constexpr ArgSpec hipHostMalloc_args[] = {{"ptr", sizeof(void**)}, {"size", sizeof(size_t)}};
 
-        ROCPROFILER_CALL(
-            rocprofiler_iterate_callback_tracing_kind_operation_args(record, cb, 1, &out),
-            "failed to iterate hipMemcpy arguments");
-
-        PRINT("[ROCMPROF INFO] hipMemcpy: dst=%p, src=%p, size=%zu, kind=%d\n", dst, src, size, (int)kind);
-        yosemite_memcpy_callback((uint64_t)dst, (uint64_t)src, size, false, (uint32_t)kind, 0 /*device_id*/);
-    } else if (record.operation == ROCPROFILER_HIP_RUNTIME_API_ID_hipMemset
-                && record.phase == ROCPROFILER_CALLBACK_PHASE_ENTER) {
-        void* ptr = nullptr;
-        int value = 0;
-        size_t size = 0;
-        struct memset_args {
-            void** ptr;
-            int* value;
-            size_t* size;
-        };
-        memset_args out{&ptr, &value, &size};
+// pinned host memory is only indexed, sanalyzer tracks device memory
+void issue_alloc(uint64_t correlation_id, uint64_t ptr, uint64_t size, int device, MemoryKind kind)
+{
+    alloc_index().insert(ptr, size, device, kind);
+    LOG_API(correlation_id, "alloc: ptr=0x%lx, size=%lu, device=%ld, kind=%lu", ptr, size, device, (uint64_t)kind);
+    if (kind == MemoryKind::host) return;
 
-        auto cb = [](rocprofiler_callback_tracing_kind_t,
-                    rocprofiler_tracing_operation_t,
-                    uint32_t,
-                    const void* const arg_value_addr,
-                    int32_t,
-                    const char*,
-                    const char* arg_name,
-                    const char*,
-                    int32_t,
-                    void* cb_data) -> int {
-            auto* p = static_cast<memset_args*>(cb_data);
-            if (std::string(arg_name) == "dst") {
-                *p->ptr = *static_cast<void* const*>(arg_value_addr);
-            } else if (std::string(arg_name) == "value") {
-                *p->value = *static_cast<const int*>(arg_value_addr);
-            } else if (std::string(arg_name) == "sizeBytes") {
-                *p->size = *static_cast<const size_t*>(arg_value_addr);
+    auto& shard = device_shard(device);
+    shard.allocs.fetch_add(1, std::memory_order_relaxed);
+    shard.alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    range_note_alloc(size);
+    analysis_alloc(correlation_id, ptr, size, 0, device);
+}
+
+// allocations are reported on EXIT, once the runtime has written the pointer back; on a
+// capturing stream hipMallocAsync adds an allocation node instead
+template <MemoryKind Kind>
+void on_alloc(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    if (hip_retval(record) != hipSuccess) return;
+    void** out = args.get<void**>(kAllocOut);
+    void* ptr = out ? *out : nullptr;
+    uint64_t size = args.get<uint64_t>(kAllocSize);
+    const void* stream = args.get<const void*>(kAllocStream);
+    int device = op_device(args, kAllocStream);
+    if (ptr == nullptr) return;
+
+    if (graph_capturing(stream)) {
+        graph_capture_node(stream, GraphNode::alloc(record.operation, (uint64_t)ptr, size, device));
+        return;
+    }
+    issue_alloc(record.correlation_id.internal, (uint64_t)ptr, size, device, Kind);
+}
+
+enum : uint32_t { kFreePtr, kFreeStream };
+constexpr ArgSpec hipFree_args[] = {{"ptr", sizeof(void*)}};
+constexpr ArgSpec hipFreeAsync_args[] = {{"dev_ptr", sizeof(void*)}, {"stream", sizeof(hipStream_t)}};
+constexpr ArgSpec hipHostFree_args[] = {{"ptr", sizeof(void*)}};
+
+// the index knows size and owning device of everything allocated since we attached;
+// older pointers fall back to the stream's device with an unknown size
+void issue_free(uint64_t correlation_id, uint64_t ptr, int stream_dev)
+{
+    FreedAllocation freed = alloc_index().erase(ptr);
+    tensor_segment_freed(freed);
+    int device = freed.found ? freed.device : stream_dev;
+
+    LOG_API(correlation_id, "free: ptr=0x%lx, size=%lu, device=%ld", ptr, freed.size, device);
+    if (freed.found && freed.kind == MemoryKind::host) return;
+
+    device_shard(device).frees.fetch_add(1, std::memory_order_relaxed);
+    analysis_free(correlation_id, ptr, freed.size, device);
+}
+
+void on_free(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    void* ptr = args.get<void*>(kFreePtr);
+    if (ptr == nullptr) return;
+    const void* stream = args.get<const void*>(kFreeStream);
+    if (graph_capturing(stream)) {
+        graph_capture_node(stream, GraphNode::free(record.operation, (uint64_t)ptr));
+        return;
+    }
+    issue_free(record.correlation_id.internal, (uint64_t)ptr, op_device(args, kFreeStream));
+}
+
+// Resolves both ends of a copy against the allocation index: the bytes are attributed to
+// the allocations involved, hipMemcpyDefault becomes the concrete direction, and the copy
+// is charged to the device whose memory it writes (or reads), else to the stream's.
+struct CopyTarget {
+    hipMemcpyKind kind;
+    int device;
+    bool pageable;  // the host end was not allocated through HIP
+};
+
+CopyTarget classify_copy(const void* dst, const void* src, size_t size, hipMemcpyKind kind, int stream_dev)
+{
+    CopyTarget target{kind, stream_dev, false};
+    alloc_index().with_pair((uint64_t)dst, (uint64_t)src, [&](Allocation* d, Allocation* s) {
+        if (d != nullptr) d->bytes_written.fetch_add(size, std::memory_order_relaxed);
+        if (s != nullptr) s->bytes_read.fetch_add(size, std::memory_order_relaxed);
+
+        bool dst_on_device = d != nullptr && d->on_device();
+        bool src_on_device = s != nullptr && s->on_device();
+        if (kind == hipMemcpyDefault) {
+            // pointers we never saw allocated are pageable host memory
+            if (src_on_device) target.kind = dst_on_device ? hipMemcpyDeviceToDevice : hipMemcpyDeviceToHost;
+            else target.kind = dst_on_device ? hipMemcpyHostToDevice : hipMemcpyHostToHost;
+        }
+        if (dst_on_device) target.device = d->device;
+        else if (src_on_device) target.device = s->device;
+        target.pageable = (target.kind == hipMemcpyHostToDevice && s == nullptr) ||
+                          (target.kind == hipMemcpyDeviceToHost && d == nullptr);
+    });
+    return target;
+}
+
+TimelineOp timeline_copy_op(hipMemcpyKind kind)
+{
+    switch (kind) {
+        case hipMemcpyHostToDevice: return TimelineOp::copy_h2d;
+        case hipMemcpyDeviceToHost: return TimelineOp::copy_d2h;
+        case hipMemcpyHostToHost: return TimelineOp::copy_h2h;
+        default: return TimelineOp::copy_d2d;
+    }
+}
+
+enum : uint32_t { kMemcpyDst, kMemcpySrc, kMemcpySize, kMemcpyKind, kMemcpyStream };
+constexpr ArgSpec hipMemcpy_args[] = {{"dst", sizeof(void*)}, {"src", sizeof(const void*)},
+                                      {"sizeBytes", sizeof(size_t)}, {"kind", sizeof(hipMemcpyKind)}};
+constexpr ArgSpec hipMemcpyAsync_args[] = {{"dst", sizeof(void*)}, {"src", sizeof(const void*)},
+                                           {"sizeBytes", sizeof(size_t)}, {"kind", sizeof(hipMemcpyKind)},
+                                           {"stream", sizeof(hipStream_t)}};
+
+// Log formats of the copy paths (the logger only takes 64-bit arguments).
+constexpr const char* kMemcpyLog = "memcpy: dst=0x%lx, src=0x%lx, size=%lu, kind=%ld, async=%lu";
+constexpr const char* kMemcpy2DLog = "memcpy2D: dst=0x%lx, src=0x%lx, size=%lu, kind=%ld, async=%lu";
+constexpr const char* kGraphMemcpyLog = "graph memcpy: dst=0x%lx, src=0x%lx, size=%lu, kind=%ld, async=%lu";
+
+// A copy enqueued on stream, from a copy call or a graph launch replaying a copy node.
+void issue_copy(uint64_t correlation_id, uint32_t operation, const char* log_fmt, void* dst, const void* src,
+                size_t size, hipMemcpyKind kind_arg, const void* stream, bool async)
+{
+    int stream_dev = stream_device(stream);
+    CopyTarget target = classify_copy(dst, src, size, kind_arg, stream_dev);
+    hipMemcpyKind kind = target.kind;
+    int device = target.device;
+    timeline_copy(operation, stream, stream_dev, timeline_copy_op(kind), size, async, target.pageable);
+
+    auto& shard = device_shard(device);
+    shard.memcpys.fetch_add(1, std::memory_order_relaxed);
+    shard.memcpy_bytes.fetch_add(size, std::memory_order_relaxed);
+    range_note_copy(size);
+
+    LOG_API(correlation_id, log_fmt, dst, src, size, kind, async);
+    bool analyze = sample_operation(operation, size);
+    // staged before the copy is noted, so its end can never be forwarded ahead of it
+    if (analyze) analysis_memcpy(correlation_id, (uint64_t)dst, (uint64_t)src, size, async, (uint32_t)kind, device);
+    // host to host copies never reach the device and get no record to wait for
+    if (buffered_tracing_enabled() && kind != hipMemcpyHostToHost)
+        buffered_note_copy(correlation_id, device, analyze);
+}
+
+template <bool Async>
+void on_memcpy(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    void* dst = args.get<void*>(kMemcpyDst);
+    const void* src = args.get<const void*>(kMemcpySrc);
+    size_t size = args.get<size_t>(kMemcpySize);
+    hipMemcpyKind kind = args.get<hipMemcpyKind>(kMemcpyKind);
+    const void* stream = args.get<const void*>(kMemcpyStream);
+    if (graph_capturing(stream)) {
+        graph_capture_node(stream, GraphNode::copy(record.operation, (uint64_t)dst, (uint64_t)src, size, kind));
+        return;
+    }
+    issue_copy(record.correlation_id.internal, record.operation, kMemcpyLog, dst, src, size, kind, stream, Async);
+}
+
+enum : uint32_t { k2DDst, k2DDpitch, k2DSrc, k2DSpitch, k2DWidth, k2DHeight, k2DKind, k2DStream };
+constexpr ArgSpec hipMemcpy2D_args[] = {{"dst", sizeof(void*)}, {"dpitch", sizeof(size_t)},
+                                        {"src", sizeof(const void*)}, {"spitch", sizeof(size_t)},
+                                        {"width", sizeof(size_t)}, {"height", sizeof(size_t)},
+                                        {"kind", sizeof(hipMemcpyKind)}};
+constexpr ArgSpec hipMemcpy2DAsync_args[] = {{"dst", sizeof(void*)}, {"dpitch", sizeof(size_t)},
+                                             {"src", sizeof(const void*)}, {"spitch", sizeof(size_t)},
+                                             {"width", sizeof(size_t)}, {"height", sizeof(size_t)},
+                                             {"kind", sizeof(hipMemcpyKind)}, {"stream", sizeof(hipStream_t)}};
+
+// sanalyzer only models contiguous copies: forward the bytes actually moved
+template <bool Async>
+void on_memcpy2d(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    void* dst = args.get<void*>(k2DDst);
+    const void* src = args.get<const void*>(k2DSrc);
+    size_t size = args.get<size_t>(k2DWidth) * args.get<size_t>(k2DHeight);
+    hipMemcpyKind kind = args.get<hipMemcpyKind>(k2DKind);
+    const void* stream = args.get<const void*>(k2DStream);
+    if (graph_capturing(stream)) {
+        graph_capture_node(stream, GraphNode::copy(record.operation, (uint64_t)dst, (uint64_t)src, size, kind));
+        return;
+    }
+    issue_copy(record.correlation_id.internal, record.operation, kMemcpy2DLog, dst, src, size, kind, stream, Async);
+}
+
+enum : uint32_t { kMemsetDst, kMemsetValue, kMemsetSize, kMemsetStream };
+constexpr ArgSpec hipMemset_args[] = {{"dst", sizeof(void*)}, {"value", sizeof(int)},
+                                      {"sizeBytes", sizeof(size_t)}};
+constexpr ArgSpec hipMemsetAsync_args[] = {{"dst", sizeof(void*)}, {"value", sizeof(int)},
+                                           {"sizeBytes", sizeof(size_t)}, {"stream", sizeof(hipStream_t)}};
+
+void issue_memset(uint64_t correlation_id, uint32_t operation, void* ptr, int value, size_t size, const void* stream,
+                  bool async)
+{
+    int device = stream_device(stream);
+    timeline_memset(stream, device, size);
+    alloc_index().with_allocation((uint64_t)ptr, [&](Allocation& a) {
+        a.bytes_set.fetch_add(size, std::memory_order_relaxed);
+        if (a.on_device()) device = a.device;
+    });
+
+    auto& shard = device_shard(device);
+    shard.memsets.fetch_add(1, std::memory_order_relaxed);
+    shard.memset_bytes.fetch_add(size, std::memory_order_relaxed);
+    range_note_memset(size);
+
+    LOG_API(correlation_id, "memset: ptr=0x%lx, value=%ld, size=%lu, async=%lu", ptr, value, size, async);
+    if (!sample_operation(operation, size)) return;
+    analysis_memset(correlation_id, (uint64_t)ptr, size, value, async, device);
+}
+
+template <bool Async>
+void on_memset(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    void* ptr = args.get<void*>(kMemsetDst);
+    int value = args.get<int>(kMemsetValue);
+    size_t size = args.get<size_t>(kMemsetSize);
+    const void* stream = args.get<const void*>(kMemsetStream);
+    if (graph_capturing(stream)) {
+        graph_capture_node(stream, GraphNode::memset(record.operation, (uint64_t)ptr, value, size));
+        return;
+    }
+    issue_memset(record.correlation_id.internal, record.operation, ptr, value, size, stream, Async);
+}
+
+// The sampling policy decides whether the launch reaches the analysis; it is counted
+// either way. The start is staged here in both modes, so it keeps its place among the
+// thread's calls; in buffered mode the launch is also left under its correlation ID for
+// the consumer, which forwards the end with the device times. The launch's working set is
+// staged ahead of its start.
+// On a capturing stream the launch becomes a kernel node with a copy of its arguments.
+void kernel_start(uint64_t correlation_id, uint32_t operation, kernel_name_id_t name_id, const void* stream,
+                  const KernelArgValues& values)
+{
+    if (graph_capturing(stream)) {
+        graph_capture_node(stream, GraphNode::kernel(operation, name_id, kernel_args_pack(name_id, values)));
+        return;
+    }
+    int device = stream_device(stream);
+    timeline_launch(stream, device);
+    device_shard(device).launches.fetch_add(1, std::memory_order_relaxed);
+    range_note_launch();
+    bool analyze = sample_kernel(name_id);
+    const KernelBuffer* buffers;
+    uint32_t num_buffers = kernel_args_launch(name_id, values, &buffers);
+    // staged before the launch is noted, so its end can never be forwarded ahead of it
+    if (analyze) analysis_kernel_start(correlation_id, name_id, device, buffers, num_buffers);
+    if (buffered_tracing_enabled()) buffered_note_launch(correlation_id, name_id, device, analyze);
+}
+
+enum : uint32_t { kLaunchFunc, kLaunchGrid, kLaunchBlock, kLaunchSharedMem, kLaunchStream, kLaunchArgs };
+constexpr ArgSpec hipLaunchKernel_args[] = {{"function_address", sizeof(const void*)},
+                                            {"numBlocks", sizeof(rocprofiler_dim3_t)},
+                                            {"dimBlocks", sizeof(rocprofiler_dim3_t)},
+                                            {"sharedMemBytes", sizeof(size_t)},
+                                            {"stream", sizeof(hipStream_t)},
+                                            {"args", sizeof(void**)}};
+constexpr ArgSpec hipExtLaunchKernel_args[] = {{"function_address", sizeof(const void*)},
+                                               {"numBlocks", sizeof(rocprofiler_dim3_t)},
+                                               {"dimBlocks", sizeof(rocprofiler_dim3_t)},
+                                               {"sharedMemBytes", sizeof(size_t)},
+                                               {"stream", sizeof(hipStream_t)},
+                                               {"args", sizeof(void**)}};
+
+void on_launch(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    const void* func_ptr = args.get<const void*>(kLaunchFunc);
+    rocprofiler_dim3_t grid_dim = args.get<rocprofiler_dim3_t>(kLaunchGrid);
+    rocprofiler_dim3_t block_dim = args.get<rocprofiler_dim3_t>(kLaunchBlock);
+    size_t shared_mem = args.get<size_t>(kLaunchSharedMem);
+    void* stream = args.get<void*>(kLaunchStream);
+
+    LOG_API(record.correlation_id.internal, "launch: func=0x%lx, grid=%lux%lux%lu",
+        func_ptr, grid_dim.x, grid_dim.y, grid_dim.z);
+    LOG_API(record.correlation_id.internal, "launch: block=%lux%lux%lu, sharedMem=%lu, stream=0x%lx",
+        block_dim.x, block_dim.y, block_dim.z, shared_mem, stream);
+    KernelArgValues values;
+    values.args = args.get<void**>(kLaunchArgs);
+    kernel_start(record.correlation_id.internal, record.operation,
+                 kernel_names().resolve(KernelNameTable::kHostFunction, (uint64_t)func_ptr), stream, values);
+}
+
+enum : uint32_t { kModFunc, kModGridX, kModGridY, kModGridZ, kModBlockX, kModBlockY, kModBlockZ,
+                  kModSharedMem, kModStream, kModParams, kModExtra };
+constexpr ArgSpec hipModuleLaunchKernel_args[] = {{"f", sizeof(hipFunction_t)},
+                                                  {"gridDimX", sizeof(unsigned int)},
+                                                  {"gridDimY", sizeof(unsigned int)},
+                                                  {"gridDimZ", sizeof(unsigned int)},
+                                                  {"blockDimX", sizeof(unsigned int)},
+                                                  {"blockDimY", sizeof(unsigned int)},
+                                                  {"blockDimZ", sizeof(unsigned int)},
+                                                  {"sharedMemBytes", sizeof(unsigned int)},
+                                                  {"stream", sizeof(hipStream_t)},
+                                                  {"kernelParams", sizeof(void**)},
+                                                  {"extra", sizeof(void**)}};
+
+// Arguments come as kernelParams, or packed into one buffer described by extra.
+// extra is a list of (key, value) pairs; at most kMaxExtraWords of it are read, a whole
+// pair at a time, so a list missing its HIP_LAUNCH_PARAM_END is never read past the window.
+constexpr int kMaxExtraWords = 8;
+
+KernelArgValues module_arg_values(void** params, void** extra)
+{
+    KernelArgValues values;
+    values.args = params;
+    if (params != nullptr || extra == nullptr) return values;
+    for (int i = 0; i + 1 < kMaxExtraWords && extra[i] != HIP_LAUNCH_PARAM_END; i += 2) {
+        if (extra[i] == HIP_LAUNCH_PARAM_BUFFER_POINTER) values.packed = extra[i + 1];
+        else if (extra[i] == HIP_LAUNCH_PARAM_BUFFER_SIZE && extra[i + 1] != nullptr)
+            values.packed_size = *static_cast<const size_t*>(extra[i + 1]);
+        else break;
+    }
+    return values;
+}
+
+void on_module_launch(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    const void* func_ptr = args.get<const void*>(kModFunc);
+    void* stream = args.get<void*>(kModStream);
+
+    LOG_API(record.correlation_id.internal, "module launch: func=0x%lx, grid=%lux%lux%lu",
+        func_ptr, args.get<unsigned int>(kModGridX), args.get<unsigned int>(kModGridY),
+        args.get<unsigned int>(kModGridZ));
+    LOG_API(record.correlation_id.internal, "module launch: block=%lux%lux%lu, sharedMem=%lu, stream=0x%lx",
+        args.get<unsigned int>(kModBlockX), args.get<unsigned int>(kModBlockY),
+        args.get<unsigned int>(kModBlockZ), args.get<unsigned int>(kModSharedMem), stream);
+
+    // module functions are not covered by code-object host symbols; ask HIP once per function
+    auto& names = kernel_names();
+    kernel_name_id_t name_id = names.find(KernelNameTable::kModuleFunction, (uint64_t)func_ptr);
+    if (name_id == kUnknownKernel && func_ptr != nullptr) {
+        const char* name = nullptr;
+        {
+            ToolHipCall guard;
+            name = hipKernelNameRef(static_cast<hipFunction_t>(const_cast<void*>(func_ptr)));
+        }
+        if (name != nullptr) {
+            name_id = names.intern(name);
+            names.bind(KernelNameTable::kModuleFunction, (uint64_t)func_ptr, name_id);
+        } else {
+            name_id = names.resolve(KernelNameTable::kModuleFunction, (uint64_t)func_ptr);
+        }
+    }
+    kernel_start(record.correlation_id.internal, record.operation, name_id, stream,
+                 module_arg_values(args.get<void**>(kModParams), args.get<void**>(kModExtra)));
+}
+
+enum : uint32_t { kSetDeviceId };
+constexpr ArgSpec hipSetDevice_args[] = {{"deviceId", sizeof(int)}};
+
+void on_set_device(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    if (hip_retval(record) != hipSuccess) return;
+    set_current_device(args.get<int>(kSetDeviceId));
+}
+
+// streams are created on the calling thread's current device
+enum : uint32_t { kStreamOut, kStreamFlags };
+constexpr ArgSpec hipStreamCreate_args[] = {{"stream", sizeof(hipStream_t*)}};
+constexpr ArgSpec hipStreamCreateWithFlags_args[] = {{"stream", sizeof(hipStream_t*)},
+                                                     {"flags", sizeof(unsigned int)}};
+constexpr ArgSpec hipStreamCreateWithPriority_args[] = {{"stream", sizeof(hipStream_t*)},
+                                                        {"flags", sizeof(unsigned int)}};
+
+void on_stream_create(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    if (hip_retval(record) != hipSuccess) return;
+    hipStream_t* out = args.get<hipStream_t*>(kStreamOut);
+    if (out == nullptr) return;
+    int device = current_device();
+    note_stream_created(*out, device);
+    timeline_stream_created(*out, device, args.get<unsigned int>(kStreamFlags));
+}
+
+enum : uint32_t { kStreamHandle };
+constexpr ArgSpec hipStreamDestroy_args[] = {{"stream", sizeof(hipStream_t)}};
+
+void on_stream_destroy(const rocprofiler_callback_tracing_record_t&, const ArgReader& args)
+{
+    const void* stream = args.get<const void*>(kStreamHandle);
+    timeline_stream_destroyed(stream, stream_device(stream));
+    note_stream_destroyed(stream);
+}
+
+// Synchronization feeds the stream timeline. Blocking calls start a host wait on ENTER,
+// tool_tracing_callback ends it on EXIT; queries only tell something when they succeed.
+constexpr ArgSpec hipStreamSynchronize_args[] = {{"stream", sizeof(hipStream_t)}};
+constexpr ArgSpec hipStreamQuery_args[] = {{"stream", sizeof(hipStream_t)}};
+
+void on_stream_sync(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    const void* stream = args.get<const void*>(kStreamHandle);
+    timeline_wait_stream(record.operation, stream, stream_device(stream));
+}
+
+void on_stream_query(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    if (hip_retval(record) != hipSuccess) return;
+    const void* stream = args.get<const void*>(kStreamHandle);
+    timeline_stream_idle(stream, stream_device(stream));
+}
+
+void on_device_sync(const rocprofiler_callback_tracing_record_t& record, const ArgReader&)
+{
+    timeline_wait_device(record.operation, current_device());
+}
+
+enum : uint32_t { kEventHandle, kEventStream };
+constexpr ArgSpec hipEventRecord_args[] = {{"event", sizeof(hipEvent_t)}, {"stream", sizeof(hipStream_t)}};
+constexpr ArgSpec hipEventSynchronize_args[] = {{"event", sizeof(hipEvent_t)}};
+constexpr ArgSpec hipEventQuery_args[] = {{"event", sizeof(hipEvent_t)}};
+constexpr ArgSpec hipEventDestroy_args[] = {{"event", sizeof(hipEvent_t)}};
+
+// in a capture, records and waits only order the graph's nodes
+void on_event_record(const rocprofiler_callback_tracing_record_t&, const ArgReader& args)
+{
+    const void* event = args.get<const void*>(kEventHandle);
+    const void* stream = args.get<const void*>(kEventStream);
+    graph_event_recorded(event, stream);
+    if (graph_capturing(stream)) return;
+    timeline_event_record(event, stream, stream_device(stream));
+}
+
+void on_event_sync(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    timeline_wait_event(record.operation, args.get<const void*>(kEventHandle));
+}
+
+void on_event_query(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    if (hip_retval(record) != hipSuccess) return;
+    timeline_event_complete(args.get<const void*>(kEventHandle));
+}
+
+void on_event_destroy(const rocprofiler_callback_tracing_record_t&, const ArgReader& args)
+{
+    timeline_event_destroyed(args.get<const void*>(kEventHandle));
+}
+
+enum : uint32_t { kWaitStream, kWaitEvent };
+constexpr ArgSpec hipStreamWaitEvent_args[] = {{"stream", sizeof(hipStream_t)}, {"event", sizeof(hipEvent_t)}};
+
+void on_stream_wait_event(const rocprofiler_callback_tracing_record_t&, const ArgReader& args)
+{
+    const void* stream = args.get<const void*>(kWaitStream);
+    const void* event = args.get<const void*>(kWaitEvent);
+    if (graph_stream_waits(stream, event)) return;
+    timeline_stream_wait_event(stream, stream_device(stream), event);
+}
+
+// HIP graphs (graphs.h): nodes are recorded as streams capture work or as they are added,
+// and every launch replays the executable graph's nodes on its stream.
+enum : uint32_t { kCaptureStream, kCaptureGraphOut };
+constexpr ArgSpec hipStreamBeginCapture_args[] = {{"stream", sizeof(hipStream_t)}};
+constexpr ArgSpec hipStreamEndCapture_args[] = {{"stream", sizeof(hipStream_t)}, {"pGraph", sizeof(hipGraph_t*)}};
+
+void on_begin_capture(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    if (hip_retval(record) != hipSuccess) return;
+    graph_begin_capture(args.get<const void*>(kCaptureStream));
+}
+
+void on_end_capture(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    hipGraph_t* out = args.get<hipGraph_t*>(kCaptureGraphOut);
+    bool ok = hip_retval(record) == hipSuccess && out != nullptr;
+    graph_end_capture(args.get<const void*>(kCaptureStream), ok ? *out : nullptr);
+}
+
+enum : uint32_t { kNodeGraph, kNodeParams };
+constexpr ArgSpec hipGraphAddKernelNode_args[] = {{"graph", sizeof(hipGraph_t)},
+                                                  {"pNodeParams", sizeof(const hipKernelNodeParams*)}};
+constexpr ArgSpec hipGraphAddMemcpyNode_args[] = {{"graph", sizeof(hipGraph_t)},
+                                                  {"pCopyParams", sizeof(const hipMemcpy3DParms*)}};
+constexpr ArgSpec hipGraphAddMemsetNode_args[] = {{"graph", sizeof(hipGraph_t)},
+                                                  {"pMemsetParams", sizeof(const hipMemsetParams*)}};
+constexpr ArgSpec hipGraphAddMemAllocNode_args[] = {{"graph", sizeof(hipGraph_t)},
+                                                    {"pNodeParams", sizeof(hipMemAllocNodeParams*)}};
+constexpr ArgSpec hipGraphAddMemFreeNode_args[] = {{"graph", sizeof(hipGraph_t)}, {"dev_ptr", sizeof(void*)}};
+constexpr ArgSpec hipGraphAddChildGraphNode_args[] = {{"graph", sizeof(hipGraph_t)},
+                                                      {"childGraph", sizeof(hipGraph_t)}};
+
+void on_add_kernel_node(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    const auto* params = args.get<const hipKernelNodeParams*>(kNodeParams);
+    if (hip_retval(record) != hipSuccess || params == nullptr) return;
+    kernel_name_id_t name_id = kernel_names().resolve(KernelNameTable::kHostFunction, (uint64_t)params->func);
+    KernelArgValues values = module_arg_values(params->kernelParams, params->extra);
+    graph_add_node(args.get<const void*>(kNodeGraph),
+                   GraphNode::kernel(record.operation, name_id, kernel_args_pack(name_id, values)));
+}
+
+// copies between pitched pointers; array copies have no linear address to attribute
+void on_add_memcpy_node(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    const auto* p = args.get<const hipMemcpy3DParms*>(kNodeParams);
+    if (hip_retval(record) != hipSuccess || p == nullptr) return;
+    if (p->srcArray != nullptr || p->dstArray != nullptr) return;
+    auto linear = [](const hipPitchedPtr& ptr, const hipPos& pos) {
+        return (uint64_t)ptr.ptr + pos.x + (pos.y + pos.z * ptr.ysize) * ptr.pitch;
+    };
+    uint64_t size = (uint64_t)p->extent.width * p->extent.height * p->extent.depth;
+    graph_add_node(args.get<const void*>(kNodeGraph),
+                   GraphNode::copy(record.operation, linear(p->dstPtr, p->dstPos), linear(p->srcPtr, p->srcPos),
+                                   size, p->kind));
+}
+
+void on_add_memset_node(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    const auto* p = args.get<const hipMemsetParams*>(kNodeParams);
+    if (hip_retval(record) != hipSuccess || p == nullptr) return;
+    uint64_t size = (uint64_t)p->elementSize * p->width * p->height;
+    graph_add_node(args.get<const void*>(kNodeGraph),
+                   GraphNode::memset(record.operation, (uint64_t)p->dst, (int32_t)p->value, size));
+}
+
+// the runtime writes the address back into the parameters
+void on_add_alloc_node(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    const auto* p = args.get<const hipMemAllocNodeParams*>(kNodeParams);
+    if (hip_retval(record) != hipSuccess || p == nullptr || p->dptr == nullptr) return;
+    graph_add_node(args.get<const void*>(kNodeGraph),
+                   GraphNode::alloc(record.operation, (uint64_t)p->dptr, p->bytesize, p->poolProps.location.id));
+}
+
+void on_add_free_node(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    if (hip_retval(record) != hipSuccess) return;
+    graph_add_node(args.get<const void*>(kNodeGraph),
+                   GraphNode::free(record.operation, args.get<uint64_t>(kNodeParams)));
+}
+
+void on_add_child_node(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    if (hip_retval(record) != hipSuccess) return;
+    graph_add_child(args.get<const void*>(kNodeGraph), args.get<const void*>(kNodeParams));
+}
+
+enum : uint32_t { k1DGraph, k1DDst, k1DSrc, k1DCount, k1DKind };
+constexpr ArgSpec hipGraphAddMemcpyNode1D_args[] = {{"graph", sizeof(hipGraph_t)}, {"dst", sizeof(void*)},
+                                                    {"src", sizeof(const void*)}, {"count", sizeof(size_t)},
+                                                    {"kind", sizeof(hipMemcpyKind)}};
+
+void on_add_memcpy_node_1d(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    if (hip_retval(record) != hipSuccess) return;
+    graph_add_node(args.get<const void*>(k1DGraph),
+                   GraphNode::copy(record.operation, args.get<uint64_t>(k1DDst), args.get<uint64_t>(k1DSrc),
+                                   args.get<size_t>(k1DCount), args.get<hipMemcpyKind>(k1DKind)));
+}
+
+enum : uint32_t { kCloneOut, kCloneOriginal };
+constexpr ArgSpec hipGraphClone_args[] = {{"pGraphClone", sizeof(hipGraph_t*)}, {"originalGraph", sizeof(hipGraph_t)}};
+
+void on_graph_clone(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    hipGraph_t* out = args.get<hipGraph_t*>(kCloneOut);
+    if (hip_retval(record) != hipSuccess || out == nullptr) return;
+    graph_cloned(*out, args.get<const void*>(kCloneOriginal));
+}
+
+enum : uint32_t { kGraphHandle };
+constexpr ArgSpec hipGraphDestroy_args[] = {{"graph", sizeof(hipGraph_t)}};
+
+void on_graph_destroy(const rocprofiler_callback_tracing_record_t&, const ArgReader& args)
+{
+    graph_destroyed(args.get<const void*>(kGraphHandle));
+}
+
+enum : uint32_t { kInstantiateOut, kInstantiateGraph };
+constexpr ArgSpec hipGraphInstantiate_args[] = {{"pGraphExec", sizeof(hipGraphExec_t*)},
+                                                {"graph", sizeof(hipGraph_t)}};
+constexpr ArgSpec hipGraphInstantiateWithFlags_args[] = {{"pGraphExec", sizeof(hipGraphExec_t*)},
+                                                         {"graph", sizeof(hipGraph_t)}};
+
+void on_graph_instantiate(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    hipGraphExec_t* out = args.get<hipGraphExec_t*>(kInstantiateOut);
+    if (hip_retval(record) != hipSuccess || out == nullptr) return;
+    graph_instantiated(*out, args.get<const void*>(kInstantiateGraph));
+}
+
+// whole-graph updates only; per-node hipGraphExec*SetParams are not followed
+enum : uint32_t { kUpdateExec, kUpdateGraph };
+constexpr ArgSpec hipGraphExecUpdate_args[] = {{"hGraphExec", sizeof(hipGraphExec_t)}, {"hGraph", sizeof(hipGraph_t)}};
+
+void on_graph_exec_update(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    if (hip_retval(record) != hipSuccess) return;
+    graph_instantiated(args.get<const void*>(kUpdateExec), args.get<const void*>(kUpdateGraph));
+}
+
+enum : uint32_t { kExecHandle, kExecStream };
+constexpr ArgSpec hipGraphExecDestroy_args[] = {{"graphExec", sizeof(hipGraphExec_t)}};
+constexpr ArgSpec hipGraphLaunch_args[] = {{"graphExec", sizeof(hipGraphExec_t)}, {"stream", sizeof(hipStream_t)}};
+
+void on_graph_exec_destroy(const rocprofiler_callback_tracing_record_t&, const ArgReader& args)
+{
+    graph_exec_destroyed(args.get<const void*>(kExecHandle));
+}
+
+// The nodes are issued as if each had been enqueued on the launch stream, all under the
+// launch's correlation ID. A graph launched into a capture becomes part of it.
+void on_graph_launch(const rocprofiler_callback_tracing_record_t& record, const ArgReader& args)
+{
+    const void* stream = args.get<const void*>(kExecStream);
+    std::shared_ptr<const GraphNodes> nodes = graph_launch_nodes(args.get<const void*>(kExecHandle));
+    if (nodes == nullptr) return;
+    if (graph_capturing(stream)) {
+        for (const GraphNode& node : *nodes) graph_capture_node(stream, node);
+        return;
+    }
+
+    uint64_t cid = record.correlation_id.internal;
+    LOG_API(cid, "graph launch: exec=0x%lx, nodes=%lu, stream=0x%lx", args.get<const void*>(kExecHandle),
+        nodes->size(), stream);
+    for (const GraphNode& node : *nodes) {
+        switch (node.kind) {
+            case GraphNodeKind::kernel: {
+                KernelArgValues values;
+                if (!node.args.empty()) {
+                    values.packed = node.args.data();
+                    values.packed_size = node.args.size();
+                }
+                kernel_start(cid, node.operation, node.name_id, stream, values);
+                break;
             }
-            return 0;
-        };
+            case GraphNodeKind::copy:
+                issue_copy(cid, node.operation, kGraphMemcpyLog, (void*)node.dst, (const void*)node.src, node.size,
+                           (hipMemcpyKind)node.copy_kind, stream, true);
+                break;
+            case GraphNodeKind::memset:
+                issue_memset(cid, node.operation, (void*)node.dst, node.value, node.size, stream, true);
+                break;
+            case GraphNodeKind::alloc:
+                issue_alloc(cid, node.dst, node.size, node.device, MemoryKind::device);
+                break;
+            case GraphNodeKind::free:
+                issue_free(cid, node.dst, stream_device(stream));
+                break;
+        }
+    }
+}
 
-        ROCPROFILER_CALL(
-            rocprofiler_iterate_callback_tracing_kind_operation_args(record, cb, 1, &out),
-            "failed to iterate hipMemset arguments");
-
-        PRINT("[ROCMPROF INFO] hipMemset: ptr=%p, value=%d, size=%zu\n", ptr, value, size);
-        yosemite_memset_callback((uint64_t)ptr, (uint32_t)size, (int)value, false, 0 /*device_id*/);
-    } else if (record.operation == ROCPROFILER_HIP_RUNTIME_API_ID_hipLaunchKernel
-                && record.phase == ROCPROFILER_CALLBACK_PHASE_ENTER) {
-        const void* func_ptr = nullptr;
-        rocprofiler_dim3_t grid_dim = {};
-        rocprofiler_dim3_t block_dim = {};
-        uint32_t shared_mem = 0;
-        void* stream = nullptr;
-        struct kernel_args {
-            const void** func_ptr;
-            rocprofiler_dim3_t* grid_dim;
-            rocprofiler_dim3_t* block_dim;
-            uint32_t* shared_mem;
-            void** stream;
+// One row per traced HIP runtime operation: the group that selects it (op_selection.h),
+// the phase its handler runs in, the handler and the arguments it reads. Adding an API is
+// one row here.
+struct HipOpEntry {
+    rocprofiler_tracing_operation_t operation;
+    uint32_t group;
+    rocprofiler_callback_phase_t phase;
+    op_handler_t handler;
+    const ArgSpec* specs;
+    uint32_t num_specs;
+};
+
+#define HIP_OP(NAME, GROUP, PHASE, HANDLER)                                                   \
+    HipOpEntry{ROCPROFILER_HIP_RUNTIME_API_ID_##NAME, kOp##GROUP,                             \
+               ROCPROFILER_CALLBACK_PHASE_##PHASE, HANDLER, NAME##_args,                      \
+               sizeof(NAME##_args) / sizeof(ArgSpec)}
+
+// operations without arguments
+#define HIP_OP_NO_ARGS(NAME, GROUP, PHASE, HANDLER)                                           \
+    HipOpEntry{ROCPROFILER_HIP_RUNTIME_API_ID_##NAME, kOp##GROUP,                             \
+               ROCPROFILER_CALLBACK_PHASE_##PHASE, HANDLER, nullptr, 0}
+
+constexpr HipOpEntry hip_op_rows[] = {
+    HIP_OP(hipMalloc,                   Memory, EXIT,  on_alloc<MemoryKind::device>),
+    HIP_OP(hipMallocAsync,              Memory, EXIT,  on_alloc<MemoryKind::device>),
+    HIP_OP(hipMallocManaged,            Memory, EXIT,  on_alloc<MemoryKind::managed>),
+    HIP_OP(hipHostMalloc,               Memory, EXIT,  on_alloc<MemoryKind::host>),
+    HIP_OP(hipFree,                     Memory, ENTER, on_free),
+    HIP_OP(hipFreeAsync,                Memory, ENTER, on_free),
+    HIP_OP(hipHostFree,                 Memory, ENTER, on_free),
+    HIP_OP(hipMemcpy,                   Memory, ENTER, on_memcpy<false>),
+    HIP_OP(hipMemcpyAsync,              Memory, ENTER, on_memcpy<true>),
+    HIP_OP(hipMemcpy2D,                 Memory, ENTER, on_memcpy2d<false>),
+    HIP_OP(hipMemcpy2DAsync,            Memory, ENTER, on_memcpy2d<true>),
+    HIP_OP(hipMemset,                   Memory, ENTER, on_memset<false>),
+    HIP_OP(hipMemsetAsync,              Memory, ENTER, on_memset<true>),
+    HIP_OP(hipLaunchKernel,             Launch, ENTER, on_launch),
+    HIP_OP(hipExtLaunchKernel,          Launch, ENTER, on_launch),
+    HIP_OP(hipModuleLaunchKernel,       Launch, ENTER, on_module_launch),
+    HIP_OP(hipSetDevice,                State,  EXIT,  on_set_device),
+    HIP_OP(hipStreamCreate,             State,  EXIT,  on_stream_create),
+    HIP_OP(hipStreamCreateWithFlags,    State,  EXIT,  on_stream_create),
+    HIP_OP(hipStreamCreateWithPriority, State,  EXIT,  on_stream_create),
+    HIP_OP(hipStreamDestroy,            State,  ENTER, on_stream_destroy),
+    HIP_OP(hipStreamSynchronize,        Sync,   ENTER, on_stream_sync),
+    HIP_OP(hipStreamQuery,              Sync,   EXIT,  on_stream_query),
+    HIP_OP(hipStreamWaitEvent,          SyncOrGraph, ENTER, on_stream_wait_event),
+    HIP_OP_NO_ARGS(hipDeviceSynchronize, Sync,  ENTER, on_device_sync),
+    HIP_OP(hipEventRecord,              SyncOrGraph, ENTER, on_event_record),
+    HIP_OP(hipEventSynchronize,         Sync,   ENTER, on_event_sync),
+    HIP_OP(hipEventQuery,               Sync,   EXIT,  on_event_query),
+    HIP_OP(hipEventDestroy,             Sync,   ENTER, on_event_destroy),
+    HIP_OP(hipStreamBeginCapture,       Graph,  EXIT,  on_begin_capture),
+    HIP_OP(hipStreamEndCapture,         Graph,  EXIT,  on_end_capture),
+    HIP_OP(hipGraphAddKernelNode,       Graph,  EXIT,  on_add_kernel_node),
+    HIP_OP(hipGraphAddMemcpyNode,       Graph,  EXIT,  on_add_memcpy_node),
+    HIP_OP(hipGraphAddMemcpyNode1D,     Graph,  EXIT,  on_add_memcpy_node_1d),
+    HIP_OP(hipGraphAddMemsetNode,       Graph,  EXIT,  on_add_memset_node),
+    HIP_OP(hipGraphAddMemAllocNode,     Graph,  EXIT,  on_add_alloc_node),
+    HIP_OP(hipGraphAddMemFreeNode,      Graph,  EXIT,  on_add_free_node),
+    HIP_OP(hipGraphAddChildGraphNode,   Graph,  EXIT,  on_add_child_node),
+    HIP_OP(hipGraphClone,               Graph,  EXIT,  on_graph_clone),
+    HIP_OP(hipGraphDestroy,             Graph,  ENTER, on_graph_destroy),
+    HIP_OP(hipGraphInstantiate,         Graph,  EXIT,  on_graph_instantiate),
+    HIP_OP(hipGraphInstantiateWithFlags, Graph, EXIT,  on_graph_instantiate),
+    HIP_OP(hipGraphExecUpdate,          Graph,  EXIT,  on_graph_exec_update),
+    HIP_OP(hipGraphExecDestroy,         Graph,  ENTER, on_graph_exec_destroy),
+    HIP_OP(hipGraphLaunch,              Graph,  ENTER, on_graph_launch),
+};
+
+#undef HIP_OP
+#undef HIP_OP_NO_ARGS
+
+using hip_dispatch_table_t = std::array<HipOpEntry, ROCPROFILER_HIP_RUNTIME_API_ID_LAST>;
+
+template <size_t N>
+constexpr hip_dispatch_table_t make_hip_dispatch_table(const HipOpEntry (&rows)[N])
+{
+    hip_dispatch_table_t table{};
+    for (const auto& row : rows) table[row.operation] = row;
+    return table;
+}
+
+template <size_t N>
+constexpr bool hip_op_rows_unique(const HipOpEntry (&rows)[N])
+{
+    for (size_t i = 0; i < N; i++)
+        for (size_t j = i + 1; j < N; j++)
+            if (rows[i].operation == rows[j].operation) return false;
+    return true;
+}
+
+static_assert(hip_op_rows_unique(hip_op_rows), "duplicate HIP operation in hip_op_rows");
+
+// O(1) dispatch by operation ID; entries without a handler are ignored
+constexpr hip_dispatch_table_t hip_dispatch = make_hip_dispatch_table(hip_op_rows);
+
+// Resolve argument names to payload offsets by iterating a zeroed synthetic record for
+// every traced operation. This is the only place argument names are compared.
+void build_arg_layouts()
+{
+    for (const auto& op : hip_op_rows) {
+        auto& layout = hip_arg_layouts[op.operation];
+        layout.declare(op.specs, op.num_specs);
+
+        hip_api_data_t payload = {};
+        payload.size = sizeof(payload);
+        rocprofiler_callback_tracing_record_t record = {};
+        record.kind = ROCPROFILER_CALLBACK_TRACING_HIP_RUNTIME_API;
+        record.operation = op.operation;
+        record.phase = op.phase;
+        record.payload = &payload;
+
+        struct bind_data {
+            OpArgLayout* layout;
+            const char* base;
         };
-        
-        kernel_args out{&func_ptr, &grid_dim, &block_dim, &shared_mem, &stream};
+        bind_data data{&layout, reinterpret_cast<const char*>(&payload)};
         auto cb = [](rocprofiler_callback_tracing_kind_t,
                     rocprofiler_tracing_operation_t,
-                    uint32_t,
+                    uint32_t arg_num,
                     const void* const arg_value_addr,
                     int32_t,
-                    const char*,
+                    const char* arg_type,
                     const char* arg_name,
                     const char*,
                     int32_t,
                     void* cb_data) -> int {
-            auto* p = static_cast<kernel_args*>(cb_data);
-            if (std::string(arg_name) == "function_address") {
-                *p->func_ptr = *static_cast<const void* const*>(arg_value_addr);
-            } else if (std::string(arg_name) == "numBlocks") {
-                *p->grid_dim = *static_cast<const rocprofiler_dim3_t*>(arg_value_addr);
-            } else if (std::string(arg_name) == "dimBlocks") {
-                *p->block_dim = *static_cast<const rocprofiler_dim3_t*>(arg_value_addr);
-            } else if (std::string(arg_name) == "sharedMemBytes") {
-                *p->shared_mem = *static_cast<const uint32_t*>(arg_value_addr);
-            } else if (std::string(arg_name) == "stream") {
-                *p->stream = *static_cast<void* const*>(arg_value_addr);
+            auto* d = static_cast<bind_data*>(cb_data);
+            auto* addr = static_cast<const char*>(arg_value_addr);
+            int64_t offset = -1;
+            if (addr >= d->base && addr < d->base + sizeof(hip_api_data_t)) {
+                offset = addr - d->base;
             }
+            d->layout->bind(arg_num, arg_name, arg_type, offset);
             return 0;
         };
 
         ROCPROFILER_CALL(
-            rocprofiler_iterate_callback_tracing_kind_operation_args(record, cb, 1, &out),
-            "failed to iterate hipLaunchKernel arguments");
-
-        PRINT("[ROCMPROF INFO] hipLaunchKernel: func=%p, grid=(%d,%d,%d), block=(%d,%d,%d), sharedMem=%d, stream=%p\n",
-            func_ptr, grid_dim.x, grid_dim.y, grid_dim.z, block_dim.x, block_dim.y, block_dim.z, shared_mem, stream);
- 
-        char buffer[64];
-        snprintf(buffer, sizeof(buffer), "%p", func_ptr);
-        std::string func_name(buffer);
-        yosemite_kernel_start_callback("func-" + func_name, 0 /*device_id*/);
+            rocprofiler_iterate_callback_tracing_kind_operation_args(record, cb, /*max_deref=*/0, &data),
+            "failed to resolve argument layout");
+
+        if (const char* missing = layout.finalize()) {
+            const char* op_name = nullptr;
+            rocprofiler_query_callback_tracing_kind_operation_name(
+                ROCPROFILER_CALLBACK_TRACING_HIP_RUNTIME_API, op.operation, &op_name, nullptr);
+            fprintf(stderr, "[ROCMPROF WARNING] %s: argument '%s' not found, it will read as 0\n",
+                    op_name ? op_name : "unknown", missing);
+        }
     }
+}
 
+// Fill the reader for one record. Only needed when the layout could not be resolved to
+// payload offsets, in which case the arguments are copied by position, never by name.
+void gather_args(const rocprofiler_callback_tracing_record_t& record, ArgReader& reader)
+{
+    if (!reader.needs_capture()) return;
+
+    auto cb = [](rocprofiler_callback_tracing_kind_t,
+                rocprofiler_tracing_operation_t,
+                uint32_t arg_num,
+                const void* const arg_value_addr,
+                int32_t,
+                const char*,
+                const char*,
+                const char*,
+                int32_t,
+                void* cb_data) -> int {
+        static_cast<ArgReader*>(cb_data)->capture(arg_num, arg_value_addr);
+        return 0;
+    };
+
+    ROCPROFILER_CALL(
+        rocprofiler_iterate_callback_tracing_kind_operation_args(record, cb, /*max_deref=*/0, &reader),
+        "failed to iterate operation arguments");
+}
+
+// Stringify every argument of the record, as rocprofiler formats them. Only used at the
+// full log level; the text is built on the calling thread because the record does not
+// outlive the callback, but the I/O is left to the logger thread.
+void log_record_args(const rocprofiler_callback_tracing_record_t& record)
+{
     auto info = std::stringstream{};
     info << std::left << "tid=" << record.thread_id << ", cid=" << std::setw(3)
          << record.correlation_id.internal << ", kind=" << record.kind
@@ -309,7 +958,206 @@ void tool_tracing_callback(rocprofiler_callback_tracing_record_t record,
     auto info_data_str = info_data.str();
     if(!info_data_str.empty()) info << " " << info_data_str << ")";
 
-    PRINT("[ROCMPROF INFO] %s\n", info.str().c_str());
+    auto info_str = info.str();
+    log_text(record.correlation_id.internal, info_str.data(), info_str.size());
+}
+
+
+void tool_tracing_callback(rocprofiler_callback_tracing_record_t record,
+                           rocprofiler_user_data_t* user_data,
+                           void* callback_data)
+{
+    if (record.kind != ROCPROFILER_CALLBACK_TRACING_HIP_RUNTIME_API) return;
+    if (in_tool_hip_call) return;
+    if (record.operation < 0 || record.operation >= ROCPROFILER_HIP_RUNTIME_API_ID_LAST) return;
+
+    OverheadProbe probe(record.operation);
+
+    if (record.phase == ROCPROFILER_CALLBACK_PHASE_ENTER && log_enabled(LogLevel::summary)) {
+        log_count(record.operation);
+        probe.mark(OverheadPhase::log);
+    }
+
+    const auto& entry = hip_dispatch[record.operation];
+    if (entry.handler != nullptr && record.phase == entry.phase) {
+        ArgReader args(hip_arg_layouts[record.operation], record.payload);
+        gather_args(record, args);
+        probe.mark(OverheadPhase::args);
+        entry.handler(record, args);
+        probe.mark(OverheadPhase::handler);
+    }
+
+    // a blocking call returned: end the host wait its ENTER handler started
+    if (record.phase == ROCPROFILER_CALLBACK_PHASE_EXIT && tls_host_waiting) {
+        timeline_host_wait_end(hip_retval(record) == hipSuccess);
+        probe.mark(OverheadPhase::handler);
+    }
+
+    if (log_enabled(LogLevel::full)) {
+        log_record_args(record);
+        probe.mark(OverheadPhase::log);
+    }
+}
+
+// Registers kernel symbols and argument layouts as code objects are loaded, so launches
+// can be named by a single lookup. Mappings are kept on unload; a reloaded module rebinds
+// its addresses.
+void tool_code_object_callback(rocprofiler_callback_tracing_record_t record,
+                               rocprofiler_user_data_t*,
+                               void*)
+{
+    if (record.kind != ROCPROFILER_CALLBACK_TRACING_CODE_OBJECT) return;
+    if (record.phase != ROCPROFILER_CALLBACK_PHASE_LOAD) return;
+
+    auto& names = kernel_names();
+    if (record.operation == ROCPROFILER_CODE_OBJECT_LOAD) {
+        // argument layouts for the kernel working sets
+        auto* data = static_cast<rocprofiler_callback_tracing_code_object_load_data_t*>(record.payload);
+        if (data->storage_type == ROCPROFILER_CODE_OBJECT_STORAGE_TYPE_MEMORY)
+            kernel_args_code_object(reinterpret_cast<const void*>(data->memory_base), data->memory_size);
+        else
+            kernel_args_code_object_uri(data->uri);
+    } else if (record.operation == ROCPROFILER_CODE_OBJECT_DEVICE_KERNEL_SYMBOL_REGISTER) {
+        auto* data = static_cast<rocprofiler_callback_tracing_code_object_kernel_symbol_register_data_t*>(
+            record.payload);
+        kernel_name_id_t name_id = names.intern(data->kernel_name);
+        names.bind(KernelNameTable::kKernelId, data->kernel_id, name_id);
+        names.bind(KernelNameTable::kKernelObject, data->kernel_object, name_id);
+    } else if (record.operation == ROCPROFILER_CODE_OBJECT_HOST_KERNEL_SYMBOL_REGISTER) {
+        auto* data = static_cast<rocprofiler_callback_tracing_code_object_host_kernel_symbol_register_data_t*>(
+            record.payload);
+        kernel_name_id_t name_id = names.intern(data->device_function);
+        names.bind(KernelNameTable::kHostFunction, data->host_function.handle, name_id);
+    }
+}
+
+void code_object_init()
+{
+    // Kernel symbols must be registered even while the client context is paused by
+    // roctxProfilerPause, so code-object tracing lives in its own always-on context.
+    auto co_ctx = rocprofiler_context_id_t{0};
+    ROCPROFILER_CALL(rocprofiler_create_context(&co_ctx), "code object context creation failed");
+
+    rocprofiler_tracing_operation_t ops[] = {
+        ROCPROFILER_CODE_OBJECT_LOAD,
+        ROCPROFILER_CODE_OBJECT_DEVICE_KERNEL_SYMBOL_REGISTER,
+        ROCPROFILER_CODE_OBJECT_HOST_KERNEL_SYMBOL_REGISTER,
+    };
+    ROCPROFILER_CALL(rocprofiler_configure_callback_tracing_service(
+                         co_ctx,
+                         ROCPROFILER_CALLBACK_TRACING_CODE_OBJECT,
+                         ops,
+                         sizeof(ops) / sizeof(ops[0]),
+                         tool_code_object_callback,
+                         nullptr),
+                     "code object tracing service failed to configure");
+
+    ROCPROFILER_CALL(rocprofiler_start_context(co_ctx), "start of code object context");
+}
+
+// Feeds ROCTx ranges and marks to ranges.h. Push, pop and marks are handled on ENTER;
+// a process-wide range is only known by its id once roctxRangeStartA returns.
+void tool_marker_callback(rocprofiler_callback_tracing_record_t record,
+                          rocprofiler_user_data_t*,
+                          void*)
+{
+    if (record.kind != ROCPROFILER_CALLBACK_TRACING_MARKER_CORE_API) return;
+    auto* data = static_cast<rocprofiler_callback_tracing_marker_api_data_t*>(record.payload);
+    bool enter = record.phase == ROCPROFILER_CALLBACK_PHASE_ENTER;
+
+    switch (record.operation) {
+        case ROCPROFILER_MARKER_CORE_API_ID_roctxRangePushA:
+            if (enter) range_push(data->args.roctxRangePushA.message);
+            break;
+        case ROCPROFILER_MARKER_CORE_API_ID_roctxRangePop:
+            if (enter) range_pop();
+            break;
+        case ROCPROFILER_MARKER_CORE_API_ID_roctxMarkA:
+            if (enter) range_mark(data->args.roctxMarkA.message);
+            break;
+        case ROCPROFILER_MARKER_CORE_API_ID_roctxRangeStartA:
+            if (!enter) range_start(data->retval.roctx_range_id_t_retval, data->args.roctxRangeStartA.message);
+            break;
+        case ROCPROFILER_MARKER_CORE_API_ID_roctxRangeStop:
+            if (enter) range_stop(data->args.roctxRangeStop.id);
+            break;
+        default:
+            break;
+    }
+}
+
+void marker_init()
+{
+    ranges_init();
+
+    // like code objects, ranges must be seen while the client context is paused, or the
+    // range stacks would come out of step
+    auto marker_ctx = rocprofiler_context_id_t{0};
+    ROCPROFILER_CALL(rocprofiler_create_context(&marker_ctx), "marker context creation failed");
+
+    rocprofiler_tracing_operation_t ops[] = {
+        ROCPROFILER_MARKER_CORE_API_ID_roctxMarkA,
+        ROCPROFILER_MARKER_CORE_API_ID_roctxRangePushA,
+        ROCPROFILER_MARKER_CORE_API_ID_roctxRangePop,
+        ROCPROFILER_MARKER_CORE_API_ID_roctxRangeStartA,
+        ROCPROFILER_MARKER_CORE_API_ID_roctxRangeStop,
+    };
+    ROCPROFILER_CALL(rocprofiler_configure_callback_tracing_service(
+                         marker_ctx,
+                         ROCPROFILER_CALLBACK_TRACING_MARKER_CORE_API,
+                         ops,
+                         sizeof(ops) / sizeof(ops[0]),
+                         tool_marker_callback,
+                         nullptr),
+                     "marker tracing service failed to configure");
+
+    ROCPROFILER_CALL(rocprofiler_start_context(marker_ctx), "start of marker context");
+}
+
+const char* hip_op_name(uint32_t operation)
+{
+    const char* name = nullptr;
+    rocprofiler_query_callback_tracing_kind_operation_name(
+        ROCPROFILER_CALLBACK_TRACING_HIP_RUNTIME_API, operation, &name, nullptr);
+    return name;
+}
+
+// Operation filter for the HIP runtime callback service, empty when every API is traced.
+std::vector<rocprofiler_tracing_operation_t> selected_hip_operations()
+{
+    uint32_t active_groups = kOpMemory | kOpLaunch | kOpState;
+    if (timeline_active) active_groups |= kOpSync;
+    if (graphs_active) active_groups |= kOpGraph;
+    OpSelection selection = read_op_selection(log_enabled(LogLevel::full), active_groups);
+    std::vector<rocprofiler_tracing_operation_t> ops;
+    if (selection.all) {
+        fprintf(stdout, "[ROCMPROF INFO] tracing all HIP runtime operations\n");
+        return ops;
+    }
+
+    std::vector<bool> selected(ROCPROFILER_HIP_RUNTIME_API_ID_LAST, false);
+    for (const auto& row : hip_op_rows) {
+        if (row.group & selection.groups) selected[row.operation] = true;
+    }
+    for (const auto& name : selection.names) {
+        bool found = false;
+        for (uint32_t op = 0; op < ROCPROFILER_HIP_RUNTIME_API_ID_LAST && !found; op++) {
+            const char* op_name = hip_op_name(op);
+            if (op_name != nullptr && name == op_name) {
+                selected[op] = true;
+                found = true;
+            }
+        }
+        if (!found) fprintf(stderr, "[ROCMPROF WARNING] ACCELPROF_OPS: unknown entry '%s'\n", name.c_str());
+    }
+
+    for (uint32_t op = 0; op < ROCPROFILER_HIP_RUNTIME_API_ID_LAST; op++) {
+        if (selected[op]) ops.push_back(static_cast<rocprofiler_tracing_operation_t>(op));
+    }
+    // an empty filter would subscribe to everything
+    if (ops.empty()) ops.push_back(ROCPROFILER_HIP_RUNTIME_API_ID_hipSetDevice);
+    fprintf(stdout, "[ROCMPROF INFO] tracing %zu HIP runtime operations\n", ops.size());
+    return ops;
 }
 
 void tool_control_init(rocprofiler_context_id_t& primary_ctx)
@@ -337,21 +1185,64 @@ void tool_control_init(rocprofiler_context_id_t& primary_ctx)
 
 int tool_init(rocprofiler_client_finalize_t fini_func, void* tool_data) {
     client_fini_func = fini_func;
+    // forked children stay detached; see process.h
+    process_init();
+    log_init(hip_op_name);
     ROCPROFILER_CALL(rocprofiler_create_context(&client_ctx), "context creation failed");
 
     // enable the control
     tool_control_init(client_ctx);
 
-    rocprofiler_callback_tracing_kind_t kinds[] = {
-        ROCPROFILER_CALLBACK_TRACING_HIP_RUNTIME_API,
-    };
+    // per-device report
+    device_state_init();
+
+    // per-stream queues, host-blocking sync points and missed copy/compute overlap
+    timeline_init(hip_op_name);
+
+    // time spent in our own callbacks, per operation
+    overhead_init(hip_op_name);
+
+    // binary trace of everything forwarded to the analysis
+    trace_init();
+
+    // stage sanalyzer calls for the analysis worker
+    analysis_init();
+
+    // which launches and memory operations reach the analysis
+    sampling_init(hip_op_name);
+
+    // busiest allocations by copy/memset traffic
+    log_add_summary([](FILE* out) { alloc_index().write_report(out, 10); });
+
+    // torch tensors attributed to the segments under them
+    tensor_segments_init();
+
+    // per-launch working sets from kernel arguments, layouts parsed as code objects load
+    kernel_args_init();
+
+    // graph capture and instantiation, replayed node by node at every graph launch
+    graphs_init();
+
+    // name kernels from code-object symbol registration
+    code_object_init();
+
+    // ROCTx ranges: per-range totals and range-scoped analysis
+    marker_init();
+
+    // resolve argument positions of the traced operations once, off the hot path
+    build_arg_layouts();
+
+    // subscribe only to the selected operations; an empty filter means all of them
+    std::vector<rocprofiler_tracing_operation_t> hip_ops = selected_hip_operations();
+    ROCPROFILER_CALL(rocprofiler_configure_callback_tracing_service(
+                    client_ctx, ROCPROFILER_CALLBACK_TRACING_HIP_RUNTIME_API,
+                    hip_ops.empty() ? nullptr : hip_ops.data(), hip_ops.size(),
+                    tool_tracing_callback, tool_data),
+                    "callback tracing service failed to configure");
+
+    // optional kernel dispatch / memory copy completion records
+    buffered_tracing_init(client_ctx);
 
-    for(auto itr : kinds)
-    {
-        ROCPROFILER_CALL(rocprofiler_configure_callback_tracing_service(
-                        client_ctx, itr, nullptr, 0, tool_tracing_callback, tool_data),
-                        "callback tracing service failed to configure");
-    }
     int valid_ctx = 0;
     ROCPROFILER_CALL(rocprofiler_context_is_valid(client_ctx, &valid_ctx),
                      "failure checking context validity");
@@ -366,7 +1257,13 @@ int tool_init(rocprofiler_client_finalize_t fini_func, void* tool_data) {
     return 0;
 }
 
-void tool_fini(void*) {}
+void tool_fini(void*) {
+    // a forked child reports nothing, its records and statistics are the parent's
+    if (process_is_fork_child()) return;
+    buffered_tracing_flush();
+    analysis_shutdown();
+    log_shutdown();
+}
 
 } // namespace
 
@@ -401,6 +1298,9 @@ extern "C" rocprofiler_tool_configure_result_t* rocprofiler_configure(uint32_t v
 
 
 void rocm_cleanup(void) {
+    if (rocm_accelprof::process_is_fork_child()) return;
+    rocm_accelprof::analysis_shutdown();
+    rocm_accelprof::log_shutdown();
     yosemite_terminate();
 }
 
@@ -0,0 +1,202 @@
+#include "sampling.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "env.h"
+#include "logger.h"
+#include "process.h"
+
+namespace rocm_accelprof {
+
+bool sampling_active = false;
+
+namespace {
+
+struct SampleCounter {
+    std::atomic<uint64_t> seen{0};
+    std::atomic<uint64_t> sampled{0};
+};
+
+constexpr uint32_t kChunkBits = 12;
+constexpr uint32_t kChunkMask = (1u << kChunkBits) - 1;
+constexpr uint32_t kMaxChunks = 1024;
+
+// per kernel name id, chunks are published with a CAS and never freed
+std::atomic<SampleCounter*> kernel_chunks[kMaxChunks] = {};
+SampleCounter operation_counters[kMaxLogOps];
+
+uint64_t first_n = UINT64_MAX;
+uint64_t every_k = 1;
+uint64_t duty_on_ns = 0;
+uint64_t duty_period_ns = 0;
+uint64_t event_budget = UINT64_MAX;
+uint64_t byte_budget = UINT64_MAX;
+std::chrono::steady_clock::time_point start_time;
+
+std::atomic<uint64_t> events_used{0};
+std::atomic<uint64_t> bytes_used{0};
+std::atomic<bool> budget_exhausted{false};
+std::atomic<uint64_t> skipped_by_duty{0};
+std::atomic<uint64_t> skipped_by_budget{0};
+
+log_op_name_fn op_name = nullptr;
+
+SampleCounter* kernel_counter(kernel_name_id_t name_id)
+{
+    uint32_t chunk = name_id >> kChunkBits;
+    if (chunk >= kMaxChunks) return nullptr;
+    SampleCounter* counters = kernel_chunks[chunk].load(std::memory_order_acquire);
+    if (counters == nullptr) {
+        auto* fresh = new SampleCounter[kChunkMask + 1];
+        if (kernel_chunks[chunk].compare_exchange_strong(counters, fresh, std::memory_order_acq_rel))
+            counters = fresh;
+        else
+            delete[] fresh;
+    }
+    return &counters[name_id & kChunkMask];
+}
+
+// first N, then 1 in K, on the counter of the kernel or operation
+bool count_decision(SampleCounter* counter)
+{
+    if (counter == nullptr) return true;
+    uint64_t n = counter->seen.fetch_add(1, std::memory_order_relaxed);
+    if (n < first_n) return true;
+    return every_k != 0 && (n - first_n) % every_k == 0;
+}
+
+bool in_duty_window()
+{
+    if (duty_period_ns == 0) return true;
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - start_time).count();
+    return ns % duty_period_ns < duty_on_ns;
+}
+
+bool charge_budget(uint64_t bytes)
+{
+    if (budget_exhausted.load(std::memory_order_relaxed)) return false;
+    bool over = events_used.fetch_add(1, std::memory_order_relaxed) >= event_budget;
+    if (bytes != 0 && !over) over = bytes_used.fetch_add(bytes, std::memory_order_relaxed) + bytes > byte_budget;
+    if (over && !budget_exhausted.exchange(true, std::memory_order_relaxed))
+        fprintf(stderr, "[ROCMPROF INFO] sampling budget exhausted, analysis stops here\n");
+    return !over;
+}
+
+// the counter passed its sampling rule: apply the global duty cycle and budgets
+bool admit(SampleCounter* counter, uint64_t bytes)
+{
+    if (!in_duty_window()) {
+        skipped_by_duty.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if (!charge_budget(bytes)) {
+        skipped_by_budget.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if (counter != nullptr) counter->sampled.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void write_report(FILE* out)
+{
+    uint64_t seen = 0, sampled = 0;
+    std::vector<std::pair<uint64_t, kernel_name_id_t>> kernels;
+    uint32_t num_kernels = kernel_names().size();
+    for (kernel_name_id_t id = 0; id < num_kernels; id++) {
+        SampleCounter* c = kernel_chunks[id >> kChunkBits].load(std::memory_order_acquire);
+        if (c == nullptr) continue;
+        uint64_t n = c[id & kChunkMask].seen.load(std::memory_order_relaxed);
+        if (n == 0) continue;
+        seen += n;
+        sampled += c[id & kChunkMask].sampled.load(std::memory_order_relaxed);
+        kernels.emplace_back(n, id);
+    }
+    fprintf(out, "[ROCMPROF SUMMARY] sampling: %lu of %lu launches analyzed (%lu skipped by duty cycle, "
+                 "%lu by budget)\n",
+            (unsigned long)sampled, (unsigned long)seen,
+            (unsigned long)skipped_by_duty.load(std::memory_order_relaxed),
+            (unsigned long)skipped_by_budget.load(std::memory_order_relaxed));
+    process_report(out, ReportMerge::sum, (double)sampled, "sampling.launches_analyzed");
+    process_report(out, ReportMerge::sum, (double)seen, "sampling.launches");
+    process_report(out, ReportMerge::sum, (double)skipped_by_duty.load(std::memory_order_relaxed),
+                   "sampling.skipped_by_duty_cycle");
+    process_report(out, ReportMerge::sum, (double)skipped_by_budget.load(std::memory_order_relaxed),
+                   "sampling.skipped_by_budget");
+
+    size_t top = std::min<size_t>(10, kernels.size());
+    std::partial_sort(kernels.begin(), kernels.begin() + top, kernels.end(), std::greater<>());
+    for (size_t i = 0; i < top; i++) {
+        const SampleCounter& c = kernel_chunks[kernels[i].second >> kChunkBits].load()[kernels[i].second & kChunkMask];
+        fprintf(out, "[ROCMPROF SUMMARY]   %lu/%lu %s\n", (unsigned long)c.sampled.load(std::memory_order_relaxed),
+                (unsigned long)kernels[i].first, kernel_names().name(kernels[i].second).c_str());
+    }
+    // every kernel, not only the top ones, so the job totals are complete
+    for (const auto& k : kernels) {
+        const SampleCounter& c = kernel_chunks[k.second >> kChunkBits].load()[k.second & kChunkMask];
+        const char* name = kernel_names().name(k.second).c_str();
+        process_report(out, ReportMerge::sum, (double)k.first, "kernel.%s.launches", name);
+        process_report(out, ReportMerge::sum, (double)c.sampled.load(std::memory_order_relaxed),
+                       "kernel.%s.launches_analyzed", name);
+    }
+    for (uint32_t op = 0; op < kMaxLogOps; op++) {
+        uint64_t n = operation_counters[op].seen.load(std::memory_order_relaxed);
+        if (n == 0) continue;
+        const char* name = op_name ? op_name(op) : nullptr;
+        fprintf(out, "[ROCMPROF SUMMARY]   %lu/%lu %s\n",
+                (unsigned long)operation_counters[op].sampled.load(std::memory_order_relaxed), (unsigned long)n,
+                name ? name : "?");
+        process_report(out, ReportMerge::sum, (double)operation_counters[op].sampled.load(std::memory_order_relaxed),
+                       "sampling.%s.analyzed", name ? name : "?");
+        process_report(out, ReportMerge::sum, (double)n, "sampling.%s.calls", name ? name : "?");
+    }
+}
+
+} // namespace
+
+void sampling_init(log_op_name_fn name_fn)
+{
+    op_name = name_fn;
+    first_n = env_u64("ACCELPROF_SAMPLE_FIRST", UINT64_MAX);
+    every_k = env_u64("ACCELPROF_SAMPLE_EVERY", 1);
+    duty_on_ns = env_u64("ACCELPROF_DUTY_ON_MS", 0) * 1000000;
+    duty_period_ns = env_u64("ACCELPROF_DUTY_PERIOD_MS", 0) * 1000000;
+    event_budget = env_u64("ACCELPROF_EVENT_BUDGET", UINT64_MAX);
+    byte_budget = env_u64("ACCELPROF_BYTE_BUDGET", UINT64_MAX);
+    start_time = std::chrono::steady_clock::now();
+
+    if (duty_period_ns != 0 && duty_on_ns >= duty_period_ns) duty_period_ns = 0;
+    // SAMPLE_EVERY alone means 1 in K from the start
+    if (first_n == UINT64_MAX && every_k != 1) first_n = 0;
+
+    sampling_active = first_n != UINT64_MAX || duty_period_ns != 0 || event_budget != UINT64_MAX ||
+                      byte_budget != UINT64_MAX;
+    if (!sampling_active) return;
+
+    fprintf(stdout, "[ROCMPROF INFO] sampling: first %lu, then 1 in %lu; duty %lu/%lu ms; budget %lu events, "
+                    "%lu bytes\n",
+            (unsigned long)first_n, (unsigned long)every_k, (unsigned long)(duty_on_ns / 1000000),
+            (unsigned long)(duty_period_ns / 1000000), (unsigned long)event_budget, (unsigned long)byte_budget);
+    log_add_summary(write_report);
+}
+
+bool sample_kernel_slow(kernel_name_id_t name_id)
+{
+    SampleCounter* counter = kernel_counter(name_id);
+    if (!count_decision(counter)) return false;
+    return admit(counter, 0);
+}
+
+bool sample_operation_slow(uint32_t operation, uint64_t bytes)
+{
+    SampleCounter* counter = operation < kMaxLogOps ? &operation_counters[operation] : nullptr;
+    if (!count_decision(counter)) return false;
+    return admit(counter, bytes);
+}
+
+} // namespace rocm_accelprof
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "kernel_names.h"
+#include "logger.h"
+#include "ranges.h"
+
+// Sampling policy: which launches and memory operations are forwarded to the analysis.
+//
+// Configured from the environment, all off by default (everything is analyzed):
+//   ACCELPROF_SAMPLE_FIRST=N        analyze the first N launches of every kernel (and N
+//                                   calls of every memory operation) ...
+//   ACCELPROF_SAMPLE_EVERY=K        ... then 1 in K of the rest; 0 drops the rest
+//   ACCELPROF_DUTY_ON_MS=A          analyze only during the first A ms ...
+//   ACCELPROF_DUTY_PERIOD_MS=P      ... of every P ms window
+//   ACCELPROF_EVENT_BUDGET=E        stop analyzing after E forwarded events
+//   ACCELPROF_BYTE_BUDGET=B         stop analyzing after B forwarded memcpy/memset bytes
+//
+// Decisions are one fetch_add on a per-kernel (or per-operation) counter; counters live in
+// lazily allocated chunks indexed by interned kernel name id, so no lock is ever taken.
+// Allocations and frees are never sampled out, the analysis must see the full heap.
+// Outside the ROCTx ranges selected by ACCELPROF_RANGES (ranges.h) nothing is sampled in.
+
+namespace rocm_accelprof {
+
+extern bool sampling_active;
+
+// Reads the environment; op_name labels memory operations in the report.
+void sampling_init(log_op_name_fn op_name);
+
+bool sample_kernel_slow(kernel_name_id_t name_id);
+bool sample_operation_slow(uint32_t operation, uint64_t bytes);
+
+// True when the launch of this kernel should be analyzed.
+inline bool sample_kernel(kernel_name_id_t name_id)
+{
+    return range_selected() && (!sampling_active || sample_kernel_slow(name_id));
+}
+
+// True when this memory operation (moving bytes) should be analyzed.
+inline bool sample_operation(uint32_t operation, uint64_t bytes)
+{
+    return range_selected() && (!sampling_active || sample_operation_slow(operation, bytes));
+}
+
+} // namespace rocm_accelprof
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+
+#include "analysis_event.h"
+#include "sanalyzer.h"
+
+// The one mapping from a staged event to its sanalyzer callback, shared by the analysis
+// worker and the offline replay driver (tools/accelprof_replay.cpp) so that a replayed
+// trace drives sanalyzer with exactly the calls the live backend made.
+
+// Working-set buffers have no callback in sanalyzer's interface yet; the hook is
+// referenced weakly, and until a build provides it the events are only staged for the
+// trace. A launch's buffers are always forwarded immediately before its kernel start,
+// with nothing in between, so the hook needs no correlation ID to pair them up.
+void yosemite_kernel_buffer_callback(uint64_t ptr, uint64_t size, uint32_t arg_index, int device_id)
+    __attribute__((weak));
+
+namespace rocm_accelprof {
+
+inline bool sanalyzer_takes_kernel_buffers()
+{
+    return yosemite_kernel_buffer_callback != nullptr;
+}
+
+// kernel_name(id) returns the name of an interned kernel name id.
+template <typename KernelName>
+inline void forward_to_sanalyzer(const AnalysisEvent& ev, KernelName&& kernel_name)
+{
+    switch (ev.type) {
+        case EventType::alloc:
+            yosemite_alloc_callback(ev.a, ev.b, (int)ev.arg, ev.device);
+            break;
+        case EventType::free:
+            yosemite_free_callback(ev.a, ev.b, 0, ev.device);
+            break;
+        case EventType::memcpy:
+            yosemite_memcpy_callback(ev.a, ev.b, ev.c, ev.is_async, ev.arg, ev.device);
+            break;
+        case EventType::memset:
+            yosemite_memset_callback(ev.a, (uint32_t)ev.b, (int)ev.arg, ev.is_async, ev.device);
+            break;
+        case EventType::kernel_start:
+            // the interned name is copied only here, sanalyzer takes it by value
+            yosemite_kernel_start_callback(kernel_name(ev.arg), ev.device);
+            break;
+        case EventType::kernel_end:
+            yosemite_kernel_end_callback(ev.device);
+            break;
+        case EventType::kernel_buffer:
+            if (yosemite_kernel_buffer_callback) yosemite_kernel_buffer_callback(ev.a, ev.b, ev.arg, ev.device);
+            break;
+        case EventType::memcpy_end:
+            // sanalyzer models a copy at its API call and has no completion callback; the
+            // device times only go to the trace
+            break;
+    }
+}
+
+} // namespace rocm_accelprof
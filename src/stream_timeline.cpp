@@ -0,0 +1,674 @@
+#include "stream_timeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "device_state.h"
+#include "env.h"
+#include "process.h"
+
+namespace rocm_accelprof {
+
+bool timeline_active = false;
+thread_local bool tls_host_waiting = false;
+
+namespace {
+
+constexpr size_t kMaxQueued = 1u << 16;
+constexpr uint32_t kStreamNonBlocking = 0x1;   // hipStreamNonBlocking
+
+enum class StreamKind : uint8_t { blocking, non_blocking, null };
+
+struct StreamState;
+
+struct QueuedOp {
+    uint64_t position;
+    TimelineOp op;
+    StreamState* waits_for;        // TimelineOp::wait only
+    uint64_t waits_for_position;
+};
+
+struct StreamState {
+    const void* handle = nullptr;
+    int device = 0;
+    StreamKind kind = StreamKind::blocking;
+    uint64_t issued = 0;           // last position handed out
+    uint64_t drained = 0;          // known complete up to here
+    uint64_t null_ordered = 0;     // position the null stream already waits for
+    std::deque<QueuedOp> queue;
+    uint32_t queued_kernels = 0;
+    uint64_t busy_since = 0;
+    uint64_t busy_ns = 0;
+    uint64_t ops[kNumTimelineOps] = {};
+    uint64_t bytes[kNumTimelineOps] = {};
+    size_t max_queued = 0;
+    uint64_t overflow = 0;         // ops assumed complete to bound the queue
+};
+
+struct OverlapStats {
+    uint64_t sync_copies = 0;           // synchronous host copies while kernels were queued
+    uint64_t sync_copy_bytes = 0;
+    uint64_t queued_copies = 0;         // async host copies behind kernels on the only busy stream
+    uint64_t queued_copy_bytes = 0;
+    uint64_t null_serializations = 0;   // null-stream work ordered after busy streams
+    uint64_t serialized_streams = 0;
+    uint64_t pageable_copies = 0;       // async copies from or to pageable memory
+    uint64_t pageable_bytes = 0;
+};
+
+// Streams of one device. Waits queued on a stream of another device are drained after
+// the lock is released, so no two device locks are ever held at once.
+struct DeviceTimeline {
+    std::mutex mutex;
+    std::unordered_map<const void*, StreamState*> streams;   // the null stream under nullptr
+    std::vector<StreamState*> retired;                         // destroyed, kept for the report
+    uint32_t busy_streams = 0;
+    uint32_t busy_blocking = 0;                                // blocking streams, null excluded
+    uint32_t queued_kernels = 0;
+    OverlapStats overlap;
+};
+
+struct Drain {
+    StreamState* stream;
+    uint64_t position;
+};
+
+struct EventMark {
+    StreamState* stream;
+    uint64_t position;
+};
+
+struct SyncPoint {
+    uint64_t count = 0;
+    uint64_t idle = 0;                  // nothing was outstanding
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+};
+
+// (operation, device, stream, device-wide)
+using SyncKey = std::tuple<uint32_t, int, const void*, bool>;
+
+struct HostWait {
+    SyncKey key;
+    uint64_t start_ns = 0;
+    bool outstanding = false;
+    std::vector<Drain> targets;
+};
+
+DeviceTimeline timelines[kMaxDevices];
+
+std::mutex event_mutex;
+std::unordered_map<const void*, EventMark> events;
+
+std::mutex sync_mutex;
+std::map<SyncKey, SyncPoint> sync_points;
+
+thread_local HostWait tls_wait;
+
+log_op_name_fn op_name_fn = nullptr;
+uint64_t start_ns = 0;
+
+uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int device_index(int device)
+{
+    return (device < 0 || device >= kMaxDevices) ? 0 : device;
+}
+
+StreamState* stream_locked(DeviceTimeline& t, const void* handle, int device)
+{
+    auto it = t.streams.find(handle);
+    if (it != t.streams.end()) return it->second;
+    // streams created before we attached are taken as blocking
+    auto* s = new StreamState();
+    s->handle = handle;
+    s->device = device;
+    s->kind = handle == nullptr ? StreamKind::null : StreamKind::blocking;
+    t.streams.emplace(handle, s);
+    return s;
+}
+
+// Marks s complete up to position; waits queued on s complete what they wait for.
+void drain_locked(DeviceTimeline& t, StreamState* s, uint64_t position, uint64_t now, std::vector<Drain>& remote)
+{
+    if (position <= s->drained) return;
+    s->drained = position;
+    bool was_busy = !s->queue.empty();
+    while (!s->queue.empty() && s->queue.front().position <= position) {
+        QueuedOp op = s->queue.front();
+        s->queue.pop_front();
+        if (op.op == TimelineOp::kernel) {
+            s->queued_kernels--;
+            t.queued_kernels--;
+        }
+        if (op.waits_for == nullptr) continue;
+        if (op.waits_for->device == s->device) drain_locked(t, op.waits_for, op.waits_for_position, now, remote);
+        else remote.push_back({op.waits_for, op.waits_for_position});
+    }
+    if (was_busy && s->queue.empty()) {
+        s->busy_ns += now - s->busy_since;
+        t.busy_streams--;
+        if (s->kind == StreamKind::blocking) t.busy_blocking--;
+    }
+}
+
+// Drains pending entries, and whatever they unblock, device by device. No lock held.
+void drain_all(std::vector<Drain>& pending, uint64_t now)
+{
+    while (!pending.empty()) {
+        Drain d = pending.back();
+        pending.pop_back();
+        DeviceTimeline& t = timelines[d.stream->device];
+        std::lock_guard<std::mutex> lock(t.mutex);
+        drain_locked(t, d.stream, d.position, now, pending);
+    }
+}
+
+uint64_t push_locked(DeviceTimeline& t, StreamState* s, TimelineOp op, uint64_t bytes, StreamState* waits_for,
+                     uint64_t waits_for_position, uint64_t now, std::vector<Drain>& remote)
+{
+    if (s->queue.size() >= kMaxQueued) {
+        s->overflow++;
+        drain_locked(t, s, s->queue.front().position, now, remote);
+    }
+    if (s->queue.empty()) {
+        s->busy_since = now;
+        t.busy_streams++;
+        if (s->kind == StreamKind::blocking) t.busy_blocking++;
+    }
+    uint64_t position = ++s->issued;
+    s->queue.push_back({position, op, waits_for, waits_for_position});
+    s->max_queued = std::max(s->max_queued, s->queue.size());
+    s->ops[(uint32_t)op]++;
+    s->bytes[(uint32_t)op] += bytes;
+    if (op == TimelineOp::kernel) {
+        s->queued_kernels++;
+        t.queued_kernels++;
+    }
+    return position;
+}
+
+// Legacy null-stream semantics: work on the null stream waits for every blocking stream
+// of its device, and work on a blocking stream waits for the null stream.
+void order_against_null_locked(DeviceTimeline& t, StreamState* s, bool count, uint64_t now,
+                               std::vector<Drain>& remote)
+{
+    if (s->kind == StreamKind::null) {
+        if (t.busy_blocking == 0) return;
+        uint32_t serialized = 0;
+        for (auto& entry : t.streams) {
+            StreamState* other = entry.second;
+            if (other->kind != StreamKind::blocking || other->queue.empty()) continue;
+            if (other->null_ordered == other->issued) continue;
+            other->null_ordered = other->issued;
+            push_locked(t, s, TimelineOp::wait, 0, other, other->issued, now, remote);
+            serialized++;
+        }
+        if (count && serialized != 0) {
+            t.overlap.null_serializations++;
+            t.overlap.serialized_streams += serialized;
+        }
+    } else if (s->kind == StreamKind::blocking) {
+        auto it = t.streams.find(nullptr);
+        if (it == t.streams.end() || it->second->queue.empty()) return;
+        StreamState* null_stream = it->second;
+        if (!s->queue.empty() && s->queue.back().waits_for == null_stream &&
+            s->queue.back().waits_for_position == null_stream->issued) return;
+        push_locked(t, s, TimelineOp::wait, 0, null_stream, null_stream->issued, now, remote);
+    }
+}
+
+void add_target_locked(HostWait& wait, StreamState* s)
+{
+    if (s->queue.empty()) return;
+    wait.targets.push_back({s, s->issued});
+    wait.outstanding = true;
+}
+
+// Targets are added by the caller before the wait is armed.
+HostWait& begin_wait(uint32_t operation, int device, const void* stream, bool device_wide, uint64_t now)
+{
+    HostWait& wait = tls_wait;
+    wait.key = SyncKey{operation, device, stream, device_wide};
+    wait.start_ns = now;
+    wait.outstanding = false;
+    wait.targets.clear();
+    return wait;
+}
+
+const char* stream_kind_name(StreamKind kind)
+{
+    switch (kind) {
+        case StreamKind::null: return "null";
+        case StreamKind::non_blocking: return "non-blocking";
+        default: return "blocking";
+    }
+}
+
+struct StreamRow {
+    int device;
+    const void* handle;
+    StreamKind kind;
+    bool retired;
+    uint64_t busy_ns;
+    uint64_t ops[kNumTimelineOps];
+    uint64_t bytes[kNumTimelineOps];
+    size_t max_queued;
+    uint64_t overflow;
+};
+
+void write_report(FILE* out)
+{
+    uint64_t now = now_ns();
+    double window_ms = (double)(now - start_ns) / 1e6;
+
+    std::vector<StreamRow> rows;
+    std::vector<std::pair<int, OverlapStats>> overlap;
+    for (int d = 0; d < kMaxDevices; d++) {
+        DeviceTimeline& t = timelines[d];
+        std::lock_guard<std::mutex> lock(t.mutex);
+        auto add_row = [&](const StreamState* s, bool retired) {
+            if (s->issued == 0) return;
+            StreamRow row{d, s->handle, s->kind, retired, s->busy_ns, {}, {}, s->max_queued, s->overflow};
+            if (!s->queue.empty()) row.busy_ns += now - s->busy_since;
+            std::copy(s->ops, s->ops + kNumTimelineOps, row.ops);
+            std::copy(s->bytes, s->bytes + kNumTimelineOps, row.bytes);
+            rows.push_back(row);
+        };
+        for (const auto& entry : t.streams) add_row(entry.second, false);
+        for (const StreamState* s : t.retired) add_row(s, true);
+        overlap.emplace_back(d, t.overlap);
+    }
+
+    std::vector<std::pair<SyncKey, SyncPoint>> points;
+    {
+        std::lock_guard<std::mutex> lock(sync_mutex);
+        points.assign(sync_points.begin(), sync_points.end());
+    }
+    if (rows.empty() && points.empty()) return;
+
+    uint64_t waits = 0, blocked_ns = 0;
+    for (const auto& p : points) {
+        waits += p.second.count;
+        blocked_ns += p.second.total_ns;
+    }
+    fprintf(out, "[ROCMPROF SUMMARY] stream timeline: %zu streams over %.3f ms, host blocked %.3f ms (%.1f%%) "
+                 "in %lu waits\n",
+            rows.size(), window_ms, (double)blocked_ns / 1e6,
+            window_ms > 0 ? 100.0 * (double)blocked_ns / 1e6 / window_ms : 0.0, (unsigned long)waits);
+    // stream handles are per process: streams merge by device
+    process_report(out, ReportMerge::sum, (double)blocked_ns, "timeline.host_blocked_ns");
+    process_report(out, ReportMerge::sum, (double)waits, "timeline.waits");
+    process_report_mean(out, (double)blocked_ns / 1e6 / window_ms, window_ms, "timeline.host_blocked_share");
+    for (const StreamRow& r : rows) {
+        process_report(out, ReportMerge::sum, (double)r.busy_ns, "timeline.device.%d.stream_outstanding_ns",
+                       r.device);
+        process_report(out, ReportMerge::sum, (double)r.ops[(uint32_t)TimelineOp::kernel],
+                       "timeline.device.%d.kernels", r.device);
+        process_report(out, ReportMerge::max, (double)r.max_queued, "timeline.device.%d.max_queued", r.device);
+    }
+
+    std::sort(rows.begin(), rows.end(),
+              [](const StreamRow& a, const StreamRow& b) { return a.busy_ns > b.busy_ns; });
+    constexpr size_t kTopStreams = 16;
+    for (size_t i = 0; i < std::min(rows.size(), kTopStreams); i++) {
+        const StreamRow& r = rows[i];
+        uint64_t copies = r.ops[(uint32_t)TimelineOp::copy_h2d] + r.ops[(uint32_t)TimelineOp::copy_d2h] +
+                          r.ops[(uint32_t)TimelineOp::copy_d2d] + r.ops[(uint32_t)TimelineOp::copy_h2h];
+        fprintf(out, "[ROCMPROF SUMMARY]   device %d stream 0x%lx (%s%s): outstanding %.1f%% (%.3f ms), "
+                     "%lu kernels, %lu copies (H2D %lu, D2H %lu, D2D %lu, H2H %lu bytes), %lu memsets, "
+                     "%lu waits, max %zu queued\n",
+                r.device, (unsigned long)(uintptr_t)r.handle, stream_kind_name(r.kind), r.retired ? ", destroyed" : "",
+                window_ms > 0 ? 100.0 * (double)r.busy_ns / 1e6 / window_ms : 0.0, (double)r.busy_ns / 1e6,
+                (unsigned long)r.ops[(uint32_t)TimelineOp::kernel], (unsigned long)copies,
+                (unsigned long)r.bytes[(uint32_t)TimelineOp::copy_h2d],
+                (unsigned long)r.bytes[(uint32_t)TimelineOp::copy_d2h],
+                (unsigned long)r.bytes[(uint32_t)TimelineOp::copy_d2d],
+                (unsigned long)r.bytes[(uint32_t)TimelineOp::copy_h2h],
+                (unsigned long)r.ops[(uint32_t)TimelineOp::memset], (unsigned long)r.ops[(uint32_t)TimelineOp::wait],
+                r.max_queued);
+        if (r.overflow != 0)
+            fprintf(out, "[ROCMPROF SUMMARY]     %lu operations assumed complete to bound the queue\n",
+                    (unsigned long)r.overflow);
+    }
+    if (rows.size() > kTopStreams)
+        fprintf(out, "[ROCMPROF SUMMARY]   ... and %zu more streams\n", rows.size() - kTopStreams);
+
+    if (!points.empty()) {
+        std::sort(points.begin(), points.end(),
+                  [](const auto& a, const auto& b) { return a.second.total_ns > b.second.total_ns; });
+        fprintf(out, "[ROCMPROF SUMMARY] host-blocking sync points:\n");
+        for (size_t i = 0; i < std::min<size_t>(points.size(), 10); i++) {
+            const SyncKey& key = points[i].first;
+            const SyncPoint& p = points[i].second;
+            const char* name = op_name_fn ? op_name_fn(std::get<0>(key)) : nullptr;
+            char where[64];
+            if (std::get<3>(key)) snprintf(where, sizeof(where), "device %d", std::get<1>(key));
+            else snprintf(where, sizeof(where), "device %d stream 0x%lx", std::get<1>(key),
+                          (unsigned long)(uintptr_t)std::get<2>(key));
+            fprintf(out, "[ROCMPROF SUMMARY]   %s %s: %lu waits, %.3f ms blocked (max %.3f ms), "
+                         "%lu with nothing outstanding\n",
+                    name ? name : "unknown", where, (unsigned long)p.count, (double)p.total_ns / 1e6,
+                    (double)p.max_ns / 1e6, (unsigned long)p.idle);
+        }
+    }
+    for (const auto& point : points) {
+        const SyncKey& key = point.first;
+        const SyncPoint& p = point.second;
+        const char* name = op_name_fn ? op_name_fn(std::get<0>(key)) : nullptr;
+        int device = std::get<1>(key);
+        if (name == nullptr) name = "unknown";
+        process_report(out, ReportMerge::sum, (double)p.count, "sync.%s.device.%d.waits", name, device);
+        process_report(out, ReportMerge::sum, (double)p.total_ns, "sync.%s.device.%d.blocked_ns", name, device);
+        process_report(out, ReportMerge::max, (double)p.max_ns, "sync.%s.device.%d.max_blocked_ns", name, device);
+        process_report(out, ReportMerge::sum, (double)p.idle, "sync.%s.device.%d.idle_waits", name, device);
+    }
+
+    for (const auto& entry : overlap) {
+        const OverlapStats& o = entry.second;
+        if (o.sync_copies == 0 && o.queued_copies == 0 && o.null_serializations == 0 && o.pageable_copies == 0)
+            continue;
+        fprintf(out, "[ROCMPROF SUMMARY] missed copy/compute overlap on device %d:\n", entry.first);
+        if (o.sync_copies != 0)
+            fprintf(out, "[ROCMPROF SUMMARY]   %lu synchronous host copies (%lu bytes) while kernels were queued\n",
+                    (unsigned long)o.sync_copies, (unsigned long)o.sync_copy_bytes);
+        if (o.queued_copies != 0)
+            fprintf(out, "[ROCMPROF SUMMARY]   %lu async host copies (%lu bytes) queued behind kernels on the "
+                         "only busy stream\n",
+                    (unsigned long)o.queued_copies, (unsigned long)o.queued_copy_bytes);
+        if (o.null_serializations != 0)
+            fprintf(out, "[ROCMPROF SUMMARY]   %lu null-stream operations serialized behind %lu busy streams\n",
+                    (unsigned long)o.null_serializations, (unsigned long)o.serialized_streams);
+        if (o.pageable_copies != 0)
+            fprintf(out, "[ROCMPROF SUMMARY]   %lu async copies (%lu bytes) through pageable host memory\n",
+                    (unsigned long)o.pageable_copies, (unsigned long)o.pageable_bytes);
+        int d = entry.first;
+        process_report(out, ReportMerge::sum, (double)o.sync_copies, "overlap.device.%d.sync_copies", d);
+        process_report(out, ReportMerge::sum, (double)o.sync_copy_bytes, "overlap.device.%d.sync_copy_bytes", d);
+        process_report(out, ReportMerge::sum, (double)o.queued_copies, "overlap.device.%d.queued_copies", d);
+        process_report(out, ReportMerge::sum, (double)o.queued_copy_bytes, "overlap.device.%d.queued_copy_bytes", d);
+        process_report(out, ReportMerge::sum, (double)o.null_serializations,
+                       "overlap.device.%d.null_stream_serializations", d);
+        process_report(out, ReportMerge::sum, (double)o.pageable_copies, "overlap.device.%d.pageable_copies", d);
+        process_report(out, ReportMerge::sum, (double)o.pageable_bytes, "overlap.device.%d.pageable_bytes", d);
+    }
+}
+
+} // namespace
+
+void timeline_init(log_op_name_fn op_name)
+{
+    timeline_active = env_bool("ACCELPROF_TIMELINE", true);
+    if (!timeline_active) return;
+    op_name_fn = op_name;
+    start_ns = now_ns();
+    log_add_summary(write_report);
+}
+
+void timeline_stream_created(const void* stream, int device, uint32_t flags)
+{
+    if (!timeline_active || stream == nullptr) return;
+    int d = device_index(device);
+    DeviceTimeline& t = timelines[d];
+    std::lock_guard<std::mutex> lock(t.mutex);
+    // a handle we still know was destroyed while the client context was paused
+    auto it = t.streams.find(stream);
+    if (it != t.streams.end()) {
+        t.retired.push_back(it->second);
+        t.streams.erase(it);
+    }
+    stream_locked(t, stream, d)->kind = (flags & kStreamNonBlocking) ? StreamKind::non_blocking
+                                                                    : StreamKind::blocking;
+}
+
+// hipStreamDestroy returns at once and releases the stream once its work is done; it
+// closes the stream's outstanding interval here.
+void timeline_stream_destroyed(const void* stream, int device)
+{
+    if (!timeline_active || stream == nullptr) return;
+    uint64_t now = now_ns();
+    std::vector<Drain> remote;
+    DeviceTimeline& t = timelines[device_index(device)];
+    {
+        std::lock_guard<std::mutex> lock(t.mutex);
+        auto it = t.streams.find(stream);
+        if (it == t.streams.end()) return;
+        StreamState* s = it->second;
+        drain_locked(t, s, s->issued, now, remote);
+        t.streams.erase(it);
+        t.retired.push_back(s);
+    }
+    drain_all(remote, now);
+}
+
+void timeline_launch(const void* stream, int device)
+{
+    if (!timeline_active) return;
+    uint64_t now = now_ns();
+    std::vector<Drain> remote;
+    int d = device_index(device);
+    DeviceTimeline& t = timelines[d];
+    {
+        std::lock_guard<std::mutex> lock(t.mutex);
+        StreamState* s = stream_locked(t, stream, d);
+        order_against_null_locked(t, s, true, now, remote);
+        push_locked(t, s, TimelineOp::kernel, 0, nullptr, 0, now, remote);
+    }
+    drain_all(remote, now);
+}
+
+void timeline_copy(uint32_t operation, const void* stream, int device, TimelineOp op, uint64_t bytes,
+                   bool async, bool pageable)
+{
+    if (!timeline_active) return;
+    uint64_t now = now_ns();
+    std::vector<Drain> remote;
+    int d = device_index(device);
+    DeviceTimeline& t = timelines[d];
+    {
+        std::lock_guard<std::mutex> lock(t.mutex);
+        StreamState* s = stream_locked(t, stream, d);
+        bool host_copy = op == TimelineOp::copy_h2d || op == TimelineOp::copy_d2h;
+        if (host_copy && !async && t.queued_kernels != 0) {
+            t.overlap.sync_copies++;
+            t.overlap.sync_copy_bytes += bytes;
+        }
+        if (host_copy && async && s->queued_kernels != 0 && t.busy_streams == 1) {
+            t.overlap.queued_copies++;
+            t.overlap.queued_copy_bytes += bytes;
+        }
+        if (host_copy && async && pageable) {
+            t.overlap.pageable_copies++;
+            t.overlap.pageable_bytes += bytes;
+        }
+        order_against_null_locked(t, s, true, now, remote);
+        uint64_t position = push_locked(t, s, op, bytes, nullptr, 0, now, remote);
+
+        // the runtime returns from a pageable device-to-host copy once it is done; a
+        // pageable host-to-device copy returns once staged, which completes nothing
+        if (!async || (host_copy && pageable)) {
+            HostWait& wait = begin_wait(operation, d, stream, false, now);
+            wait.outstanding = true;
+            if (!async || op == TimelineOp::copy_d2h) wait.targets.push_back({s, position});
+            tls_host_waiting = true;
+        }
+    }
+    drain_all(remote, now);
+}
+
+void timeline_memset(const void* stream, int device, uint64_t bytes)
+{
+    if (!timeline_active) return;
+    uint64_t now = now_ns();
+    std::vector<Drain> remote;
+    int d = device_index(device);
+    DeviceTimeline& t = timelines[d];
+    {
+        std::lock_guard<std::mutex> lock(t.mutex);
+        StreamState* s = stream_locked(t, stream, d);
+        order_against_null_locked(t, s, true, now, remote);
+        push_locked(t, s, TimelineOp::memset, bytes, nullptr, 0, now, remote);
+    }
+    drain_all(remote, now);
+}
+
+void timeline_event_record(const void* event, const void* stream, int device)
+{
+    if (!timeline_active || event == nullptr) return;
+    uint64_t now = now_ns();
+    std::vector<Drain> remote;
+    int d = device_index(device);
+    DeviceTimeline& t = timelines[d];
+    EventMark mark;
+    {
+        std::lock_guard<std::mutex> lock(t.mutex);
+        StreamState* s = stream_locked(t, stream, d);
+        order_against_null_locked(t, s, false, now, remote);
+        mark = EventMark{s, s->issued};
+    }
+    drain_all(remote, now);
+    std::lock_guard<std::mutex> lock(event_mutex);
+    events[event] = mark;
+}
+
+void timeline_stream_wait_event(const void* stream, int device, const void* event)
+{
+    if (!timeline_active || event == nullptr) return;
+    EventMark mark{nullptr, 0};
+    {
+        std::lock_guard<std::mutex> lock(event_mutex);
+        auto it = events.find(event);
+        if (it != events.end()) mark = it->second;
+    }
+    if (mark.stream == nullptr || mark.position == 0) return;
+
+    uint64_t now = now_ns();
+    std::vector<Drain> remote;
+    int d = device_index(device);
+    DeviceTimeline& t = timelines[d];
+    {
+        std::lock_guard<std::mutex> lock(t.mutex);
+        StreamState* s = stream_locked(t, stream, d);
+        if (s != mark.stream) push_locked(t, s, TimelineOp::wait, 0, mark.stream, mark.position, now, remote);
+    }
+    drain_all(remote, now);
+}
+
+void timeline_event_destroyed(const void* event)
+{
+    if (!timeline_active) return;
+    std::lock_guard<std::mutex> lock(event_mutex);
+    events.erase(event);
+}
+
+void timeline_wait_stream(uint32_t operation, const void* stream, int device)
+{
+    if (!timeline_active) return;
+    int d = device_index(device);
+    DeviceTimeline& t = timelines[d];
+    HostWait& wait = begin_wait(operation, d, stream, false, now_ns());
+    {
+        std::lock_guard<std::mutex> lock(t.mutex);
+        StreamState* s = stream_locked(t, stream, d);
+        add_target_locked(wait, s);
+        // synchronizing the legacy null stream also waits for the blocking streams
+        if (s->kind == StreamKind::null) {
+            for (auto& entry : t.streams)
+                if (entry.second->kind == StreamKind::blocking) add_target_locked(wait, entry.second);
+        }
+    }
+    tls_host_waiting = true;
+}
+
+void timeline_wait_device(uint32_t operation, int device)
+{
+    if (!timeline_active) return;
+    int d = device_index(device);
+    DeviceTimeline& t = timelines[d];
+    HostWait& wait = begin_wait(operation, d, nullptr, true, now_ns());
+    {
+        std::lock_guard<std::mutex> lock(t.mutex);
+        for (auto& entry : t.streams) add_target_locked(wait, entry.second);
+    }
+    tls_host_waiting = true;
+}
+
+void timeline_wait_event(uint32_t operation, const void* event)
+{
+    if (!timeline_active) return;
+    uint64_t now = now_ns();
+    EventMark mark{nullptr, 0};
+    {
+        std::lock_guard<std::mutex> lock(event_mutex);
+        auto it = events.find(event);
+        if (it != events.end()) mark = it->second;
+    }
+    int d = mark.stream ? mark.stream->device : 0;
+    HostWait& wait = begin_wait(operation, d, mark.stream ? mark.stream->handle : nullptr, false, now);
+    if (mark.stream != nullptr) {
+        std::lock_guard<std::mutex> lock(timelines[d].mutex);
+        if (mark.position > mark.stream->drained) {
+            wait.targets.push_back({mark.stream, mark.position});
+            wait.outstanding = true;
+        }
+    }
+    tls_host_waiting = true;
+}
+
+void timeline_host_wait_end(bool ok)
+{
+    tls_host_waiting = false;
+    HostWait& wait = tls_wait;
+    uint64_t now = now_ns();
+    uint64_t ns = now - wait.start_ns;
+    if (ok) drain_all(wait.targets, now);
+    wait.targets.clear();
+
+    std::lock_guard<std::mutex> lock(sync_mutex);
+    SyncPoint& p = sync_points[wait.key];
+    p.count++;
+    if (!wait.outstanding) p.idle++;
+    p.total_ns += ns;
+    p.max_ns = std::max(p.max_ns, ns);
+}
+
+void timeline_stream_idle(const void* stream, int device)
+{
+    if (!timeline_active) return;
+    uint64_t now = now_ns();
+    std::vector<Drain> remote;
+    int d = device_index(device);
+    DeviceTimeline& t = timelines[d];
+    {
+        std::lock_guard<std::mutex> lock(t.mutex);
+        StreamState* s = stream_locked(t, stream, d);
+        drain_locked(t, s, s->issued, now, remote);
+    }
+    drain_all(remote, now);
+}
+
+void timeline_event_complete(const void* event)
+{
+    if (!timeline_active) return;
+    std::vector<Drain> pending;
+    {
+        std::lock_guard<std::mutex> lock(event_mutex);
+        auto it = events.find(event);
+        if (it == events.end()) return;
+        pending.push_back({it->second.stream, it->second.position});
+    }
+    drain_all(pending, now_ns());
+}
+
+} // namespace rocm_accelprof
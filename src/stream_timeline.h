@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+
+#include "logger.h"
+
+// Stream-aware timeline of the work the host enqueues, for copy/compute overlap analysis.
+//
+// Every launch, copy and memset is appended to the ordered queue of its stream. The host
+// only learns that work has finished from the calls that wait for it: hipStreamSynchronize,
+// hipDeviceSynchronize, hipEventSynchronize, synchronous copies, and hipStreamQuery or
+// hipEventQuery returning success. hipEventRecord marks a position in a stream and
+// hipStreamWaitEvent queues a wait for that position on another stream, so draining the
+// waiting stream past it drains the recorded one as well. The legacy null stream is
+// ordered against the blocking streams of its device the same way.
+//
+// The report gives, per stream, how long it had work outstanding (occupancy as the host
+// sees it, an upper bound of device time), the host-blocking sync points by operation and
+// stream, and the copy/compute overlap given away: synchronous copies while kernels are in
+// flight, async copies queued behind kernels on the only busy stream of a device, work on
+// the null stream that serializes other streams, and async copies from pageable memory,
+// which the runtime stages synchronously.
+//
+// On by default; ACCELPROF_TIMELINE=0 disables it.
+
+namespace rocm_accelprof {
+
+enum class TimelineOp : uint8_t {
+    kernel = 0,
+    copy_h2d,
+    copy_d2h,
+    copy_d2d,
+    copy_h2h,
+    memset,
+    wait,       // the stream waits for a position of another stream
+};
+constexpr uint32_t kNumTimelineOps = 7;
+
+// Set once by timeline_init, read-only afterwards.
+extern bool timeline_active;
+
+// True while the calling thread is inside a call that blocks on the device.
+extern thread_local bool tls_host_waiting;
+
+void timeline_init(log_op_name_fn op_name);
+
+// flags as passed to hipStreamCreateWithFlags
+void timeline_stream_created(const void* stream, int device, uint32_t flags);
+void timeline_stream_destroyed(const void* stream, int device);
+
+// Work enqueued on a stream of device. A synchronous copy also starts a host wait for
+// it; operation names the call in the sync point report.
+void timeline_launch(const void* stream, int device);
+void timeline_copy(uint32_t operation, const void* stream, int device, TimelineOp op, uint64_t bytes,
+                   bool async, bool pageable);
+void timeline_memset(const void* stream, int device, uint64_t bytes);
+
+void timeline_event_record(const void* event, const void* stream, int device);
+void timeline_stream_wait_event(const void* stream, int device, const void* event);
+void timeline_event_destroyed(const void* event);
+
+// Host waits. The handler of a blocking call starts the wait on ENTER with what it waits
+// for; the tracing callback ends it on EXIT while tls_host_waiting is set, and ok says
+// whether the call succeeded, i.e. whether the work waited for is known complete.
+void timeline_wait_stream(uint32_t operation, const void* stream, int device);
+void timeline_wait_device(uint32_t operation, int device);
+void timeline_wait_event(uint32_t operation, const void* event);
+void timeline_host_wait_end(bool ok);
+
+// Successful queries: the work is known complete without a wait.
+void timeline_stream_idle(const void* stream, int device);
+void timeline_event_complete(const void* event);
+
+} // namespace rocm_accelprof
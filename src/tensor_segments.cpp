@@ -0,0 +1,262 @@
+#include "tensor_segments.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "device_state.h"
+#include "env.h"
+#include "logger.h"
+#include "process.h"
+
+namespace rocm_accelprof {
+
+namespace {
+
+constexpr size_t kMaxCurveSamples = 4096;
+constexpr uint64_t kFirstSampleIntervalNs = 1000000;
+
+struct TensorRecord {
+    uint64_t segment_id;
+    uint64_t bytes;
+};
+
+struct Segment {
+    uint64_t base = 0;
+    uint64_t size = 0;
+    int32_t device = 0;
+    uint32_t tensors = 0;
+    uint64_t bytes = 0;
+};
+
+struct CurveSample {
+    uint64_t time_ns;
+    int64_t allocated;      // caching allocator totals
+    int64_t reserved;
+    uint64_t pinned;        // bytes of segments holding at least one tensor
+    uint64_t idle;          // of those, not covered by a tensor
+};
+
+struct DeviceTensors {
+    uint64_t live_tensors = 0;
+    uint64_t pinned = 0;
+    uint64_t idle = 0;
+    uint64_t unmatched = 0;  // tensors outside every known segment
+    double peak_fragmentation = 0;
+    uint64_t sample_interval_ns = kFirstSampleIntervalNs;
+    uint64_t last_sample_ns = 0;
+    std::vector<CurveSample> curve;
+};
+
+std::mutex mutex;  // guards everything below; tensor events arrive in batches
+std::unordered_map<uint64_t, TensorRecord> tensors;    // by tensor address
+std::unordered_map<uint64_t, Segment> segments;        // by allocation id, only those holding tensors
+DeviceTensors devices[kMaxDevices];
+std::string curve_path;
+uint64_t start_ns = 0;  // steady clock
+
+DeviceTensors& device_tensors(int device)
+{
+    return devices[(device < 0 ? 0 : device) % kMaxDevices];
+}
+
+double fragmentation(uint64_t pinned, uint64_t idle)
+{
+    return pinned ? (double)idle / (double)pinned : 0.0;
+}
+
+// Moves a segment's contribution to its device's pinned/idle totals around an update.
+template <typename F>
+void update_segment(Segment& s, F&& change)
+{
+    DeviceTensors& d = device_tensors(s.device);
+    if (s.tensors != 0) {
+        d.pinned -= s.size;
+        d.idle -= s.size - std::min(s.bytes, s.size);
+    }
+    change(s);
+    if (s.tensors != 0) {
+        d.pinned += s.size;
+        d.idle += s.size - std::min(s.bytes, s.size);
+    }
+}
+
+void sample(int device, int64_t allocated, int64_t reserved, uint64_t time_ns)
+{
+    DeviceTensors& d = device_tensors(device);
+    d.peak_fragmentation = std::max(d.peak_fragmentation, fragmentation(d.pinned, d.idle));
+    if (curve_path.empty()) return;
+
+    // threads stamp and number their events separately, so the times may step back a little
+    uint64_t now = std::max(time_ns > start_ns ? time_ns - start_ns : 0, d.last_sample_ns);
+    if (!d.curve.empty() && now - d.last_sample_ns < d.sample_interval_ns) return;
+    if (d.curve.size() == kMaxCurveSamples) {
+        // halve the resolution of what is kept, and of what comes next
+        for (size_t i = 0; i < kMaxCurveSamples / 2; i++) d.curve[i] = d.curve[2 * i];
+        d.curve.resize(kMaxCurveSamples / 2);
+        d.sample_interval_ns *= 2;
+    }
+    d.curve.push_back({now, allocated, reserved, d.pinned, d.idle});
+    d.last_sample_ns = now;
+}
+
+void free_tensor_locked(uint64_t ptr)
+{
+    auto it = tensors.find(ptr);
+    if (it == tensors.end()) return;
+    TensorRecord record = it->second;
+    tensors.erase(it);
+
+    auto seg = segments.find(record.segment_id);
+    if (seg == segments.end()) return;  // the segment was released first
+    device_tensors(seg->second.device).live_tensors--;
+    update_segment(seg->second, [&](Segment& s) {
+        s.tensors--;
+        s.bytes -= std::min(s.bytes, record.bytes);
+    });
+    if (seg->second.tensors == 0) segments.erase(seg);
+}
+
+void alloc_tensor_locked(uint64_t ptr, uint64_t bytes, int device, uint64_t segment_id)
+{
+    // the free of a previous tensor at this address was missed
+    free_tensor_locked(ptr);
+
+    auto seg = segments.find(segment_id);
+    if (seg == segments.end()) {
+        Segment found;
+        uint64_t id = 0;
+        if (segment_id != 0) {
+            alloc_index().with_allocation(ptr, [&](Allocation& a) {
+                id = a.id;
+                found.base = a.base;
+                found.size = a.size;
+                found.device = a.device;
+            });
+        }
+        if (segment_id == kTensorSegmentUnresolved) segment_id = id;
+        if (segment_id == 0) {
+            // allocated before we attached, or not through the HIP runtime
+            device_tensors(device).unmatched++;
+            return;
+        }
+        if (id != segment_id) {
+            // the segment was released since, it pins nothing; the free finds no segment
+            tensors[ptr] = {segment_id, bytes};
+            return;
+        }
+        seg = segments.emplace(id, found).first;
+    }
+
+    device_tensors(seg->second.device).live_tensors++;
+    update_segment(seg->second, [&](Segment& s) {
+        s.tensors++;
+        s.bytes += bytes;
+    });
+    tensors[ptr] = {segment_id, bytes};
+}
+
+void write_curve()
+{
+    FILE* out = fopen(curve_path.c_str(), "w");
+    if (out == nullptr) {
+        fprintf(stderr, "[ROCMPROF WARNING] cannot write ACCELPROF_TENSOR_CURVE '%s'\n", curve_path.c_str());
+        return;
+    }
+    fprintf(out, "device,time_ms,allocated,reserved,pinned,idle,fragmentation\n");
+    for (int dev = 0; dev < kMaxDevices; dev++) {
+        for (const CurveSample& c : devices[dev].curve) {
+            fprintf(out, "%d,%.3f,%ld,%ld,%lu,%lu,%.4f\n", dev, (double)c.time_ns / 1e6, (long)c.allocated,
+                    (long)c.reserved, (unsigned long)c.pinned, (unsigned long)c.idle, fragmentation(c.pinned, c.idle));
+        }
+    }
+    fclose(out);
+}
+
+void write_report(FILE* out)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<const Segment*> by_idle;
+    for (const auto& entry : segments) by_idle.push_back(&entry.second);
+    auto idle = [](const Segment* s) { return s->size - std::min(s->bytes, s->size); };
+
+    for (int dev = 0; dev < kMaxDevices; dev++) {
+        const DeviceTensors& d = devices[dev];
+        if (d.live_tensors == 0 && d.unmatched == 0 && d.peak_fragmentation == 0) continue;
+        uint64_t pinned_segments = 0;
+        for (const Segment* s : by_idle) pinned_segments += s->device == dev;
+        fprintf(out, "[ROCMPROF SUMMARY] tensors device %d: %lu live in %lu segments, %lu of %lu pinned bytes idle "
+                     "(fragmentation %.1f%%, peak %.1f%%), %lu tensor events outside known segments\n",
+                dev, (unsigned long)d.live_tensors, (unsigned long)pinned_segments, (unsigned long)d.idle,
+                (unsigned long)d.pinned, 100.0 * fragmentation(d.pinned, d.idle), 100.0 * d.peak_fragmentation,
+                (unsigned long)d.unmatched);
+        process_report(out, ReportMerge::sum, (double)d.live_tensors, "tensors.device.%d.live", dev);
+        process_report(out, ReportMerge::sum, (double)d.pinned, "tensors.device.%d.pinned_bytes", dev);
+        process_report(out, ReportMerge::sum, (double)d.idle, "tensors.device.%d.idle_bytes", dev);
+        process_report_mean(out, fragmentation(d.pinned, d.idle), (double)d.pinned,
+                            "tensors.device.%d.fragmentation", dev);
+        process_report(out, ReportMerge::max, d.peak_fragmentation, "tensors.device.%d.peak_fragmentation", dev);
+        process_report(out, ReportMerge::sum, (double)d.unmatched, "tensors.device.%d.outside_segments", dev);
+    }
+
+    size_t top = std::min<size_t>(10, by_idle.size());
+    std::partial_sort(by_idle.begin(), by_idle.begin() + top, by_idle.end(),
+                      [&](const Segment* a, const Segment* b) { return idle(a) > idle(b); });
+    for (size_t i = 0; i < top; i++) {
+        const Segment& s = *by_idle[i];
+        fprintf(out, "[ROCMPROF SUMMARY]   dev %d segment 0x%lx (%lu bytes): %u tensors, occupancy %.1f%%, "
+                     "%lu bytes idle\n",
+                s.device, (unsigned long)s.base, (unsigned long)s.size, s.tensors,
+                100.0 * (double)std::min(s.bytes, s.size) / (double)std::max<uint64_t>(s.size, 1),
+                (unsigned long)idle(&s));
+    }
+    if (!curve_path.empty()) write_curve();
+}
+
+} // namespace
+
+void tensor_segments_init()
+{
+    curve_path = env_string("ACCELPROF_TENSOR_CURVE");
+    start_ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    log_add_summary(write_report);
+}
+
+void tensor_segment_freed(const FreedAllocation& freed)
+{
+    if (!freed.found) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto seg = segments.find(freed.id);
+    if (seg == segments.end()) return;
+    // its tensor records go stale and are dropped when the tensors are freed
+    device_tensors(seg->second.device).live_tensors -= seg->second.tensors;
+    update_segment(seg->second, [](Segment& s) {
+        s.tensors = 0;
+        s.bytes = 0;
+    });
+    segments.erase(seg);
+}
+
+} // namespace rocm_accelprof
+
+extern "C" uint64_t accelprof_tensor_segment(uint64_t ptr)
+{
+    uint64_t id = 0;
+    rocm_accelprof::alloc_index().with_allocation(ptr, [&](rocm_accelprof::Allocation& a) { id = a.id; });
+    return id;
+}
+
+extern "C" void accelprof_tensor_event(uint64_t ptr, int64_t delta, int64_t total_allocated, int64_t total_reserved,
+                                       int device, uint64_t segment_id, uint64_t time_ns)
+{
+    using namespace rocm_accelprof;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (delta > 0) alloc_tensor_locked(ptr, (uint64_t)delta, device, segment_id);
+    else free_tensor_locked(ptr);
+    sample(device, total_allocated, total_reserved, time_ns);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+#include "alloc_index.h"
+
+// Correlation of PyTorch caching-allocator tensors with the hipMalloc segments under them.
+//
+// The torch backend (torch/amd_rocm_torch.cpp) hands its batched tensor events to
+// accelprof_tensor_event, exported from this library and looked up by the torch backend
+// until it is found. Every tensor block is attributed to the allocation that contained it
+// when it was reported, which gives per-segment occupancy and, per device, the bytes of
+// segments that live tensors pin and how much of them is idle (the fragmentation that
+// hipFree/empty_cache cannot return). Events reach us a batch later, so the torch backend
+// asks accelprof_tensor_segment for the segment as it records a tensor, and stamps the
+// time the curve is drawn at.
+//
+// ACCELPROF_TENSOR_CURVE=<file> writes reserved/allocated/pinned/idle over time as CSV.
+// The curve keeps at most a fixed number of samples per device: when it is full every
+// other sample is dropped and the sampling interval doubles.
+
+namespace rocm_accelprof {
+
+// Segment id of a tensor event whose segment was not looked up when it was recorded; it
+// is looked up as the event is handed over.
+constexpr uint64_t kTensorSegmentUnresolved = ~0ull;
+
+void tensor_segments_init();
+
+// A segment left the allocation index (hipFree); its tensors no longer pin anything.
+void tensor_segment_freed(const FreedAllocation& freed);
+
+} // namespace rocm_accelprof
+
+// Allocation id of the live allocation containing ptr, 0 when there is none.
+extern "C" uint64_t accelprof_tensor_segment(uint64_t ptr);
+
+// delta > 0 allocates a tensor block of delta bytes at ptr, delta <= 0 frees it; the
+// totals are the caching allocator's own view of the device. segment_id is what
+// accelprof_tensor_segment returned for an allocation when it was reported, time_ns the
+// steady clock then.
+extern "C" void accelprof_tensor_event(uint64_t ptr, int64_t delta, int64_t total_allocated, int64_t total_reserved,
+                                       int device, uint64_t segment_id, uint64_t time_ns);
@@ -0,0 +1,20 @@
+#pragma once
+
+// Set while the tool itself calls into HIP (hipGetDevice, hipKernelNameRef, ...), so
+// that those calls are not analyzed as if the application made them.
+
+namespace rocm_accelprof {
+
+inline thread_local bool in_tool_hip_call = false;
+
+// Restores the previous value, so guards nest and keep the worker's permanent one set.
+struct ToolHipCall {
+    ToolHipCall() : previous(in_tool_hip_call) { in_tool_hip_call = true; }
+    ~ToolHipCall() { in_tool_hip_call = previous; }
+    ToolHipCall(const ToolHipCall&) = delete;
+    ToolHipCall& operator=(const ToolHipCall&) = delete;
+
+    bool previous;
+};
+
+} // namespace rocm_accelprof
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "analysis_event.h"
+
+// Binary trace format, version 4 (version 1 had no kernel_buffer records, version 2 no
+// device times in kernel_end, version 3 no memcpy_end records).
+//
+// A trace is a directory of segment files, accelprof-<pid>-<tid>-<segment>.trace (with an
+// r<rank>- prefix after accelprof- in a multi-rank job), written by each producing thread
+// through a memory mapping. Every segment stands alone:
+//
+//   TraceFileHeader
+//   records: a type byte followed by LEB128 varints; type 0 ends the segment (the tail of
+//            a segment that was never closed is zero-filled)
+//
+// Event records (type = EventType, | kTraceNewDevice when the device differs from the
+// previous event's) start with
+//   seq delta, timestamp delta, zigzag correlation ID delta, [device]
+// followed by
+//   alloc         zigzag ptr delta, size, alloc type
+//   free          zigzag ptr delta, size
+//   memcpy        zigzag dst delta, zigzag (src - dst), size, kind << 1 | async
+//   memset        zigzag dst delta, size, zigzag value << 1 | async
+//   kernel_start  name id
+//   kernel_end    zigzag device start delta, device duration (version 3)
+//   kernel_buffer zigzag ptr delta, size, argument index
+//   memcpy_end    zigzag device start delta, device duration (version 4)
+// Deltas are taken against the previous event of the same segment; the pointer delta is
+// against the previous ptr/dst and the device start against the previous kernel_end's or
+// memcpy_end's.
+// Name records (kTraceName: id, length, bytes) precede the first event of a segment that
+// refers to the id. Events of all segments merge into the global order by seq.
+
+namespace rocm_accelprof {
+
+constexpr char kTraceMagic[8] = {'A', 'P', 'T', 'R', 'A', 'C', 'E', '\0'};
+constexpr uint16_t kTraceVersion = 4;
+constexpr uint8_t kTraceEnd = 0;
+constexpr uint8_t kTraceName = 0x7f;
+constexpr uint8_t kTraceNewDevice = 0x80;
+constexpr size_t kMaxEventRecordBytes = 1 + 11 * 10;
+constexpr size_t kMaxTraceNameBytes = 4096;
+
+struct TraceFileHeader {
+    char magic[8];
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t pid;
+    uint64_t tid;
+    uint64_t base_timestamp;   // steady clock ns the timestamp deltas start from
+    uint32_t segment;
+    uint32_t reserved;
+};
+static_assert(sizeof(TraceFileHeader) == 40, "trace header layout is part of the format");
+
+// Values the deltas of the next record are taken against, and the segment's version.
+struct TraceDeltaState {
+    uint16_t version = kTraceVersion;
+    uint64_t seq = 0;
+    uint64_t timestamp = 0;
+    uint64_t correlation_id = 0;
+    uint64_t ptr = 0;
+    uint64_t device_start = 0;
+    int32_t device = 0;
+};
+
+inline uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+inline int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+inline uint8_t* put_varint(uint8_t* out, uint64_t v)
+{
+    while (v >= 0x80) {
+        *out++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *out++ = (uint8_t)v;
+    return out;
+}
+
+inline bool get_varint(const uint8_t*& in, const uint8_t* end, uint64_t& v)
+{
+    v = 0;
+    for (uint32_t shift = 0; in < end && shift < 64; shift += 7) {
+        uint8_t byte = *in++;
+        v |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+// Encodes one event; out must have room for kMaxEventRecordBytes.
+inline uint8_t* encode_event(uint8_t* out, const AnalysisEvent& ev, TraceDeltaState& prev)
+{
+    bool new_device = ev.device != prev.device;
+    *out++ = (uint8_t)ev.type | (new_device ? kTraceNewDevice : 0);
+    out = put_varint(out, ev.seq - prev.seq);
+    out = put_varint(out, ev.timestamp - prev.timestamp);
+    out = put_varint(out, zigzag((int64_t)(ev.correlation_id - prev.correlation_id)));
+    if (new_device) out = put_varint(out, (uint32_t)ev.device);
+    prev.seq = ev.seq;
+    prev.timestamp = ev.timestamp;
+    prev.correlation_id = ev.correlation_id;
+    prev.device = ev.device;
+
+    switch (ev.type) {
+        case EventType::alloc:
+        case EventType::free:
+            out = put_varint(out, zigzag((int64_t)(ev.a - prev.ptr)));
+            out = put_varint(out, ev.b);
+            if (ev.type == EventType::alloc) out = put_varint(out, ev.arg);
+            prev.ptr = ev.a;
+            break;
+        case EventType::memcpy:
+            out = put_varint(out, zigzag((int64_t)(ev.a - prev.ptr)));
+            out = put_varint(out, zigzag((int64_t)(ev.b - ev.a)));
+            out = put_varint(out, ev.c);
+            out = put_varint(out, (uint64_t)ev.arg << 1 | (ev.is_async ? 1 : 0));
+            prev.ptr = ev.a;
+            break;
+        case EventType::memset:
+            out = put_varint(out, zigzag((int64_t)(ev.a - prev.ptr)));
+            out = put_varint(out, ev.b);
+            out = put_varint(out, zigzag((int32_t)ev.arg) << 1 | (ev.is_async ? 1 : 0));
+            prev.ptr = ev.a;
+            break;
+        case EventType::kernel_start:
+            out = put_varint(out, ev.arg);
+            break;
+        case EventType::kernel_end:
+        case EventType::memcpy_end:
+            out = put_varint(out, zigzag((int64_t)(ev.a - prev.device_start)));
+            out = put_varint(out, ev.b - ev.a);
+            prev.device_start = ev.a;
+            break;
+        case EventType::kernel_buffer:
+            out = put_varint(out, zigzag((int64_t)(ev.a - prev.ptr)));
+            out = put_varint(out, ev.b);
+            out = put_varint(out, ev.arg);
+            prev.ptr = ev.a;
+            break;
+    }
+    return out;
+}
+
+// Decodes the event record whose type byte has already been consumed.
+inline bool decode_event(const uint8_t*& in, const uint8_t* end, uint8_t type_byte, AnalysisEvent& ev,
+                         TraceDeltaState& prev)
+{
+    uint64_t v[4];
+    EventType type = static_cast<EventType>(type_byte & ~kTraceNewDevice);
+    ev = AnalysisEvent{};
+    ev.type = type;
+    for (int i = 0; i < 3; i++)
+        if (!get_varint(in, end, v[i])) return false;
+    ev.seq = prev.seq += v[0];
+    ev.timestamp = prev.timestamp += v[1];
+    ev.correlation_id = prev.correlation_id += (uint64_t)unzigzag(v[2]);
+    if (type_byte & kTraceNewDevice) {
+        if (!get_varint(in, end, v[3])) return false;
+        prev.device = (int32_t)(uint32_t)v[3];
+    }
+    ev.device = prev.device;
+
+    switch (type) {
+        case EventType::alloc:
+        case EventType::free:
+            if (!get_varint(in, end, v[0]) || !get_varint(in, end, v[1])) return false;
+            ev.a = prev.ptr += (uint64_t)unzigzag(v[0]);
+            ev.b = v[1];
+            if (type == EventType::alloc) {
+                if (!get_varint(in, end, v[2])) return false;
+                ev.arg = (uint32_t)v[2];
+            }
+            return true;
+        case EventType::memcpy:
+            for (auto& x : v)
+                if (!get_varint(in, end, x)) return false;
+            ev.a = prev.ptr += (uint64_t)unzigzag(v[0]);
+            ev.b = ev.a + (uint64_t)unzigzag(v[1]);
+            ev.c = v[2];
+            ev.arg = (uint32_t)(v[3] >> 1);
+            ev.is_async = v[3] & 1;
+            return true;
+        case EventType::memset:
+            for (int i = 0; i < 3; i++)
+                if (!get_varint(in, end, v[i])) return false;
+            ev.a = prev.ptr += (uint64_t)unzigzag(v[0]);
+            ev.b = v[1];
+            ev.arg = (uint32_t)(int32_t)unzigzag(v[2] >> 1);
+            ev.is_async = v[2] & 1;
+            return true;
+        case EventType::kernel_start:
+            if (!get_varint(in, end, v[0])) return false;
+            ev.arg = (uint32_t)v[0];
+            return true;
+        case EventType::kernel_end:
+            if (prev.version < 3) return true;
+            if (!get_varint(in, end, v[0]) || !get_varint(in, end, v[1])) return false;
+            ev.a = prev.device_start += (uint64_t)unzigzag(v[0]);
+            ev.b = ev.a + v[1];
+            return true;
+        case EventType::kernel_buffer:
+            for (int i = 0; i < 3; i++)
+                if (!get_varint(in, end, v[i])) return false;
+            ev.a = prev.ptr += (uint64_t)unzigzag(v[0]);
+            ev.b = v[1];
+            ev.arg = (uint32_t)v[2];
+            return true;
+        case EventType::memcpy_end:
+            if (!get_varint(in, end, v[0]) || !get_varint(in, end, v[1])) return false;
+            ev.a = prev.device_start += (uint64_t)unzigzag(v[0]);
+            ev.b = ev.a + v[1];
+            return true;
+    }
+    return false;
+}
+
+} // namespace rocm_accelprof
@@ -0,0 +1,248 @@
+#include "trace_writer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "env.h"
+#include "kernel_names.h"
+#include "logger.h"
+#include "process.h"
+#include "trace_format.h"
+
+namespace rocm_accelprof {
+
+bool trace_active = false;
+
+namespace {
+
+std::string trace_dir;
+size_t segment_bytes = 16 << 20;
+uint32_t trace_pid = 0;
+int trace_rank = -1;
+
+// a name record: type, id, length, bytes
+constexpr size_t kMaxNameRecordBytes = 1 + 10 + 10 + kMaxTraceNameBytes;
+
+struct SegmentWriter {
+    int fd = -1;
+    uint8_t* base = nullptr;
+    size_t used = 0;
+    uint32_t segment = 0;
+    uint64_t tid = 0;
+    bool failed = false;
+    TraceDeltaState prev;
+    std::vector<bool> named;           // kernel name ids defined in the current segment
+    // owner-written totals, read by the summary
+    std::atomic<uint64_t> events{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint32_t> segments{0};
+};
+
+std::mutex writers_mutex;
+std::vector<SegmentWriter*> writers;   // never freed, for the summary
+
+uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool open_segment(SegmentWriter& w)
+{
+    char path[4096];
+    if (trace_rank >= 0)
+        snprintf(path, sizeof(path), "%s/accelprof-r%d-%u-%lu-%u.trace", trace_dir.c_str(), trace_rank, trace_pid,
+                 (unsigned long)w.tid, w.segment);
+    else
+        snprintf(path, sizeof(path), "%s/accelprof-%u-%lu-%u.trace", trace_dir.c_str(), trace_pid,
+                 (unsigned long)w.tid, w.segment);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "[ROCMPROF WARNING] cannot create trace segment '%s', tracing off for this thread\n", path);
+        return false;
+    }
+    void* base = MAP_FAILED;
+    if (ftruncate(fd, (off_t)segment_bytes) == 0)
+        base = mmap(nullptr, segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "[ROCMPROF WARNING] cannot map trace segment '%s', tracing off for this thread\n", path);
+        close(fd);
+        return false;
+    }
+
+    TraceFileHeader header{};
+    memcpy(header.magic, kTraceMagic, sizeof(header.magic));
+    header.version = kTraceVersion;
+    header.header_size = sizeof(TraceFileHeader);
+    header.pid = trace_pid;
+    header.tid = w.tid;
+    header.base_timestamp = now_ns();
+    header.segment = w.segment;
+    memcpy(base, &header, sizeof(header));
+
+    w.fd = fd;
+    w.base = static_cast<uint8_t*>(base);
+    w.used = sizeof(header);
+    w.prev = TraceDeltaState{};
+    w.prev.timestamp = header.base_timestamp;
+    std::fill(w.named.begin(), w.named.end(), false);
+    w.segments.fetch_add(1, std::memory_order_relaxed);
+    w.bytes.fetch_add(sizeof(header), std::memory_order_relaxed);
+    return true;
+}
+
+// Cut the file to what was written, plus the terminating zero type byte.
+void close_segment(SegmentWriter& w)
+{
+    if (w.base == nullptr) return;
+    munmap(w.base, segment_bytes);
+    // if this fails the zero-filled tail terminates the segment just as well
+    int rc = ftruncate(w.fd, (off_t)(w.used + 1));
+    (void)rc;
+    close(w.fd);
+    w.base = nullptr;
+    w.fd = -1;
+    w.segment++;
+}
+
+// Closes the segment of an exiting thread; events it emits afterwards are not traced.
+thread_local bool tls_writer_closed = false;
+
+struct WriterOwner {
+    SegmentWriter* writer = nullptr;
+    ~WriterOwner() {
+        if (writer) close_segment(*writer);
+        writer = nullptr;
+        tls_writer_closed = true;
+    }
+};
+
+thread_local WriterOwner tls_writer;
+
+SegmentWriter* thread_writer()
+{
+    if (tls_writer.writer != nullptr) return tls_writer.writer;
+    auto* w = new SegmentWriter();
+    w->tid = static_cast<uint64_t>(syscall(SYS_gettid));
+    w->failed = !open_segment(*w);
+    {
+        std::lock_guard<std::mutex> lock(writers_mutex);
+        writers.push_back(w);
+    }
+    tls_writer.writer = w;
+    return w;
+}
+
+void write_report(FILE* out)
+{
+    uint64_t events = 0, bytes = 0, segments = 0;
+    std::lock_guard<std::mutex> lock(writers_mutex);
+    for (auto* w : writers) {
+        events += w->events.load(std::memory_order_relaxed);
+        bytes += w->bytes.load(std::memory_order_relaxed);
+        segments += w->segments.load(std::memory_order_relaxed);
+    }
+    fprintf(out, "[ROCMPROF SUMMARY] trace: %lu events, %lu bytes in %lu segments under %s\n",
+            (unsigned long)events, (unsigned long)bytes, (unsigned long)segments, trace_dir.c_str());
+    process_report(out, ReportMerge::sum, (double)events, "trace.events");
+    process_report(out, ReportMerge::sum, (double)bytes, "trace.bytes");
+    process_report(out, ReportMerge::sum, (double)segments, "trace.segments");
+}
+
+// Fork: the child inherits the parent's segment mappings, which are MAP_SHARED. It unmaps
+// and closes them without touching the files and traces nothing.
+void before_fork() { writers_mutex.lock(); }
+
+void after_fork_parent() { writers_mutex.unlock(); }
+
+void after_fork_child()
+{
+    writers_mutex.unlock();
+    trace_active = false;
+    for (auto* w : writers) {
+        if (w->base != nullptr) {
+            munmap(w->base, segment_bytes);
+            close(w->fd);
+        }
+        w->base = nullptr;
+        w->fd = -1;
+        w->failed = true;
+    }
+    tls_writer.writer = nullptr;
+    tls_writer_closed = true;
+}
+
+} // namespace
+
+void trace_init()
+{
+    const char* pattern = env_cstr("ACCELPROF_TRACE_DIR");
+    if (pattern == nullptr) return;
+    trace_dir = process_expand_path(pattern);
+    if (mkdir(trace_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "[ROCMPROF WARNING] cannot create ACCELPROF_TRACE_DIR '%s', tracing off\n", trace_dir.c_str());
+        return;
+    }
+    segment_bytes = std::max<uint64_t>(env_u64("ACCELPROF_TRACE_SEGMENT_MB", 16), 1) << 20;
+    trace_pid = (uint32_t)getpid();
+    trace_rank = process_rank();
+    process_init();
+    pthread_atfork(before_fork, after_fork_parent, after_fork_child);
+    log_add_summary(write_report);
+    trace_active = true;
+}
+
+void trace_write_slow(const AnalysisEvent& ev)
+{
+    if (tls_writer_closed) return;
+    SegmentWriter* w = thread_writer();
+    if (w->failed) return;
+
+    const std::string* name = nullptr;
+    if (ev.type == EventType::kernel_start) {
+        if (ev.arg >= w->named.size()) w->named.resize(std::max<size_t>(ev.arg + 1, w->named.size() * 2), false);
+        if (!w->named[ev.arg]) name = &kernel_names().name(ev.arg);
+    }
+
+    size_t need = kMaxEventRecordBytes + (name ? kMaxNameRecordBytes : 0) + 1;
+    if (w->used + need > segment_bytes) {
+        close_segment(*w);
+        if (!open_segment(*w)) {
+            w->failed = true;
+            return;
+        }
+        if (ev.type == EventType::kernel_start) name = &kernel_names().name(ev.arg);
+    }
+
+    uint8_t* out = w->base + w->used;
+    if (name != nullptr) {
+        size_t len = std::min(name->size(), kMaxTraceNameBytes);
+        *out++ = kTraceName;
+        out = put_varint(out, ev.arg);
+        out = put_varint(out, len);
+        memcpy(out, name->data(), len);
+        out += len;
+        w->named[ev.arg] = true;
+    }
+    out = encode_event(out, ev, w->prev);
+
+    size_t written = out - (w->base + w->used);
+    w->used += written;
+    w->events.store(w->events.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    w->bytes.store(w->bytes.load(std::memory_order_relaxed) + written, std::memory_order_relaxed);
+}
+
+} // namespace rocm_accelprof
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "analysis_event.h"
+
+// Binary trace output (format in trace_format.h), enabled with ACCELPROF_TRACE_DIR.
+//
+// Every producing thread appends to its own memory-mapped segment file: an event costs a
+// varint encode into the mapping and no system call. Segments are ACCELPROF_TRACE_SEGMENT_MB
+// (default 16) large; only opening the next one, at thread exit or when a segment is full,
+// touches the file system. Convert with tools/accelprof-trace.
+//
+// %p, %r and %h in ACCELPROF_TRACE_DIR expand to the pid, rank and host (process.h); in a
+// multi-rank job segment names also carry the rank, so ranks can share one directory.
+
+namespace rocm_accelprof {
+
+extern bool trace_active;
+
+void trace_init();
+
+void trace_write_slow(const AnalysisEvent& ev);
+
+inline void trace_write(const AnalysisEvent& ev)
+{
+    if (trace_active) trace_write_slow(ev);
+}
+
+} // namespace rocm_accelprof
@@ -0,0 +1,384 @@
+// Job-wide aggregation of the end-of-run summaries of every process of a multi-rank job.
+//
+//   accelprof-aggregate <socket> [--reports N] [--out FILE] [--max-keys N]
+//
+// Listens on the Unix socket that the processes are given as ACCELPROF_AGGREGATE. Each
+// process connects once per backend at exit and sends a header line,
+//   ACCELPROF-REPORT 2 source=<hip|torch> rank=<rank> pid=<pid> host=<host>
+// followed by the structured records of its summary (src/process.h), one per line:
+//   <sum|max|min|mean> <value> <weight> <key>
+// The summary text stays with the process for display; nothing here parses it. Records
+// merge by key as their merge kind says: sum adds, max and min keep the extreme, mean is
+// weighted by the weight. A key reported more than once in a report combines the same
+// way within it first. When the per-report value of a key differs between reports, its
+// range is appended with the ranks that hold the extremes.
+//
+// Memory is bounded by the number of distinct keys (--max-keys, default 10000, later keys
+// are counted and dropped) and 4 KiB per open connection plus the keys it touched. The
+// merged report is written as [ROCMPROF JOB] lines after N reports (--reports; with the
+// torch backend loaded every rank sends two) or on SIGINT/SIGTERM.
+//
+// Build: make tools
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kMaxLineBytes = 4096;
+constexpr size_t kMaxConnections = 1024;
+const char kReportHeader[] = "ACCELPROF-REPORT 2 ";
+
+enum class Merge : uint8_t { sum, max, min, mean };
+
+struct Reporter {
+    int rank = -1;
+    int pid = 0;
+};
+
+// One merged key. current/current_weight hold the open report's share until it ends.
+struct Entry {
+    std::string key;
+    Merge merge = Merge::sum;
+    bool integral = true;
+    double total = 0;               // sum, max, min; mean: sum of value * weight
+    double weight = 0;              // mean: sum of weights
+    uint64_t reports = 0;
+    uint64_t last_report = 0;
+    double current = 0, current_weight = 0;
+    double lo = 0, hi = 0;
+    Reporter lo_reporter, hi_reporter;
+};
+
+struct Connection {
+    int fd = -1;
+    std::string partial;
+    bool overlong = false;          // dropping the rest of a line past kMaxLineBytes
+    bool header = false;
+    uint64_t report = 0;
+    Reporter reporter;
+    std::string host;
+    std::vector<size_t> touched;    // entries with a share in this report
+};
+
+volatile sig_atomic_t stop_requested = 0;
+
+size_t max_keys = 10000;
+std::vector<Entry> entries;
+std::unordered_map<std::string, size_t> entry_index;
+uint64_t dropped_keys = 0;
+uint64_t bad_records = 0;
+uint64_t reports_done = 0;
+uint64_t next_report = 0;
+std::set<std::pair<int, int>> ranks;        // (rank, pid), rank -1 outside multi-rank jobs
+std::set<std::string> hosts;
+
+bool parse_merge(const char* word, size_t len, Merge& merge)
+{
+    static const char* const kNames[] = {"sum", "max", "min", "mean"};
+    for (int m = 0; m < 4; m++) {
+        if (strlen(kNames[m]) == len && memcmp(word, kNames[m], len) == 0) {
+            merge = (Merge)m;
+            return true;
+        }
+    }
+    return false;
+}
+
+double combine(Merge merge, double a, double b)
+{
+    switch (merge) {
+        case Merge::max: return std::max(a, b);
+        case Merge::min: return std::min(a, b);
+        default: return a + b;
+    }
+}
+
+// Record: <merge> <value> <weight> <key>
+void merge_record(Connection& conn, const std::string& text)
+{
+    const char* line = text.c_str();
+    const char* space = strchr(line, ' ');
+    Merge merge;
+    if (space == nullptr || !parse_merge(line, (size_t)(space - line), merge)) {
+        bad_records++;
+        return;
+    }
+    char* end = nullptr;
+    double value = strtod(space + 1, &end);
+    if (end == space + 1 || *end != ' ') {
+        bad_records++;
+        return;
+    }
+    const char* weight_text = end + 1;
+    double weight = strtod(weight_text, &end);
+    if (end == weight_text || *end != ' ' || end[1] == '\0' || !std::isfinite(value) || !(weight > 0)) {
+        bad_records++;
+        return;
+    }
+    std::string key(end + 1);
+
+    auto it = entry_index.find(key);
+    if (it == entry_index.end()) {
+        if (entries.size() >= max_keys) {
+            dropped_keys++;
+            return;
+        }
+        it = entry_index.emplace(key, entries.size()).first;
+        entries.emplace_back();
+        entries.back().key = key;
+        entries.back().merge = merge;
+    }
+    Entry& entry = entries[it->second];
+    if (entry.merge != merge) {
+        bad_records++;
+        return;
+    }
+    if (entry.last_report != conn.report) {
+        entry.last_report = conn.report;
+        entry.current = merge == Merge::mean ? value * weight : value;
+        entry.current_weight = weight;
+        conn.touched.push_back(it->second);
+    } else if (merge == Merge::mean) {
+        entry.current += value * weight;
+        entry.current_weight += weight;
+    } else {
+        entry.current = combine(merge, entry.current, value);
+    }
+    entry.integral &= value == std::floor(value);
+}
+
+// Folds the shares of a finished report into the job values.
+void finish_report(Connection& conn)
+{
+    for (size_t i : conn.touched) {
+        Entry& entry = entries[i];
+        double value = entry.merge == Merge::mean ? entry.current / entry.current_weight : entry.current;
+        bool first = entry.reports++ == 0;
+        if (entry.merge == Merge::mean) {
+            entry.total += entry.current;
+            entry.weight += entry.current_weight;
+        } else {
+            entry.total = first ? value : combine(entry.merge, entry.total, value);
+        }
+        if (first || value < entry.lo) {
+            entry.lo = value;
+            entry.lo_reporter = conn.reporter;
+        }
+        if (first || value > entry.hi) {
+            entry.hi = value;
+            entry.hi_reporter = conn.reporter;
+        }
+    }
+    conn.touched.clear();
+}
+
+// Header: ACCELPROF-REPORT 2 source=... rank=... pid=... host=...
+bool parse_header(Connection& conn, const std::string& text)
+{
+    if (text.compare(0, sizeof(kReportHeader) - 1, kReportHeader) != 0) {
+        if (text.compare(0, 17, "ACCELPROF-REPORT ") == 0)
+            fprintf(stderr, "accelprof-aggregate: report format '%.20s' is not version 2, rebuild the tool "
+                            "library\n", text.c_str());
+        return false;
+    }
+    const char* rank = strstr(text.c_str(), " rank=");
+    const char* pid = strstr(text.c_str(), " pid=");
+    const char* host = strstr(text.c_str(), " host=");
+    if (rank == nullptr || pid == nullptr) return false;
+    conn.reporter.rank = atoi(rank + 6);
+    conn.reporter.pid = atoi(pid + 5);
+    conn.host = host ? std::string(host + 6) : "";
+    conn.report = ++next_report;
+    return true;
+}
+
+void handle_line(Connection& conn, const std::string& text)
+{
+    if (!conn.header) {
+        conn.header = parse_header(conn, text);
+        if (!conn.header) fprintf(stderr, "accelprof-aggregate: dropping a connection without report header\n");
+        return;
+    }
+    if (!text.empty()) merge_record(conn, text);
+}
+
+// Returns false once the connection is done.
+bool read_connection(Connection& conn)
+{
+    char buf[65536];
+    ssize_t n = read(conn.fd, buf, sizeof(buf));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) return true;
+    if (n <= 0) {
+        if (!conn.partial.empty() && conn.header && !conn.overlong) handle_line(conn, conn.partial);
+        if (conn.header) {
+            finish_report(conn);
+            reports_done++;
+            ranks.insert({conn.reporter.rank, conn.reporter.rank >= 0 ? 0 : conn.reporter.pid});
+            hosts.insert(conn.host);
+        }
+        return false;
+    }
+    for (ssize_t i = 0; i < n; i++) {
+        char c = buf[i];
+        if (c == '\n') {
+            if (!conn.overlong) handle_line(conn, conn.partial);
+            conn.partial.clear();
+            conn.overlong = false;
+            if (!conn.header) return false;
+            continue;
+        }
+        if (conn.overlong) continue;
+        if (conn.partial.size() >= kMaxLineBytes) {
+            conn.overlong = true;
+            conn.partial.clear();
+            continue;
+        }
+        conn.partial += c;
+    }
+    return true;
+}
+
+std::string reporter_name(const Reporter& r)
+{
+    return r.rank >= 0 ? "rank " + std::to_string(r.rank) : "pid " + std::to_string(r.pid);
+}
+
+std::string format_value(const Entry& entry, double value)
+{
+    char text[64];
+    // large values keep their units digits, small fractions their significant ones
+    if ((entry.integral && entry.merge != Merge::mean) || std::fabs(value) >= 1e6)
+        snprintf(text, sizeof(text), "%.0f", value);
+    else
+        snprintf(text, sizeof(text), "%.6g", value);
+    return text;
+}
+
+void write_report(FILE* out)
+{
+    fprintf(out, "[ROCMPROF JOB] %lu reports from %zu processes on %zu hosts\n", (unsigned long)reports_done,
+            ranks.size(), hosts.size());
+    for (const Entry& entry : entries) {
+        if (entry.reports == 0) continue;   // only in a report that never finished
+        double value = entry.merge == Merge::mean ? entry.total / entry.weight : entry.total;
+        std::string text = entry.key + " " + format_value(entry, value);
+        if (entry.reports > 1 && entry.lo != entry.hi) {
+            text += "  [" + std::to_string(entry.reports) + " reports, min " + format_value(entry, entry.lo) + " (" +
+                    reporter_name(entry.lo_reporter) + "), max " + format_value(entry, entry.hi) + " (" +
+                    reporter_name(entry.hi_reporter) + ")]";
+        } else if (entry.reports > 1) {
+            text += "  [" + std::to_string(entry.reports) + " reports]";
+        }
+        fprintf(out, "[ROCMPROF JOB] %s\n", text.c_str());
+    }
+    if (dropped_keys > 0)
+        fprintf(out, "[ROCMPROF JOB] %lu records dropped past --max-keys %zu\n", (unsigned long)dropped_keys,
+                max_keys);
+    if (bad_records > 0)
+        fprintf(out, "[ROCMPROF JOB] %lu malformed records or merge kinds conflicting with their key\n",
+                (unsigned long)bad_records);
+}
+
+int usage()
+{
+    fprintf(stderr, "usage: accelprof-aggregate <socket> [--reports N] [--out FILE] [--max-keys N]\n");
+    return 2;
+}
+
+void on_signal(int) { stop_requested = 1; }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) return usage();
+    const char* path = argv[1];
+    const char* output = nullptr;
+    uint64_t expected = 0;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--reports") == 0 && i + 1 < argc) expected = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) output = argv[++i];
+        else if (strcmp(argv[i], "--max-keys") == 0 && i + 1 < argc) max_keys = strtoull(argv[++i], nullptr, 10);
+        else return usage();
+    }
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "accelprof-aggregate: socket path too long\n");
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(path);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(listener, 128) != 0) {
+        fprintf(stderr, "accelprof-aggregate: cannot listen on %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    struct sigaction action{};
+    action.sa_handler = on_signal;   // no SA_RESTART, poll returns EINTR
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<Connection> conns;
+    std::vector<pollfd> fds;
+    while (!stop_requested && (expected == 0 || reports_done < expected)) {
+        fds.clear();
+        for (const Connection& conn : conns) fds.push_back({conn.fd, POLLIN, 0});
+        // stop accepting while at the connection cap, the backlog waits
+        if (conns.size() < kMaxConnections) fds.push_back({listener, POLLIN, 0});
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        size_t live = 0;
+        for (size_t i = 0; i < conns.size(); i++) {
+            bool open = fds[i].revents == 0 || read_connection(conns[i]);
+            if (!open) {
+                close(conns[i].fd);
+                continue;
+            }
+            if (live != i) conns[live] = std::move(conns[i]);
+            live++;
+        }
+        conns.resize(live);
+        if (conns.size() < kMaxConnections && (fds.back().revents & POLLIN) && fds.back().fd == listener) {
+            int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0) {
+                conns.emplace_back();
+                conns.back().fd = fd;
+            }
+        }
+    }
+    for (const Connection& conn : conns) close(conn.fd);
+    close(listener);
+    unlink(path);
+
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (out == nullptr) {
+        fprintf(stderr, "accelprof-aggregate: cannot write %s\n", output);
+        out = stdout;
+    }
+    write_report(out);
+    if (out != stdout) fclose(out);
+    return 0;
+}
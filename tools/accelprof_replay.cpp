@@ -0,0 +1,191 @@
+// Replay driver: feeds a binary trace written with ACCELPROF_TRACE_DIR back into sanalyzer,
+// without ROCm or a GPU. The events go through the same event-to-callback mapping as the
+// live analysis worker (src/sanalyzer_forward.h), in the order the backend forwarded them.
+//
+//   accelprof-replay <trace dir|segments...> [--timing full|original] [--speed X] [--pid P]
+//
+//   --timing full      back to back, as fast as sanalyzer takes them (default)
+//   --timing original  each event at its captured offset from the first, divided by --speed
+//   --pid P            the process to replay when the trace holds several (default: the first)
+//
+// Reports throughput in events/s and the distribution of the time spent in each callback.
+//
+// Build: make replay (needs SANALYZER_DIR)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sanalyzer_forward.h"
+#include "trace_reader.h"
+
+using namespace rocm_accelprof;
+
+namespace {
+
+const char* event_type_name(uint32_t type)
+{
+    static const char* names[] = {"?", "alloc", "free", "memcpy", "memset", "kernel_start", "kernel_end",
+                                  "kernel_buffer", "memcpy_end"};
+    return type < kNumEventTypes ? names[type] : "?";
+}
+
+uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Waits until the steady clock reaches deadline: sleeps while far off, spins the rest.
+void wait_until(uint64_t deadline)
+{
+    uint64_t now = now_ns();
+    if (deadline > now + 200000) std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - now - 100000));
+    while (now_ns() < deadline) {
+    }
+}
+
+uint64_t percentile(const std::vector<uint64_t>& sorted, double p)
+{
+    if (sorted.empty()) return 0;
+    size_t i = std::min(sorted.size() - 1, (size_t)(p * (double)sorted.size()));
+    return sorted[i];
+}
+
+void write_latency_row(FILE* out, const char* name, std::vector<uint64_t>& ns)
+{
+    if (ns.empty()) return;
+    std::sort(ns.begin(), ns.end());
+    uint64_t total = 0;
+    for (uint64_t v : ns) total += v;
+    fprintf(out, "%-14s %10zu %9lu %9lu %9lu %9lu %9lu %11lu\n", name, ns.size(), (unsigned long)(total / ns.size()),
+            (unsigned long)percentile(ns, 0.50), (unsigned long)percentile(ns, 0.90),
+            (unsigned long)percentile(ns, 0.99), (unsigned long)percentile(ns, 0.999), (unsigned long)ns.back());
+}
+
+int usage()
+{
+    fprintf(stderr, "usage: accelprof-replay <trace dir|segment files...> [--timing full|original] [--speed X] "
+                    "[--pid P]\n");
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    bool original_timing = false;
+    double speed = 1.0;
+    long pid_arg = -1;
+    TraceReader trace;
+    int paths = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--timing") == 0 && i + 1 < argc) {
+            std::string timing = argv[++i];
+            if (timing != "full" && timing != "original") return usage();
+            original_timing = timing == "original";
+            continue;
+        }
+        if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            speed = atof(argv[++i]);
+            if (speed <= 0) return usage();
+            continue;
+        }
+        if (strcmp(argv[i], "--pid") == 0 && i + 1 < argc) {
+            pid_arg = atol(argv[++i]);
+            continue;
+        }
+        std::string error;
+        if (!trace.add_path(argv[i], error)) {
+            fprintf(stderr, "accelprof-replay: %s\n", error.c_str());
+            return 1;
+        }
+        paths++;
+    }
+    if (paths == 0) return usage();
+    trace.finish();
+
+    // sanalyzer keeps one address space, so only one process of a multi-process trace replays
+    std::set<uint32_t> pids;
+    for (const auto& e : trace.events()) pids.insert(e.pid);
+    if (pids.empty()) {
+        fprintf(stderr, "accelprof-replay: no events in the trace\n");
+        return 1;
+    }
+    uint32_t pid = pid_arg >= 0 ? (uint32_t)pid_arg : *pids.begin();
+    if (pids.count(pid) == 0) {
+        fprintf(stderr, "accelprof-replay: no events of pid %u in the trace\n", pid);
+        return 1;
+    }
+    if (pids.size() > 1 && pid_arg < 0)
+        fprintf(stderr, "accelprof-replay: trace holds %zu processes, replaying pid %u (select with --pid)\n",
+                pids.size(), pid);
+
+    std::vector<const AnalysisEvent*> events;
+    for (const auto& e : trace.events())
+        if (e.pid == pid) events.push_back(&e.ev);
+
+    // resolve kernel names up front so that the replay loop does not search the name map
+    std::vector<std::string> names;
+    for (const AnalysisEvent* ev : events) {
+        if (ev->type != EventType::kernel_start) continue;
+        if (ev->arg >= names.size()) names.resize(ev->arg + 1);
+        if (names[ev->arg].empty()) names[ev->arg] = trace.kernel_name(pid, ev->arg);
+    }
+    auto kernel_name = [&names](uint32_t id) -> const std::string& { return names[id]; };
+
+    AccelProfOptions_t options;
+    yosemite_init(options);
+
+    std::vector<uint64_t> latency[kNumEventTypes];
+    for (auto& l : latency) l.reserve(events.size() / 4);
+    uint64_t t0 = events.front()->timestamp;
+    uint64_t total_lag = 0, max_lag = 0;
+
+    uint64_t start = now_ns();
+    for (const AnalysisEvent* ev : events) {
+        if (original_timing) {
+            // sequence order is not timestamp order across threads: an event may predate t0
+            int64_t offset = std::max<int64_t>((int64_t)(ev->timestamp - t0), 0);
+            uint64_t deadline = start + (uint64_t)((double)offset / speed);
+            wait_until(deadline);
+            uint64_t lag = now_ns() - deadline;
+            total_lag += lag;
+            max_lag = std::max(max_lag, lag);
+        }
+        uint64_t before = now_ns();
+        forward_to_sanalyzer(*ev, kernel_name);
+        latency[(int)ev->type].push_back(now_ns() - before);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    yosemite_terminate();
+
+    size_t n = events.size();
+    double seconds = (double)elapsed / 1e9;
+    printf("replayed:    %zu events of pid %u from %zu segments, %s timing", n, pid, trace.segments(),
+           original_timing ? "original" : "full-speed");
+    if (original_timing && speed != 1.0) printf(" x%.2f", speed);
+    printf("\n");
+    printf("wall time:   %.3f s (captured span %.3f s)\n", seconds, (double)std::max<int64_t>((int64_t)(events.back()->timestamp - t0), 0) / 1e9);
+    printf("throughput:  %.0f events/s\n", seconds > 0 ? (double)n / seconds : 0.0);
+    if (original_timing)
+        printf("dispatch lag: mean %lu ns, max %lu ns\n", (unsigned long)(total_lag / n), (unsigned long)max_lag);
+
+    printf("\ncallback latency (ns)\n");
+    printf("%-14s %10s %9s %9s %9s %9s %9s %11s\n", "event", "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+    std::vector<uint64_t> all;
+    all.reserve(n);
+    for (uint32_t t = 1; t < kNumEventTypes; t++) {
+        all.insert(all.end(), latency[t].begin(), latency[t].end());
+        write_latency_row(stdout, event_type_name(t), latency[t]);
+    }
+    write_latency_row(stdout, "all", all);
+    return 0;
+}
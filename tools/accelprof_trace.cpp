@@ -0,0 +1,371 @@
+// Offline converter for binary traces written with ACCELPROF_TRACE_DIR.
+//
+//   accelprof-trace json  <trace dir|segments...> [-o out.json]   Perfetto / Chrome trace JSON
+//   accelprof-trace csv   <trace dir|segments...> [-o out.csv]    per-kernel / per-device summary
+//   accelprof-trace dump  <trace dir|segments...> [-o out.txt]    one text line per event
+//   accelprof-trace stats <trace dir|segments...>                 size against the text log
+//
+// Build: make tools
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "trace_reader.h"
+
+using namespace rocm_accelprof;
+
+namespace {
+
+const char* copy_kind_name(uint32_t kind)
+{
+    static const char* names[] = {"HtoH", "HtoD", "DtoH", "DtoD", "Default"};
+    return kind < 5 ? names[kind] : "?";
+}
+
+// The line the api log level writes for the same event, for dump and the size comparison.
+int format_text(char* buf, size_t size, const TraceReader& trace, const TraceEvent& e)
+{
+    const AnalysisEvent& ev = e.ev;
+    int n = snprintf(buf, size, "[ROCMPROF INFO] tid=%lu, cid=%lu, ", (unsigned long)e.tid,
+                     (unsigned long)ev.correlation_id);
+    switch (ev.type) {
+        case EventType::alloc:
+            return n + snprintf(buf + n, size - n, "alloc: ptr=0x%lx, size=%lu, device=%d, kind=%u",
+                                (unsigned long)ev.a, (unsigned long)ev.b, ev.device, ev.arg);
+        case EventType::free:
+            return n + snprintf(buf + n, size - n, "free: ptr=0x%lx, size=%lu, device=%d", (unsigned long)ev.a,
+                                (unsigned long)ev.b, ev.device);
+        case EventType::memcpy:
+            return n + snprintf(buf + n, size - n, "memcpy: dst=0x%lx, src=0x%lx, size=%lu, kind=%u, async=%u",
+                                (unsigned long)ev.a, (unsigned long)ev.b, (unsigned long)ev.c, ev.arg,
+                                ev.is_async);
+        case EventType::memset:
+            return n + snprintf(buf + n, size - n, "memset: ptr=0x%lx, value=%d, size=%lu, async=%u",
+                                (unsigned long)ev.a, (int)ev.arg, (unsigned long)ev.b, ev.is_async);
+        case EventType::kernel_start:
+            return n + snprintf(buf + n, size - n, "launch: %s, device=%d",
+                                trace.kernel_name(e.pid, ev.arg).c_str(), ev.device);
+        case EventType::kernel_end:
+            return n + snprintf(buf + n, size - n, "kernel end: device=%d, device_time=%lu ns", ev.device,
+                                (unsigned long)(ev.b - ev.a));
+        case EventType::kernel_buffer:
+            return n + snprintf(buf + n, size - n, "kernel buffer: ptr=0x%lx, size=%lu, arg=%u, device=%d",
+                                (unsigned long)ev.a, (unsigned long)ev.b, ev.arg, ev.device);
+        case EventType::memcpy_end:
+            return n + snprintf(buf + n, size - n, "memcpy end: device=%d, device_time=%lu ns", ev.device,
+                                (unsigned long)(ev.b - ev.a));
+    }
+    return n;
+}
+
+std::string json_escape(const std::string& s)
+{
+    std::string out;
+    out.reserve(s.size());
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+std::string csv_quote(const std::string& s)
+{
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    return out + "\"";
+}
+
+// GPU tracks get their own thread IDs next to the host threads of the process
+uint64_t gpu_track(int device) { return 0x100000000ull + (uint32_t)device; }
+
+void write_json(const TraceReader& trace, FILE* out)
+{
+    const auto& events = trace.events();
+    uint64_t t0 = UINT64_MAX;
+    for (const auto& e : events) {
+        t0 = std::min(t0, e.ev.timestamp);
+        if ((e.ev.type == EventType::kernel_end || e.ev.type == EventType::memcpy_end) && e.ev.a != 0)
+            t0 = std::min(t0, e.ev.a);
+    }
+    auto us = [t0](uint64_t ts) { return (double)(ts - t0) / 1000.0; };
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first = true;
+    auto sep = [&]() {
+        if (!first) fputs(",\n", out);
+        first = false;
+    };
+
+    std::map<std::pair<uint32_t, uint64_t>, bool> tracks;
+    // (pid, cid) -> starts waiting for their end; the kernels of a graph launch share a cid
+    std::map<std::pair<uint32_t, uint64_t>, std::deque<const TraceEvent*>> open_kernels;
+    std::map<std::pair<uint32_t, uint64_t>, std::deque<const TraceEvent*>> open_copies;
+    std::map<std::pair<uint32_t, int>, int64_t> live;
+    std::map<std::pair<uint32_t, uint64_t>, uint64_t> sizes;
+    std::map<std::pair<uint32_t, uint64_t>, std::pair<uint64_t, uint64_t>> working_sets;  // (pid, cid) -> buffers, bytes
+
+    for (const auto& e : events) {
+        const AnalysisEvent& ev = e.ev;
+        tracks[{e.pid, e.tid}] = true;
+        switch (ev.type) {
+            case EventType::alloc:
+            case EventType::free: {
+                auto key = std::make_pair(e.pid, ev.device);
+                if (ev.type == EventType::alloc) {
+                    sizes[{e.pid, ev.a}] = ev.b;
+                    live[key] += (int64_t)ev.b;
+                } else {
+                    auto it = sizes.find({e.pid, ev.a});
+                    if (it != sizes.end()) {
+                        live[key] -= (int64_t)it->second;
+                        sizes.erase(it);
+                    }
+                }
+                sep();
+                fprintf(out, "{\"ph\":\"C\",\"name\":\"device %d allocated\",\"pid\":%u,\"ts\":%.3f,"
+                             "\"args\":{\"bytes\":%ld}}",
+                        ev.device, e.pid, us(ev.timestamp), (long)live[key]);
+                break;
+            }
+            case EventType::memcpy:
+                sep();
+                fprintf(out, "{\"ph\":\"i\",\"s\":\"t\",\"name\":\"memcpy %s\",\"pid\":%u,\"tid\":%lu,\"ts\":%.3f,"
+                             "\"args\":{\"dst\":\"0x%lx\",\"src\":\"0x%lx\",\"bytes\":%lu,\"async\":%u,"
+                             "\"device\":%d,\"cid\":%lu}}",
+                        copy_kind_name(ev.arg), e.pid, (unsigned long)e.tid, us(ev.timestamp), (unsigned long)ev.a,
+                        (unsigned long)ev.b, (unsigned long)ev.c, ev.is_async, ev.device,
+                        (unsigned long)ev.correlation_id);
+                open_copies[{e.pid, ev.correlation_id}].push_back(&e);
+                break;
+            case EventType::memset:
+                sep();
+                fprintf(out, "{\"ph\":\"i\",\"s\":\"t\",\"name\":\"memset\",\"pid\":%u,\"tid\":%lu,\"ts\":%.3f,"
+                             "\"args\":{\"dst\":\"0x%lx\",\"bytes\":%lu,\"value\":%d,\"async\":%u,\"device\":%d,"
+                             "\"cid\":%lu}}",
+                        e.pid, (unsigned long)e.tid, us(ev.timestamp), (unsigned long)ev.a, (unsigned long)ev.b,
+                        (int)ev.arg, ev.is_async, ev.device, (unsigned long)ev.correlation_id);
+                break;
+            case EventType::kernel_start:
+                open_kernels[{e.pid, ev.correlation_id}].push_back(&e);
+                break;
+            case EventType::kernel_end: {
+                // buffered mode: the start was staged at launch, the end carries the device times
+                auto it = open_kernels.find({e.pid, ev.correlation_id});
+                if (it == open_kernels.end()) break;
+                const TraceEvent& start = *it->second.front();
+                it->second.pop_front();
+                if (it->second.empty()) open_kernels.erase(it);
+                sep();
+                auto ws = working_sets[{e.pid, start.ev.correlation_id}];
+                uint64_t begin = ev.a != 0 ? ev.a : start.ev.timestamp;
+                fprintf(out, "{\"ph\":\"X\",\"name\":\"%s\",\"pid\":%u,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f,"
+                             "\"args\":{\"device\":%d,\"cid\":%lu,\"buffers\":%lu,\"working_set\":%lu}}",
+                        json_escape(trace.kernel_name(e.pid, start.ev.arg)).c_str(), e.pid,
+                        (unsigned long)gpu_track(ev.device), us(std::max(begin, t0)), (double)(ev.b - ev.a) / 1000.0,
+                        ev.device, (unsigned long)start.ev.correlation_id, (unsigned long)ws.first,
+                        (unsigned long)ws.second);
+                tracks[{e.pid, gpu_track(ev.device)}] = true;
+                break;
+            }
+            case EventType::kernel_buffer: {
+                auto& ws = working_sets[{e.pid, ev.correlation_id}];
+                ws.first++;
+                ws.second += ev.b;
+                break;
+            }
+            case EventType::memcpy_end: {
+                // buffered mode: the copy is an instant on its thread, the end adds the device span
+                auto it = open_copies.find({e.pid, ev.correlation_id});
+                if (it == open_copies.end()) break;
+                const TraceEvent& copy = *it->second.front();
+                it->second.pop_front();
+                if (it->second.empty()) open_copies.erase(it);
+                sep();
+                fprintf(out, "{\"ph\":\"X\",\"name\":\"memcpy %s\",\"pid\":%u,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f,"
+                             "\"args\":{\"bytes\":%lu,\"device\":%d,\"cid\":%lu}}",
+                        copy_kind_name(copy.ev.arg), e.pid, (unsigned long)gpu_track(ev.device),
+                        us(std::max(ev.a, t0)), (double)(ev.b - ev.a) / 1000.0, (unsigned long)copy.ev.c,
+                        ev.device, (unsigned long)ev.correlation_id);
+                tracks[{e.pid, gpu_track(ev.device)}] = true;
+                break;
+            }
+        }
+    }
+
+    // launches without an end (callback mode) are instants on the launching thread
+    for (const auto& entry : open_kernels) {
+        for (const TraceEvent* e : entry.second) {
+            sep();
+            fprintf(out, "{\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\",\"pid\":%u,\"tid\":%lu,\"ts\":%.3f,"
+                         "\"args\":{\"device\":%d,\"cid\":%lu}}",
+                    json_escape(trace.kernel_name(e->pid, e->ev.arg)).c_str(), e->pid, (unsigned long)e->tid,
+                    us(e->ev.timestamp), e->ev.device, (unsigned long)e->ev.correlation_id);
+        }
+    }
+    for (const auto& track : tracks) {
+        sep();
+        uint64_t tid = track.first.second;
+        if (tid >= gpu_track(0))
+            fprintf(out, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%u,\"tid\":%lu,\"args\":{\"name\":\"GPU %lu\"}}",
+                    track.first.first, (unsigned long)tid, (unsigned long)(tid - gpu_track(0)));
+        else
+            fprintf(out, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%u,\"tid\":%lu,\"args\":{\"name\":\"host %lu\"}}",
+                    track.first.first, (unsigned long)tid, (unsigned long)tid);
+    }
+    fprintf(out, "\n]}\n");
+}
+
+void write_csv(const TraceReader& trace, FILE* out)
+{
+    struct Totals {
+        uint64_t count = 0;
+        uint64_t bytes = 0;
+    };
+    // (pid, section, name, device)
+    std::map<std::tuple<uint32_t, std::string, std::string, int>, Totals> rows;
+    std::map<std::pair<uint32_t, int>, std::pair<int64_t, int64_t>> live;  // current, peak
+    std::unordered_map<uint64_t, uint64_t> sizes;
+
+    for (const auto& e : trace.events()) {
+        const AnalysisEvent& ev = e.ev;
+        Totals* t = nullptr;
+        uint64_t bytes = 0;
+        switch (ev.type) {
+            case EventType::alloc: {
+                t = &rows[{e.pid, "alloc", "", ev.device}];
+                bytes = ev.b;
+                sizes[ev.a ^ ((uint64_t)e.pid << 48)] = ev.b;
+                auto& l = live[{e.pid, ev.device}];
+                l.first += (int64_t)ev.b;
+                l.second = std::max(l.second, l.first);
+                break;
+            }
+            case EventType::free: {
+                t = &rows[{e.pid, "free", "", ev.device}];
+                auto it = sizes.find(ev.a ^ ((uint64_t)e.pid << 48));
+                if (it != sizes.end()) {
+                    bytes = it->second;
+                    live[{e.pid, ev.device}].first -= (int64_t)it->second;
+                    sizes.erase(it);
+                }
+                break;
+            }
+            case EventType::memcpy:
+                t = &rows[{e.pid, "memcpy", copy_kind_name(ev.arg), ev.device}];
+                bytes = ev.c;
+                break;
+            case EventType::memset:
+                t = &rows[{e.pid, "memset", "", ev.device}];
+                bytes = ev.b;
+                break;
+            case EventType::kernel_start:
+                t = &rows[{e.pid, "kernel", trace.kernel_name(e.pid, ev.arg), ev.device}];
+                break;
+            case EventType::kernel_end:
+            case EventType::memcpy_end:
+                break;
+            case EventType::kernel_buffer:
+                t = &rows[{e.pid, "kernel_buffer", "", ev.device}];
+                bytes = ev.b;
+                break;
+        }
+        if (t != nullptr) {
+            t->count++;
+            t->bytes += bytes;
+        }
+    }
+
+    fprintf(out, "pid,section,name,device,count,bytes\n");
+    for (const auto& row : rows) {
+        fprintf(out, "%u,%s,%s,%d,%lu,%lu\n", std::get<0>(row.first), std::get<1>(row.first).c_str(),
+                csv_quote(std::get<2>(row.first)).c_str(), std::get<3>(row.first), (unsigned long)row.second.count,
+                (unsigned long)row.second.bytes);
+    }
+    for (const auto& l : live)
+        fprintf(out, "%u,peak_allocated,\"\",%d,0,%ld\n", l.first.first, l.first.second, (long)l.second.second);
+}
+
+void write_dump(const TraceReader& trace, FILE* out)
+{
+    char line[8192];
+    for (const auto& e : trace.events()) {
+        format_text(line, sizeof(line), trace, e);
+        fprintf(out, "%s\n", line);
+    }
+}
+
+void write_stats(const TraceReader& trace, FILE* out)
+{
+    char line[8192];
+    uint64_t text_bytes = 0;
+    for (const auto& e : trace.events()) text_bytes += std::min<int>(format_text(line, sizeof(line), trace, e), sizeof(line) - 1) + 1;
+    size_t n = trace.events().size();
+    fprintf(out, "segments:        %zu\n", trace.segments());
+    fprintf(out, "events:          %zu\n", n);
+    fprintf(out, "trace bytes:     %lu (%.1f per event)\n", (unsigned long)trace.trace_bytes(),
+            n ? (double)trace.trace_bytes() / n : 0.0);
+    fprintf(out, "text log bytes:  %lu (%.1f per event)\n", (unsigned long)text_bytes, n ? (double)text_bytes / n : 0.0);
+    fprintf(out, "ratio:           %.1fx\n", trace.trace_bytes() ? (double)text_bytes / trace.trace_bytes() : 0.0);
+}
+
+int usage()
+{
+    fprintf(stderr, "usage: accelprof-trace json|csv|dump|stats <trace dir|segment files...> [-o output]\n");
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) return usage();
+    std::string command = argv[1];
+
+    TraceReader trace;
+    const char* output = nullptr;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+            continue;
+        }
+        std::string error;
+        if (!trace.add_path(argv[i], error)) {
+            fprintf(stderr, "accelprof-trace: %s\n", error.c_str());
+            return 1;
+        }
+    }
+    trace.finish();
+
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (out == nullptr) {
+        fprintf(stderr, "accelprof-trace: cannot write %s\n", output);
+        return 1;
+    }
+    if (command == "json") write_json(trace, out);
+    else if (command == "csv") write_csv(trace, out);
+    else if (command == "dump") write_dump(trace, out);
+    else if (command == "stats") write_stats(trace, out);
+    else return usage();
+    if (out != stdout) fclose(out);
+    return 0;
+}
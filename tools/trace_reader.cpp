@@ -0,0 +1,126 @@
+#include "trace_reader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rocm_accelprof {
+
+bool TraceReader::add_path(const std::string& path, std::string& error)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        error = "cannot stat " + path;
+        return false;
+    }
+    if (!S_ISDIR(st.st_mode)) return add_file(path, error);
+
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        error = "cannot open directory " + path;
+        return false;
+    }
+    std::vector<std::string> files;
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > 6 && name.compare(name.size() - 6, 6, ".trace") == 0) files.push_back(path + "/" + name);
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+    for (const auto& file : files)
+        if (!add_file(file, error)) return false;
+    return true;
+}
+
+bool TraceReader::add_file(const std::string& path, std::string& error)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        error = "cannot open " + path;
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size < sizeof(TraceFileHeader)) {
+        close(fd);
+        error = path + ": not a trace segment";
+        return false;
+    }
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        error = "cannot map " + path;
+        return false;
+    }
+
+    const uint8_t* data = static_cast<const uint8_t*>(map);
+    TraceFileHeader header;
+    memcpy(&header, data, sizeof(header));
+    // every version adds record types, older segments decode unchanged
+    if (memcmp(header.magic, kTraceMagic, sizeof(kTraceMagic)) != 0 || header.version == 0 ||
+        header.version > kTraceVersion) {
+        munmap(map, size);
+        error = path + ": not a version 1-" + std::to_string(kTraceVersion) + " trace segment";
+        return false;
+    }
+
+    TraceDeltaState prev;
+    prev.version = header.version;
+    prev.timestamp = header.base_timestamp;
+    const uint8_t* in = data + header.header_size;
+    const uint8_t* end = data + size;
+    bool ok = true;
+    while (in < end && *in != kTraceEnd) {
+        uint8_t type = *in++;
+        if (type == kTraceName) {
+            uint64_t id = 0, len = 0;
+            if (!get_varint(in, end, id) || !get_varint(in, end, len) || len > (uint64_t)(end - in)) {
+                ok = false;
+                break;
+            }
+            names_[{header.pid, (uint32_t)id}].assign(reinterpret_cast<const char*>(in), len);
+            in += len;
+            continue;
+        }
+        TraceEvent event{{}, header.pid, header.tid};
+        uint8_t event_type = type & ~kTraceNewDevice;
+        if (event_type == 0 || event_type >= kNumEventTypes ||
+            !decode_event(in, end, type, event.ev, prev)) {
+            ok = false;
+            break;
+        }
+        events_.push_back(event);
+    }
+    munmap(map, size);
+
+    trace_bytes_ += size;
+    segments_++;
+    if (!ok) {
+        // a truncated segment (crashed writer): keep what decoded cleanly
+        fprintf(stderr, "warning: %s: corrupt record, rest of the segment skipped\n", path.c_str());
+    }
+    return true;
+}
+
+void TraceReader::finish()
+{
+    std::sort(events_.begin(), events_.end(), [](const TraceEvent& a, const TraceEvent& b) {
+        return a.pid != b.pid ? a.pid < b.pid : a.ev.seq < b.ev.seq;
+    });
+}
+
+const std::string& TraceReader::kernel_name(uint32_t pid, uint32_t id) const
+{
+    static const std::string unknown = "unknown";
+    auto it = names_.find({pid, id});
+    return it != names_.end() ? it->second : unknown;
+}
+
+} // namespace rocm_accelprof
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "analysis_event.h"
+#include "trace_format.h"
+
+// Reader for the binary trace format (src/trace_format.h), shared by the offline tools.
+//
+// Segment files are mapped read-only and decoded in place; the events of all segments are
+// merged into the global order, per process by sequence number.
+
+namespace rocm_accelprof {
+
+struct TraceEvent {
+    AnalysisEvent ev;
+    uint32_t pid;
+    uint64_t tid;
+};
+
+class TraceReader {
+public:
+    // A segment file, or a directory whose *.trace files are all loaded.
+    bool add_path(const std::string& path, std::string& error);
+
+    // Sorts the events loaded so far into (pid, seq) order.
+    void finish();
+
+    const std::vector<TraceEvent>& events() const { return events_; }
+    const std::string& kernel_name(uint32_t pid, uint32_t id) const;
+
+    uint64_t trace_bytes() const { return trace_bytes_; }
+    size_t segments() const { return segments_; }
+
+private:
+    bool add_file(const std::string& path, std::string& error);
+
+    std::vector<TraceEvent> events_;
+    std::map<std::pair<uint32_t, uint32_t>, std::string> names_;
+    uint64_t trace_bytes_ = 0;
+    size_t segments_ = 0;
+};
+
+} // namespace rocm_accelprof
@@ -1,10 +1,27 @@
 #include <cstdio>
 #include <cinttypes>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
 #include <memory>
 #include <atomic>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+#include <link.h>
+#include <stdio_ext.h>
 
 #include <torch/extension.h>
 
+#include "env.h"
+#include "process.h"
+#include "sanalyzer.h"
+#include "tensor_segments.h"
+#include "torch_scopes.h"
+
 #define VERBOSE 1
 
 #ifdef VERBOSE
@@ -13,28 +30,377 @@
 #define PRINT(fmt, ...) do {} while (0)
 #endif
 
+// Tensor allocations reported by the caching allocator are recorded as fixed-size events
+// into per-thread buffers and handed on in batches, so a report costs a sequence number
+// and a store instead of a formatted, flushed line.
+//
+// ACCELPROF_TORCH_OUTPUT is a comma list of what a flushed batch feeds (default
+// sanalyzer,segments,counters):
+//   sanalyzer - yosemite_tensor_malloc/free_callback, in report order across threads
+//   segments  - the ROCm backend's tensor-to-segment registry (src/tensor_segments.h),
+//               once librocm_callback.so is loaded in the process; it is looked for
+//               again at every flush until found, and allocations recorded after that
+//               carry the segment they were made in
+//   counters  - per-device running totals, written at exit
+//   print     - the old one line per event (buffered, for debugging)
+// ACCELPROF_TORCH_TRACE=<file> (%p, %r and %h expand as in process.h) also appends the
+// raw events to a binary file: the TorchTraceHeader followed by TensorEvent records; with
+// ACCELPROF_TORCH_SCOPES the scope table that decodes their scope ids is written next to
+// it as <file>.scopes.
+//
+// A batch is flushed when a thread's buffer is full, at exit, and on
+// accelprof_torch_flush() (e.g. once per training step). Forked children (DataLoader
+// workers) record nothing and write no summary, the parent's events stay the parent's.
+
+namespace {
+
+using namespace rocm_accelprof;
+
+// ----------- fixed-size tensor events -----------
+struct TensorEvent {
+  uint64_t seq;          // report order across threads
+  uint64_t ptr;
+  int64_t delta;         // negative on frees
+  int64_t total_allocated;
+  int64_t total_reserved;
+  int32_t device;
+  uint32_t scope;        // node of torch_scopes.h, kRootScope when scopes are off
+  uint64_t time_ns;      // steady clock at report time
+  uint64_t segment;      // allocation id under an allocated tensor, kTensorSegmentUnresolved if unknown
+};
+static_assert(sizeof(TensorEvent) == 64, "tensor events are part of the trace format");
+
+struct TorchTraceHeader {
+  char magic[8];         // "APTORCH"
+  uint32_t version;
+  uint32_t record_size;
+};
+
+constexpr size_t kBatchEvents = 4096;
+constexpr int kMaxDevices = 64;
+// a thread that records without a backend looks for it again after this many events
+constexpr uint64_t kBackendRetryEvents = 1024;
+
+enum TorchOutput : uint32_t {
+  kOutSanalyzer = 1u << 0,
+  kOutCounters  = 1u << 1,
+  kOutPrint     = 1u << 2,
+  kOutTrace     = 1u << 3,
+  kOutSegments  = 1u << 4,
+};
+
+using tensor_event_fn = decltype(&accelprof_tensor_event);
+using tensor_segment_fn = decltype(&accelprof_tensor_segment);
+
+// Filled by the owning thread. The lock is only contended while a flush collects the
+// buffers; sequence numbers are taken under it, so a flush that holds every buffer lock
+// sees every event stamped so far.
+struct TensorBuffer {
+  std::mutex mutex;
+  std::vector<TensorEvent> events;
+  std::atomic<bool> owned{false};
+};
+
+struct DeviceCounters {
+  uint64_t allocs = 0;
+  uint64_t frees = 0;
+  uint64_t alloc_bytes = 0;
+  int64_t peak_allocated = 0;
+  int64_t peak_reserved = 0;
+};
+
+struct TorchState {
+  uint32_t outputs = kOutSanalyzer | kOutSegments | kOutCounters;
+  // set once the backend is found; the event hook is stored first
+  std::atomic<tensor_event_fn> backend_tensor_event{nullptr};
+  std::atomic<tensor_segment_fn> backend_tensor_segment{nullptr};
+  std::atomic<uint64_t> next_seq{0};
+  std::mutex buffers_mutex;              // guards buffers
+  std::vector<TensorBuffer*> buffers;    // never freed; buffers of exited threads are reused
+  std::mutex flush_mutex;                // serializes flushes, guards everything below
+  std::vector<TensorEvent> batch;
+  FILE* trace = nullptr;
+  std::string trace_path;
+  uint64_t flushes = 0;
+  DeviceCounters devices[kMaxDevices];
+};
+
+TorchState& state() {
+  static auto* s = new TorchState();
+  return *s;
+}
+
+// Releases the buffer of an exiting thread so that a later thread can take it over.
+struct BufferOwner {
+  TensorBuffer* buffer = nullptr;
+  ~BufferOwner() {
+    if (buffer) buffer->owned.store(false, std::memory_order_release);
+  }
+};
+
+thread_local BufferOwner tls_buffer;
+thread_local uint64_t tls_records_without_backend = 0;
+
+TensorBuffer* acquire_buffer() {
+  auto& s = state();
+  std::lock_guard<std::mutex> lock(s.buffers_mutex);
+  for (auto* b : s.buffers) {
+    bool expected = false;
+    if (b->owned.compare_exchange_strong(expected, true)) return b;
+  }
+  auto* b = new TensorBuffer();
+  b->events.reserve(kBatchEvents);
+  b->owned.store(true);
+  s.buffers.push_back(b);
+  return b;
+}
+
+// The backend may have been loaded RTLD_LOCAL by rocprofiler-sdk, so look for it by path
+// when the global lookup fails.
+void* find_backend_symbol(const char* symbol) {
+  void* fn = dlsym(RTLD_DEFAULT, symbol);
+  if (fn == nullptr) {
+    struct Lookup {
+      const char* symbol;
+      void* fn;
+    } lookup{symbol, nullptr};
+    dl_iterate_phdr([](struct dl_phdr_info* info, size_t, void* data) -> int {
+      const char* name = info->dlpi_name;
+      if (name == nullptr || std::strstr(name, "librocm_callback.so") == nullptr) return 0;
+      auto* l = static_cast<Lookup*>(data);
+      if (void* handle = dlopen(name, RTLD_NOW | RTLD_NOLOAD)) l->fn = dlsym(handle, l->symbol);
+      return 1;
+    }, &lookup);
+    fn = lookup.fn;
+  }
+  return fn;
+}
+
+// The ROCm backend is usually loaded after us, when HIP initializes, so it is looked for
+// until it is found. Returns its segment lookup, null while it is missing.
+tensor_segment_fn connect_backend(TorchState& s) {
+  if (auto segment = s.backend_tensor_segment.load(std::memory_order_acquire)) return segment;
+  auto event = reinterpret_cast<tensor_event_fn>(find_backend_symbol("accelprof_tensor_event"));
+  auto segment = reinterpret_cast<tensor_segment_fn>(find_backend_symbol("accelprof_tensor_segment"));
+  if (event == nullptr || segment == nullptr) return nullptr;
+  s.backend_tensor_event.store(event, std::memory_order_release);
+  s.backend_tensor_segment.store(segment, std::memory_order_release);
+  return segment;
+}
+
+void forward_event(TorchState& s, const TensorEvent& ev) {
+  if (s.outputs & kOutSanalyzer) {
+    if (ev.delta > 0)
+      yosemite_tensor_malloc_callback(ev.ptr, ev.delta, ev.total_allocated, ev.total_reserved, ev.device);
+    else
+      yosemite_tensor_free_callback(ev.ptr, ev.delta, ev.total_allocated, ev.total_reserved, ev.device);
+  }
+  if (s.outputs & kOutSegments) {
+    if (auto fn = s.backend_tensor_event.load(std::memory_order_acquire))
+      fn(ev.ptr, ev.delta, ev.total_allocated, ev.total_reserved, ev.device, ev.segment, ev.time_ns);
+  }
+  if (scopes_active) scopes_on_event(ev.ptr, ev.delta, ev.scope);
+  if (s.outputs & kOutCounters) {
+    DeviceCounters& c = s.devices[std::min(std::max(ev.device, 0), kMaxDevices - 1)];
+    if (ev.delta > 0) {
+      c.allocs++;
+      c.alloc_bytes += (uint64_t)ev.delta;
+    } else {
+      c.frees++;
+    }
+    c.peak_allocated = std::max(c.peak_allocated, ev.total_allocated);
+    c.peak_reserved = std::max(c.peak_reserved, ev.total_reserved);
+  }
+  if (s.outputs & kOutPrint) {
+    std::fprintf(stdout, "%s tensor %" PRIu64 " with size %" PRId64 ", allocated %" PRId64 ", reserved %" PRId64
+                 " on device %d\n", ev.delta > 0 ? "Malloc" : "Free", ev.ptr, ev.delta, ev.total_allocated,
+                 ev.total_reserved, ev.device);
+  }
+}
+
+// Collects every buffer and forwards the events in report order.
+void flush_all() {
+  auto& s = state();
+  std::lock_guard<std::mutex> flush_lock(s.flush_mutex);
+  std::vector<TensorBuffer*> buffers;
+  {
+    std::lock_guard<std::mutex> lock(s.buffers_mutex);
+    buffers = s.buffers;
+  }
+  for (auto* b : buffers) b->mutex.lock();
+  for (auto* b : buffers) {
+    s.batch.insert(s.batch.end(), b->events.begin(), b->events.end());
+    b->events.clear();
+  }
+  for (auto* b : buffers) b->mutex.unlock();
+  if (s.batch.empty()) return;
+  if (s.outputs & kOutSegments) connect_backend(s);
+
+  std::sort(s.batch.begin(), s.batch.end(),
+            [](const TensorEvent& a, const TensorEvent& b) { return a.seq < b.seq; });
+  for (const auto& ev : s.batch) forward_event(s, ev);
+  if (s.trace) std::fwrite(s.batch.data(), sizeof(TensorEvent), s.batch.size(), s.trace);
+  s.flushes++;
+  s.batch.clear();
+}
+
+void record(uint64_t ptr, int64_t delta, int64_t total_allocated, int64_t total_reserved, int device) {
+  if (process_is_fork_child()) return;
+  auto& s = state();
+  if (tls_buffer.buffer == nullptr) tls_buffer.buffer = acquire_buffer();
+  TensorBuffer* b = tls_buffer.buffer;
+  uint32_t scope = scopes_active && delta > 0 ? current_scope() : kRootScope;
+  // the segment under the tensor now; by the flush it may be gone and its range reused
+  uint64_t segment = kTensorSegmentUnresolved;
+  if (delta > 0 && (s.outputs & kOutSegments)) {
+    tensor_segment_fn lookup = s.backend_tensor_segment.load(std::memory_order_acquire);
+    if (lookup == nullptr && tls_records_without_backend++ % kBackendRetryEvents == 0) lookup = connect_backend(s);
+    if (lookup != nullptr) segment = lookup(ptr);
+  }
+  bool full;
+  {
+    std::lock_guard<std::mutex> lock(b->mutex);
+    uint64_t now = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch()).count();
+    b->events.push_back({s.next_seq.fetch_add(1, std::memory_order_relaxed), ptr, delta, total_allocated,
+                         total_reserved, device, scope, now, segment});
+    full = b->events.size() >= kBatchEvents;
+  }
+  if (full) flush_all();
+}
+
+void write_counters(FILE* out) {
+  auto& s = state();
+  std::lock_guard<std::mutex> lock(s.flush_mutex);
+  if (!(s.outputs & kOutCounters)) return;
+  for (int d = 0; d < kMaxDevices; d++) {
+    const DeviceCounters& c = s.devices[d];
+    if (c.allocs == 0 && c.frees == 0) continue;
+    std::fprintf(out, "[ROCMPROF SUMMARY] torch device %d: %" PRIu64 " tensor allocs (%" PRIu64 " bytes), %"
+                 PRIu64 " frees, peak allocated %" PRId64 ", peak reserved %" PRId64 "\n",
+                 d, c.allocs, c.alloc_bytes, c.frees, c.peak_allocated, c.peak_reserved);
+    process_report(out, ReportMerge::sum, (double)c.allocs, "torch.device.%d.tensor_allocs", d);
+    process_report(out, ReportMerge::sum, (double)c.alloc_bytes, "torch.device.%d.tensor_alloc_bytes", d);
+    process_report(out, ReportMerge::sum, (double)c.frees, "torch.device.%d.tensor_frees", d);
+    process_report(out, ReportMerge::max, (double)c.peak_allocated, "torch.device.%d.peak_allocated", d);
+    process_report(out, ReportMerge::max, (double)c.peak_reserved, "torch.device.%d.peak_reserved", d);
+  }
+  std::fprintf(out, "[ROCMPROF SUMMARY] torch: %" PRIu64 " tensor events in %" PRIu64 " batches\n",
+               s.next_seq.load(), s.flushes);
+  process_report(out, ReportMerge::sum, (double)s.next_seq.load(), "torch.tensor_events");
+  process_report(out, ReportMerge::sum, (double)s.flushes, "torch.batches");
+}
+
+void write_summary(FILE* out) {
+  write_counters(out);
+  std::lock_guard<std::mutex> lock(state().flush_mutex);
+  scopes_write_report(out);
+}
+
+// Built in memory when a job aggregator is configured: the text is written, the records sent.
+void write_summaries() {
+  char* text = nullptr;
+  size_t len = 0;
+  FILE* mem = process_aggregating() ? open_memstream(&text, &len) : nullptr;
+  if (mem == nullptr) {
+    write_summary(stdout);
+    return;
+  }
+  write_summary(mem);
+  std::fclose(mem);
+  std::string display, records;
+  process_split_report(text, len, display, records);
+  std::free(text);
+  std::fwrite(display.data(), 1, display.size(), stdout);
+  process_send_report("torch", records.data(), records.size());
+}
+
+void torch_shutdown() {
+  if (process_is_fork_child()) return;
+  flush_all();
+  write_summaries();
+  auto& s = state();
+  std::lock_guard<std::mutex> lock(s.flush_mutex);
+  if (s.trace) {
+    std::fclose(s.trace);
+    s.trace = nullptr;
+    if (scopes_active) {
+      std::string path = s.trace_path + ".scopes";
+      if (FILE* out = std::fopen(path.c_str(), "w")) {
+        scopes_write_table(out);
+        std::fclose(out);
+      }
+    }
+  }
+  std::fflush(stdout);
+}
+
+void configure_outputs() {
+  auto& s = state();
+  if (const char* spec = env_cstr("ACCELPROF_TORCH_OUTPUT")) {
+    s.outputs = 0;
+    std::string list = spec;
+    std::replace(list.begin(), list.end(), ',', ' ');
+    std::istringstream words(list);
+    std::string word;
+    while (words >> word) {
+      if (word == "sanalyzer") s.outputs |= kOutSanalyzer;
+      else if (word == "segments") s.outputs |= kOutSegments;
+      else if (word == "counters") s.outputs |= kOutCounters;
+      else if (word == "print") s.outputs |= kOutPrint;
+      else if (word != "none")
+        std::fprintf(stderr, "[ROCMPROF WARNING] unknown ACCELPROF_TORCH_OUTPUT entry '%s'\n", word.c_str());
+    }
+  }
+  std::string path = process_expand_path(env_string("ACCELPROF_TORCH_TRACE"));
+  if (!path.empty()) {
+    s.trace = std::fopen(path.c_str(), "wb");
+    s.trace_path = path;
+    if (s.trace == nullptr) {
+      std::fprintf(stderr, "[ROCMPROF WARNING] cannot create ACCELPROF_TORCH_TRACE '%s'\n", path.c_str());
+    } else {
+      TorchTraceHeader header{{'A', 'P', 'T', 'O', 'R', 'C', 'H', '\0'}, 3, (uint32_t)sizeof(TensorEvent)};
+      std::fwrite(&header, sizeof(header), 1, s.trace);
+      s.outputs |= kOutTrace;
+    }
+  }
+}
+
+// Fork: both locks are held across it so the child never inherits them locked. The child
+// discards the trace data the parent left buffered, or its exit would write it again.
+void before_fork() {
+  auto& s = state();
+  s.flush_mutex.lock();
+  s.buffers_mutex.lock();
+}
+
+void after_fork_parent() {
+  auto& s = state();
+  s.buffers_mutex.unlock();
+  s.flush_mutex.unlock();
+}
+
+void after_fork_child() {
+  auto& s = state();
+  s.buffers_mutex.unlock();
+  s.flush_mutex.unlock();
+  if (s.trace) {
+    __fpurge(s.trace);
+    std::fclose(s.trace);
+    s.trace = nullptr;
+  }
+}
+
+} // namespace
+
 static inline bool is_cuda_or_hip(const c10::Device& d) {
   using DT = c10::DeviceType;
   return d.type() == DT::CUDA || d.type() == DT::HIP;
 }
 
-// ----------- simple logging (no globals/objects needed) -----------
-static inline void tensor_malloc_callback(uint64_t ptr,
-                              int64_t bytes,
-                              int64_t total_alloc,
-                              int64_t total_resv,
-                              int device_id) {
-  PRINT("Malloc tensor %lu with size %ld, allocated %ld, reserved %ld on device %d\n",
-        ptr, bytes, total_alloc, total_resv, device_id);
-}
-
-static inline void tensor_free_callback(uint64_t ptr,
-                            int64_t bytes,  // negative delta on frees
-                            int64_t total_alloc,
-                            int64_t total_resv,
-                            int device_id) {
-  PRINT("Free tensor %lu with size %ld, allocated %ld, reserved %ld on device %d\n",
-        ptr, bytes, total_alloc, total_resv, device_id);
+// Forwards everything recorded so far; callable from Python through ctypes.
+extern "C" void accelprof_torch_flush() {
+  flush_all();
 }
 
 // ----------- Profiler callback -----------
@@ -51,19 +417,7 @@ public:
                          size_t total_reserved,
                          c10::Device device) override {
     if (!is_cuda_or_hip(device)) return;
-    if (alloc_size > 0) {
-      tensor_malloc_callback((uint64_t)ptr,
-                 (int64_t)alloc_size,
-                 (int64_t)total_allocated,
-                 (int64_t)total_reserved,
-                 device.index());
-    } else {
-      tensor_free_callback((uint64_t)ptr,
-               (int64_t)alloc_size,
-               (int64_t)total_allocated,
-               (int64_t)total_reserved,
-               device.index());
-    }
+    record((uint64_t)ptr, alloc_size, (int64_t)total_allocated, (int64_t)total_reserved, device.index());
   }
 #else
   // PyTorch 1.x: totals are int64_t
@@ -73,19 +427,7 @@ public:
                          int64_t total_reserved,
                          c10::Device device) override {
     if (!is_cuda_or_hip(device)) return;
-    if (alloc_size > 0) {
-      tensor_malloc_callback((uint64_t)ptr,
-                 (int64_t)alloc_size,
-                 (int64_t)total_allocated,
-                 (int64_t)total_reserved,
-                 device.index());
-    } else {
-      tensor_free_callback((uint64_t)ptr,
-               (int64_t)alloc_size,
-               (int64_t)total_allocated,
-               (int64_t)total_reserved,
-               device.index());
-    }
+    record((uint64_t)ptr, alloc_size, total_allocated, total_reserved, device.index());
   }
 #endif
 };
@@ -109,6 +451,11 @@ static void tensor_scope_on_load() {
   if (installed.exchange(true)) return;
 
   PRINT("tensor_scope: constructor @%p\n", (void*)&tensor_scope_on_load);
+  configure_outputs();
+  scopes_init();
+  process_init();
+  pthread_atfork(before_fork, after_fork_parent, after_fork_child);
+  std::atexit(torch_shutdown);
   g_prof = make_profiler_never_delete();
   c10::ThreadLocalDebugInfo::_push(c10::DebugInfoKind::PROFILER_STATE, g_prof);
 
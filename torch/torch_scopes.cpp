@@ -0,0 +1,294 @@
+#include <torch/extension.h>
+#include <ATen/record_function.h>
+
+#include "torch_scopes.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "env.h"
+#include "process.h"
+
+namespace rocm_accelprof {
+
+bool scopes_active = false;
+
+namespace {
+
+constexpr uint32_t kMaxScopeDepth = 64;
+constexpr uint32_t kOtherName = 1;   // names past kMaxScopeNames
+
+struct ScopeNode {
+  uint32_t parent;
+  uint32_t name;
+};
+
+// Hash-consed scope stacks: a node is its parent node and an interned name.
+struct ScopeTable {
+  std::mutex mutex;
+  std::unordered_map<std::string, uint32_t> name_ids;
+  std::vector<std::string> names;
+  std::unordered_map<uint64_t, uint32_t> node_ids;   // parent << 32 | name
+  std::vector<ScopeNode> nodes;
+  std::atomic<uint64_t> overflow{0};                  // scopes charged to an ancestor
+  uint64_t other_names = 0;                           // lookups answered with kOtherName
+
+  ScopeTable() {
+    names.push_back("<no operator>");
+    name_ids.emplace(names.back(), 0);
+    names.push_back("<other>");
+    name_ids.emplace(names.back(), kOtherName);
+    nodes.push_back({kRootScope, 0});
+  }
+};
+
+ScopeTable& table() {
+  static auto* t = new ScopeTable();
+  return *t;
+}
+
+uint32_t intern_name_locked(ScopeTable& t, const std::string& name) {
+  auto it = t.name_ids.find(name);
+  if (it != t.name_ids.end()) return it->second;
+  // a full node table cannot take a scope with a new name either
+  if (t.names.size() >= kMaxScopeNames || t.nodes.size() >= kMaxScopeNodes) {
+    t.other_names++;
+    return kOtherName;
+  }
+  uint32_t id = (uint32_t)t.names.size();
+  t.names.push_back(name);
+  t.name_ids.emplace(name, id);
+  return id;
+}
+
+uint32_t child_locked(ScopeTable& t, uint32_t parent, uint32_t name) {
+  uint64_t key = (uint64_t)parent << 32 | name;
+  auto it = t.node_ids.find(key);
+  if (it != t.node_ids.end()) return it->second;
+  if (t.nodes.size() >= kMaxScopeNodes) {
+    t.overflow.fetch_add(1, std::memory_order_relaxed);
+    return parent;
+  }
+  uint32_t id = (uint32_t)t.nodes.size();
+  t.nodes.push_back({parent, name});
+  t.node_ids.emplace(key, id);
+  return id;
+}
+
+// Operator names are static strings, so the thread caches them by address; user scope
+// names are not and are interned by content.
+struct ScopeStack {
+  uint32_t depth = 0;
+  uint32_t nodes[kMaxScopeDepth + 1] = {kRootScope};
+  std::unordered_map<const char*, uint32_t> operator_names;
+  std::unordered_map<uint64_t, uint32_t> children;
+  uint64_t allocations = 0;
+
+  uint32_t top() const { return nodes[std::min(depth, kMaxScopeDepth)]; }
+};
+
+thread_local ScopeStack tls_stack;
+
+uint32_t python_every = 0;
+
+uint32_t enter_child(ScopeStack& stack, uint32_t parent, uint32_t name) {
+  uint64_t key = (uint64_t)parent << 32 | name;
+  auto it = stack.children.find(key);
+  if (it != stack.children.end()) return it->second;
+  auto& t = table();
+  uint32_t id;
+  {
+    std::lock_guard<std::mutex> lock(t.mutex);
+    id = child_locked(t, parent, name);
+  }
+  stack.children.emplace(key, id);
+  return id;
+}
+
+void push_scope(const char* name, bool static_name) {
+  ScopeStack& stack = tls_stack;
+  if (stack.depth < kMaxScopeDepth) {
+    uint32_t name_id;
+    auto cached = static_name ? stack.operator_names.find(name) : stack.operator_names.end();
+    if (cached != stack.operator_names.end()) {
+      name_id = cached->second;
+    } else {
+      auto& t = table();
+      {
+        std::lock_guard<std::mutex> lock(t.mutex);
+        name_id = intern_name_locked(t, name);
+      }
+      if (static_name) stack.operator_names.emplace(name, name_id);
+    }
+    stack.nodes[stack.depth + 1] = enter_child(stack, stack.nodes[stack.depth], name_id);
+  } else {
+    table().overflow.fetch_add(1, std::memory_order_relaxed);
+  }
+  stack.depth++;
+}
+
+std::unique_ptr<at::ObserverContext> on_function_enter(const at::RecordFunction& fn) {
+#if defined(TORCH_VERSION_MAJOR) && (TORCH_VERSION_MAJOR >= 2)
+  const char* name = fn.name();
+#else
+  const char* name = fn.name().str();
+#endif
+  push_scope(name, fn.scope() == at::RecordScope::FUNCTION);
+  return nullptr;
+}
+
+void on_function_exit(const at::RecordFunction&, at::ObserverContext*) {
+  if (tls_stack.depth > 0) tls_stack.depth--;
+}
+
+// "file:line function" of the running Python frame, empty without the GIL.
+std::string python_frame() {
+  if (!Py_IsInitialized() || !PyGILState_Check()) return {};
+  PyFrameObject* frame = PyEval_GetFrame();
+  if (frame == nullptr) return {};
+#if PY_VERSION_HEX >= 0x03090000
+  PyCodeObject* code = PyFrame_GetCode(frame);
+#else
+  PyCodeObject* code = frame->f_code;
+  Py_XINCREF(code);
+#endif
+  if (code == nullptr) return {};
+  const char* file = PyUnicode_AsUTF8(code->co_filename);
+  const char* func = PyUnicode_AsUTF8(code->co_name);
+  std::string name = std::string(file ? file : "?") + ":" + std::to_string(PyFrame_GetLineNumber(frame)) + " " +
+                     (func ? func : "?");
+  Py_DECREF(code);
+  return name;
+}
+
+// ----------- accounting, under the caller's flush lock -----------
+struct ScopeStats {
+  int64_t live = 0;
+  int64_t peak = 0;
+  uint64_t allocs = 0;
+  uint64_t bytes = 0;
+};
+
+std::vector<ScopeStats> stats;
+std::unordered_map<uint64_t, std::pair<uint32_t, int64_t>> live_tensors;  // ptr -> scope, bytes
+int64_t live_total = 0;
+int64_t peak_total = 0;
+int64_t snapshot_total = 0;
+std::vector<int64_t> snapshot;   // live bytes per node at the last recorded peak
+
+std::string scope_path(const ScopeTable& t, uint32_t node) {
+  std::vector<uint32_t> chain;
+  for (uint32_t n = node; n != kRootScope; n = t.nodes[n].parent) chain.push_back(n);
+  if (chain.empty()) return t.names[0];
+  std::string path;
+  for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+    if (!path.empty()) path += " > ";
+    path += t.names[t.nodes[*it].name];
+  }
+  return path;
+}
+
+} // namespace
+
+void scopes_init() {
+  if (!env_bool("ACCELPROF_TORCH_SCOPES", false)) return;
+  python_every = (uint32_t)env_u64("ACCELPROF_TORCH_PYFRAME", 0);
+  at::addGlobalCallback(at::RecordFunctionCallback(&on_function_enter, &on_function_exit)
+                            .scopes({at::RecordScope::FUNCTION, at::RecordScope::USER_SCOPE}));
+  scopes_active = true;
+}
+
+uint32_t current_scope() {
+  ScopeStack& stack = tls_stack;
+  uint32_t node = stack.top();
+  if (python_every != 0 && ++stack.allocations % python_every == 0) {
+    std::string frame = python_frame();
+    if (!frame.empty()) {
+      auto& t = table();
+      std::lock_guard<std::mutex> lock(t.mutex);
+      node = child_locked(t, node, intern_name_locked(t, frame));
+    }
+  }
+  return node;
+}
+
+void scopes_on_event(uint64_t ptr, int64_t delta, uint32_t scope) {
+  if (delta > 0) {
+    if (stats.size() <= scope) stats.resize(scope + 1);
+    auto& s = stats[scope];
+    s.allocs++;
+    s.bytes += (uint64_t)delta;
+    s.live += delta;
+    s.peak = std::max(s.peak, s.live);
+    live_total += delta;
+    live_tensors[ptr] = {scope, delta};
+
+    if (live_total > peak_total) {
+      peak_total = live_total;
+      // re-snapshot once the peak has grown by 1%, which bounds the number of copies
+      if (live_total >= snapshot_total + std::max<int64_t>(snapshot_total / 100, 1 << 20)) {
+        snapshot.resize(stats.size());
+        for (size_t i = 0; i < stats.size(); i++) snapshot[i] = stats[i].live;
+        snapshot_total = live_total;
+      }
+    }
+    return;
+  }
+  auto it = live_tensors.find(ptr);
+  if (it == live_tensors.end()) return;
+  stats[it->second.first].live -= it->second.second;
+  live_total -= it->second.second;
+  live_tensors.erase(it);
+}
+
+void scopes_write_report(FILE* out) {
+  if (!scopes_active || snapshot_total == 0) return;
+  auto& t = table();
+  std::lock_guard<std::mutex> lock(t.mutex);
+
+  // by operator: the innermost name of each stack, summed
+  std::unordered_map<uint32_t, int64_t> by_name;
+  std::vector<std::pair<int64_t, uint32_t>> by_stack;
+  for (uint32_t n = 0; n < snapshot.size(); n++) {
+    if (snapshot[n] <= 0) continue;
+    by_name[t.nodes[n].name] += snapshot[n];
+    by_stack.emplace_back(snapshot[n], n);
+  }
+  std::vector<std::pair<int64_t, uint32_t>> names;
+  for (const auto& entry : by_name) names.emplace_back(entry.second, entry.first);
+  std::sort(names.begin(), names.end(), std::greater<>());
+  std::sort(by_stack.begin(), by_stack.end(), std::greater<>());
+
+  std::fprintf(out, "[ROCMPROF SUMMARY] torch scopes: peak live tensor bytes %" PRId64 ", %zu scope nodes, %" PRIu64
+               " scopes charged to an ancestor, %" PRIu64 " names past the %u name cap; live bytes at the peak "
+               "(within 1%%) by operator:\n",
+               peak_total, t.nodes.size(), t.overflow.load(std::memory_order_relaxed), t.other_names,
+               kMaxScopeNames);
+  process_report(out, ReportMerge::max, (double)peak_total, "torch.scopes.peak_live_bytes");
+  for (size_t i = 0; i < std::min<size_t>(15, names.size()); i++) {
+    std::fprintf(out, "[ROCMPROF SUMMARY]   %14" PRId64 " %s\n", names[i].first, t.names[names[i].second].c_str());
+    process_report(out, ReportMerge::max, (double)names[i].first, "torch.scopes.op.%s.live_bytes_at_peak",
+                   t.names[names[i].second].c_str());
+  }
+  std::fprintf(out, "[ROCMPROF SUMMARY] torch scopes: by stack:\n");
+  for (size_t i = 0; i < std::min<size_t>(10, by_stack.size()); i++) {
+    const ScopeStats& s = stats[by_stack[i].second];
+    std::fprintf(out, "[ROCMPROF SUMMARY]   %14" PRId64 " (own peak %" PRId64 ", %" PRIu64 " allocs) %s\n",
+                 by_stack[i].first, s.peak, s.allocs, scope_path(t, by_stack[i].second).c_str());
+  }
+}
+
+void scopes_write_table(FILE* out) {
+  auto& t = table();
+  std::lock_guard<std::mutex> lock(t.mutex);
+  for (uint32_t n = 0; n < t.nodes.size(); n++)
+    std::fprintf(out, "%u %u %s\n", n, t.nodes[n].parent, t.names[t.nodes[n].name].c_str());
+}
+
+} // namespace rocm_accelprof
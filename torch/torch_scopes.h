@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+// Operator and module scopes of tensor allocations, enabled with ACCELPROF_TORCH_SCOPES=1.
+//
+// A RecordFunction callback keeps a per-thread stack of the ATen operators and user scopes
+// (torch.autograd.profiler.record_function, module hooks) that are running. Stacks are
+// hash-consed into a table of (parent, name) nodes, so an allocation is tagged with one
+// node id, and entering a scope that was seen before on this thread is a lookup in a
+// thread-local cache. The table is capped at kMaxScopeNodes; deeper or newer scopes are
+// charged to their deepest known ancestor. Names are capped at kMaxScopeNames, past which
+// new ones (generated user scope names, Python frames) all become "<other>".
+//
+// ACCELPROF_TORCH_PYFRAME=N additionally tags 1 in N allocations with the Python frame
+// that was running (file:line function) as a child of the operator scope.
+//
+// Scope accounting is done by the flushing thread, in report order: live bytes per node
+// and a snapshot of them whenever the process-wide live tensor bytes reach a new peak.
+
+namespace rocm_accelprof {
+
+constexpr uint32_t kRootScope = 0;
+constexpr uint32_t kMaxScopeNodes = 1u << 18;
+constexpr uint32_t kMaxScopeNames = 1u << 16;
+
+extern bool scopes_active;
+
+// Reads the environment and registers the RecordFunction callbacks.
+void scopes_init();
+
+// Scope node of the calling thread, for an allocation it is about to record.
+uint32_t current_scope();
+
+// Accounting, called under the caller's flush lock with events in report order.
+void scopes_on_event(uint64_t ptr, int64_t delta, uint32_t scope);
+
+// Peak live tensor memory by operator and by scope stack.
+void scopes_write_report(FILE* out);
+
+// "id parent name" per node, to decode the scope ids of a tensor trace.
+void scopes_write_table(FILE* out);
+
+} // namespace rocm_accelprof